@@ -0,0 +1,1527 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "bench.h"
+#include "raycaster.h"
+#include "renderer.h"
+#include "player.h"
+#include "vector2f.h"
+#include "palette.h"
+#include "texturepack.h"
+#include "hud.h"
+#include "entity.h"
+#include "flowfield.h"
+#include "tilemap.h"
+#include "pvs.h"
+#include "trace.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+/* Timing parameters */
+#define BENCH_SAMPLES          21       /* Timed samples per benchmark, the median is reported */
+#define BENCH_MIN_SAMPLE_NS    2000000  /* Minimum duration of a single sample */
+#define BENCH_MAX_BATCH        (1 << 24)
+#define BENCH_INPUTS           1024     /* Number of seeded input vectors */
+#define BENCH_SEED             0x2545F491u
+
+/* Resolution of the 32-bit versus palettized strip benchmarks */
+#define BENCH_4K_WIDTH         3840
+#define BENCH_4K_HEIGHT        2160
+
+/* Startup benchmarks generate or map this many textures */
+#define BENCH_PACK_TEXTURES    256
+#define BENCH_PACK_TEMPLATE    "/tmp/raycaster-bench-XXXXXX"
+#define BENCH_PAGE_PIXELS      (4096 / sizeof(Uint32))
+
+/*
+ * Texture sets the frame and strip benchmarks can draw with: the game's
+ * own, and mixed sizes with and without power of two widths
+ */
+#define GAME_TEXTURES          0
+#define POT_TEXTURES           1
+#define NPOT_TEXTURES          2
+#define NUM_TEXTURE_SETS       3
+
+/* Entity and flow field benchmarks run on square maps with walls around them and pillars on this fraction of the tiles */
+#define BENCH_PILLAR_CHANCE    0.1f
+
+/* Potentially visible set benchmarks split those maps into square rooms of this side, with a door in every wall */
+#define BENCH_ROOM_SIZE        16
+
+/*
+ * Absolute timings differ between machines, so they are only compared
+ * against the baseline for information: a benchmark is marked slower if its
+ * median is more than REGRESSION_THRESHOLD slower than the baseline, and the
+ * difference is larger than REGRESSION_MAD_FACTOR times its median absolute
+ * deviation. The run only fails if an optimized kernel's time relative to
+ * its reference grows by more than REGRESSION_THRESHOLD over the baseline's,
+ * taking the fastest sample of each over RATIO_REPEATS more timings.
+ */
+#define REGRESSION_THRESHOLD   0.15
+#define REGRESSION_MAD_FACTOR  3.0
+#define RATIO_REPEATS          3
+
+#define MAX_BENCHMARKS         80
+
+/* Adaptive frames are compared against full casts over this many frames of the slow camera path */
+#define QUALITY_FRAMES         240
+
+/* Frames the cache miss comparison counts over */
+#define CACHE_CHECK_FRAMES     8
+#define MAX_BENCH_NAME         64
+
+/* Datatypes */
+typedef struct {
+    const char* name;
+    void (*setup)(int variant);
+    void (*run)(long ops);
+    int variant;
+} Benchmark;
+
+typedef struct {
+    char name[MAX_BENCH_NAME];
+    double medianNs;
+    double madNs;
+    double minNs;
+    long batch;
+} BenchResult;
+
+/* Fixed camera poses (x, y, facing angle in degrees) the benchmarks run over */
+static const float benchPoses[][3] = {
+    {2.5f * WALL_SIZE, 2.5f * WALL_SIZE,  90.0f},
+    {4.7f * WALL_SIZE, 3.1f * WALL_SIZE,  37.0f},
+    {1.6f * WALL_SIZE, 7.8f * WALL_SIZE, 217.0f},
+    {6.6f * WALL_SIZE, 5.2f * WALL_SIZE, 352.0f},
+    {5.2f * WALL_SIZE, 1.5f * WALL_SIZE, 135.0f}
+};
+#define NUM_BENCH_POSES  (int)(sizeof(benchPoses) / sizeof(benchPoses[0]))
+
+/* Benchmark inputs */
+static Vector3f benchVectors[BENCH_INPUTS];
+static Vector2f benchVectors2f[BENCH_INPUTS];
+static Vector2f workVectors2f[BENCH_INPUTS];
+static Matrix3f benchMatrix;
+static RayTuple initialRays[NUM_BENCH_POSES][VIEWPLANE_LENGTH];
+static RayTuple extendedRays[NUM_BENCH_POSES][VIEWPLANE_LENGTH];
+static RayTuple workRays[VIEWPLANE_LENGTH];
+static struct {
+    float wallYStart;
+    float length;
+    int textureX;
+    int texture;
+} benchStrips[BENCH_INPUTS];
+
+static Uint32* benchFrame4k = NULL;
+static Uint8* benchIndexedFrame4k = NULL;
+static TileColumn benchTileColumns4k[BENCH_4K_WIDTH];
+static WallTexture benchTextureSets[NUM_TEXTURE_SETS][4];
+static short* benchMap = NULL;
+static EntityWorld benchEntities;
+static FlowField benchFlow;
+static int benchFlowX;
+static int benchFlowY;
+static TileMap benchTileMap;
+static PotentiallyVisibleSet benchPvs;
+static char benchPackPath[FILENAME_MAX];
+static int benchPaletteSet = GAME_TEXTURES;     /* The texture set runInitPalette builds a palette for */
+static const int benchTextureSizes[NUM_TEXTURE_SETS][4] = {
+    {TEXTURE_SIZE, TEXTURE_SIZE, TEXTURE_SIZE, TEXTURE_SIZE},
+    {32, 128, 256, 1024},
+    {48, 100, 320, 1000}
+};
+
+/* Keeps the compiler from discarding benchmarked work */
+static volatile float benchSink;
+static unsigned int benchRandomState;
+
+
+/*========================================================
+ * Inputs
+ *========================================================
+ */
+
+static void seedBenchRandom() {
+    benchRandomState = BENCH_SEED;
+}
+
+/* Returns a pseudo-random float in [lo, hi) from a fixed-seed xorshift generator */
+static float benchRandom(float lo, float hi) {
+    benchRandomState ^= benchRandomState << 13;
+    benchRandomState ^= benchRandomState >> 17;
+    benchRandomState ^= benchRandomState << 5;
+
+    return lo + (hi - lo) * (benchRandomState >> 8) / (float)(1 << 24);
+}
+
+static void setBenchPose(int pose) {
+    float angle = benchPoses[pose][2] * PI / 180.0f;
+
+    playerPos.x = benchPoses[pose][0];
+    playerPos.y = benchPoses[pose][1];
+    playerDir.x = cos(angle);
+    playerDir.y = sin(angle);
+
+    /* The viewplane stays perpendicular to the player direction */
+    viewplaneDir.x = -playerDir.y;
+    viewplaneDir.y = playerDir.x;
+}
+
+/* A slow camera path: turning by one degree and drifting a couple of units per frame */
+static void setSlowMotionPose(long frame) {
+    float angle = (frame % 360) * PI / 180.0f;
+
+    playerPos.x = 5.0f * WALL_SIZE + 0.5f * WALL_SIZE * sin(frame * 0.04f);
+    playerPos.y = 5.0f * WALL_SIZE + 0.5f * WALL_SIZE * cos(frame * 0.03f);
+    playerDir.x = cos(angle);
+    playerDir.y = sin(angle);
+    viewplaneDir.x = -playerDir.y;
+    viewplaneDir.y = playerDir.x;
+}
+
+static void prepareBenchInputs() {
+    int i, pose;
+
+    seedBenchRandom();
+
+    for(i = 0; i < BENCH_INPUTS; i++) {
+        benchVectors[i].x = benchRandom(-WALL_SIZE, WALL_SIZE);
+        benchVectors[i].y = benchRandom(-WALL_SIZE, WALL_SIZE);
+        benchVectors[i].z = 1;
+        benchVectors2f[i] = vector3fTo2f(&benchVectors[i]);
+
+        benchStrips[i].length = benchRandom(8.0f, 4.0f * WINDOW_HEIGHT);
+        benchStrips[i].wallYStart = (WINDOW_HEIGHT / 2.0f) - (benchStrips[i].length / 2.0f);
+        benchStrips[i].textureX = (int)benchRandom(0, TEXTURE_SIZE);
+        benchStrips[i].texture = (int)benchRandom(0, 4);
+    }
+
+    matrix3fCopy(&benchMatrix, &counterClockwiseRotation);
+
+    /* Snapshot the rays at each stage of casting for every pose */
+    for(pose = 0; pose < NUM_BENCH_POSES; pose++) {
+        setBenchPose(pose);
+        initializeRayDirections();
+        memcpy(initialRays[pose], rays, sizeof(rays));
+        extendRaysToFirstHit(rays);
+        memcpy(extendedRays[pose], rays, sizeof(rays));
+    }
+}
+
+/* Generate the mixed size texture sets. Returns zero if they could not be allocated. */
+static int createBenchTextureSets() {
+    int set, t;
+
+    memcpy(benchTextureSets[GAME_TEXTURES], TEXTURES, sizeof(benchTextureSets[GAME_TEXTURES]));
+    for(set = GAME_TEXTURES + 1; set < NUM_TEXTURE_SETS; set++) {
+        for(t = 0; t < 4; t++) {
+            Uint32* pixels = generateXorTexture(benchTextureSizes[set][t], (t & 1) ? 0xFF : 0, (t & 2) ? 0xFF : 0, 0xFF);
+
+            if(!pixels)
+                return FALSE;
+            initWallTexture(&benchTextureSets[set][t], pixels, benchTextureSizes[set][t], benchTextureSizes[set][t]);
+        }
+    }
+
+    return TRUE;
+}
+
+/* Restore the game's textures and free the mixed size sets */
+static void destroyBenchTextureSets() {
+    int set, t;
+
+    memcpy(TEXTURES, benchTextureSets[GAME_TEXTURES], sizeof(benchTextureSets[GAME_TEXTURES]));
+    for(set = GAME_TEXTURES + 1; set < NUM_TEXTURE_SETS; set++) {
+        for(t = 0; t < 4; t++) {
+            if(benchTextureSets[set][t].pixels)
+                destroyTexture(benchTextureSets[set][t].pixels);
+            benchTextureSets[set][t].pixels = NULL;
+        }
+    }
+}
+
+/* Draw walls with a texture set. Only the game's textures have palette indices. */
+static void useBenchTextures(int set) {
+    memcpy(TEXTURES, benchTextureSets[set], sizeof(benchTextureSets[set]));
+}
+
+/*
+ * Build the game's palette, which is built lazily and torn down by the
+ * palette benchmarks, and keep the game set's indexed textures current.
+ * Returns zero if it could not be built.
+ */
+static int useGamePalette() {
+    useBenchTextures(GAME_TEXTURES);
+    if(indexedScreenBuffer)
+        return TRUE;
+    if(!initPalette())
+        return FALSE;
+
+    memcpy(benchTextureSets[GAME_TEXTURES], TEXTURES, sizeof(benchTextureSets[GAME_TEXTURES]));
+    return TRUE;
+}
+
+/* Scale a strip's texture column, drawn from the generated size, to a texture */
+static int benchTextureX(int s, const WallTexture* texture) {
+    return benchStrips[s].textureX * texture->width / TEXTURE_SIZE;
+}
+
+
+/*========================================================
+ * Benchmarks
+ *========================================================
+ */
+
+static void noSetup(int variant) {
+    (void)variant;
+}
+
+static void runVectorAdd(long ops) {
+    Vector3f acc = HOMOGENEOUS_V3;
+    long i;
+
+    for(i = 0; i < ops; i++)
+        acc = vectorAdd(&acc, &benchVectors[i % BENCH_INPUTS]);
+    benchSink = acc.x + acc.y;
+}
+
+static void runNormalizeVector(long ops) {
+    float acc = 0;
+    long i;
+
+    for(i = 0; i < ops; i++) {
+        Vector3f v = normalizeVector(&benchVectors[i % BENCH_INPUTS]);
+        acc += v.x;
+    }
+    benchSink = acc;
+}
+
+static void runVectorProjection(long ops) {
+    float acc = 0;
+    long i;
+
+    for(i = 0; i < ops; i++) {
+        Vector3f v = vectorProjection(&benchVectors[i % BENCH_INPUTS], &benchVectors[(i + 1) % BENCH_INPUTS]);
+        acc += v.y;
+    }
+    benchSink = acc;
+}
+
+static void runMatrixVectorMultiply(long ops) {
+    float acc = 0;
+    long i;
+
+    for(i = 0; i < ops; i++) {
+        Vector3f v = benchVectors[i % BENCH_INPUTS];
+        matrixVectorMultiply(&benchMatrix, &v);
+        acc += v.x;
+    }
+    benchSink = acc;
+}
+
+static void runVector2fAdd(long ops) {
+    Vector2f acc = vector2f(0, 0);
+    long i;
+
+    for(i = 0; i < ops; i++)
+        acc = vector2fAdd(acc, benchVectors2f[i % BENCH_INPUTS]);
+    benchSink = acc.x + acc.y;
+}
+
+static void runNormalizeVector2f(long ops) {
+    float acc = 0;
+    long i;
+
+    for(i = 0; i < ops; i++)
+        acc += normalizeVector2f(benchVectors2f[i % BENCH_INPUTS]).x;
+    benchSink = acc;
+}
+
+static void runVector2fProjection(long ops) {
+    float acc = 0;
+    long i;
+
+    for(i = 0; i < ops; i++)
+        acc += vector2fProjection(benchVectors2f[i % BENCH_INPUTS], benchVectors2f[(i + 1) % BENCH_INPUTS]).y;
+    benchSink = acc;
+}
+
+static void runMatrixVector2fMultiply(long ops) {
+    float acc = 0;
+    long i;
+
+    for(i = 0; i < ops; i++)
+        acc += matrixVector2fMultiply(&benchMatrix, benchVectors2f[i % BENCH_INPUTS]).x;
+    benchSink = acc;
+}
+
+/* One op processes the whole input array, including restoring it */
+static void runNormalizeVector2fArray(long ops) {
+    long i;
+
+    for(i = 0; i < ops; i++) {
+        memcpy(workVectors2f, benchVectors2f, sizeof(workVectors2f));
+        normalizeVector2fArray(workVectors2f, BENCH_INPUTS);
+    }
+    benchSink = workVectors2f[0].x;
+}
+
+static void runMatrixVector2fArrayMultiply(long ops) {
+    long i;
+
+    for(i = 0; i < ops; i++) {
+        memcpy(workVectors2f, benchVectors2f, sizeof(workVectors2f));
+        matrixVector2fArrayMultiply(&benchMatrix, workVectors2f, BENCH_INPUTS);
+    }
+    benchSink = workVectors2f[0].y;
+}
+
+static void runVerticalRayStep(long ops) {
+    float acc = 0;
+    long i;
+
+    for(i = 0; i < ops; i++) {
+        Vector3f v = findVerticalRayStepVector(&benchVectors[i % BENCH_INPUTS]);
+        acc += v.y;
+    }
+    benchSink = acc;
+}
+
+static void runHorizontalRayStep(long ops) {
+    float acc = 0;
+    long i;
+
+    for(i = 0; i < ops; i++) {
+        Vector3f v = findHorizontalRayStepVector(&benchVectors[i % BENCH_INPUTS]);
+        acc += v.x;
+    }
+    benchSink = acc;
+}
+
+/* One op casts a whole frame of rays, including restoring its input rays */
+static void runExtendRaysToFirstHit(long ops) {
+    long i;
+
+    for(i = 0; i < ops; i++) {
+        int pose = i % NUM_BENCH_POSES;
+
+        setBenchPose(pose);
+        memcpy(workRays, initialRays[pose], sizeof(workRays));
+        extendRaysToFirstHit(workRays);
+    }
+    benchSink = workRays[0].vRay.x;
+}
+
+static void runRaycast(long ops) {
+    long i;
+
+    for(i = 0; i < ops; i++) {
+        int pose = i % NUM_BENCH_POSES;
+
+        setBenchPose(pose);
+        memcpy(workRays, extendedRays[pose], sizeof(workRays));
+        raycast(workRays);
+    }
+    benchSink = workRays[0].hRay.y;
+}
+
+static void runTexturedStrip(long ops) {
+    long i;
+
+    for(i = 0; i < ops; i++) {
+        int s = i % BENCH_INPUTS;
+        drawTexturedStrip(i % WINDOW_WIDTH, benchStrips[s].wallYStart, benchStrips[s].length,
+                benchStrips[s].textureX, &TEXTURES[benchStrips[s].texture], i & 1);
+    }
+    benchSink = screenBuffer[0];
+}
+
+static void runUntexturedStrip(long ops) {
+    long i;
+
+    for(i = 0; i < ops; i++) {
+        int s = i % BENCH_INPUTS;
+        drawUntexturedStrip(i % WINDOW_WIDTH, benchStrips[s].wallYStart, benchStrips[s].length,
+                COLORS[benchStrips[s].texture], i & 1);
+    }
+    benchSink = screenBuffer[0];
+}
+
+/* Draw the shaded textured strip for a column of a 4K frame */
+static void drawStrip4k(long frame, int x, const int indexed) {
+    int s = (frame * 7 + x) % BENCH_INPUTS;
+    float length = benchStrips[s].length * BENCH_4K_HEIGHT / WINDOW_HEIGHT;
+    float wallYStart = (BENCH_4K_HEIGHT / 2.0f) - (length / 2.0f);
+    const WallTexture* texture = &TEXTURES[benchStrips[s].texture];
+
+    if(indexed)
+        getIndexedStripKernel(TRUE, x & 1)(benchIndexedFrame4k + x, BENCH_4K_WIDTH, BENCH_4K_HEIGHT, wallYStart, length,
+                benchTextureX(s, texture), texture, 0);
+    else
+        getStripKernel(TRUE, x & 1)(benchFrame4k + x, BENCH_4K_WIDTH, BENCH_4K_HEIGHT, wallYStart, length,
+                benchTextureX(s, texture), texture, 0);
+}
+
+/* The variant is the texture set to draw with */
+static void setupTextureSet(int variant) {
+    useBenchTextures(variant);
+}
+
+/* One op draws a 4K frame of textured strips in 32-bit color */
+static void runStrips4k(long ops) {
+    long i;
+    int x;
+
+    for(i = 0; i < ops; i++)
+        for(x = 0; x < BENCH_4K_WIDTH; x++)
+            drawStrip4k(i, x, FALSE);
+    benchSink = benchFrame4k[0];
+}
+
+/*
+ * Tiled strip variants are encoded as (texture set << 1) | scalar sampling,
+ * where scalar sampling makes the tiled renderer use scalar loads instead
+ * of AVX2 gathers
+ */
+static void setupTiledStrips(int variant) {
+    setGatherSampling(!(variant & 1));
+    useBenchTextures(variant >> 1);
+}
+
+/* One op draws the same 4K frame as runStrips4k with the tiled renderer */
+static void runTiledStrips4k(long ops) {
+    long i;
+    int x;
+
+    for(i = 0; i < ops; i++) {
+        for(x = 0; x < BENCH_4K_WIDTH; x++) {
+            int s = (i * 7 + x) % BENCH_INPUTS;
+            float length = benchStrips[s].length * BENCH_4K_HEIGHT / WINDOW_HEIGHT;
+            const WallTexture* texture = &TEXTURES[benchStrips[s].texture];
+
+            prepareTileColumn(&benchTileColumns4k[x], BENCH_4K_HEIGHT, (BENCH_4K_HEIGHT / 2.0f) - (length / 2.0f), length,
+                    benchTextureX(s, texture), texture, 0, x & 1);
+        }
+        renderTiles(benchFrame4k, BENCH_4K_WIDTH, BENCH_4K_HEIGHT, benchTileColumns4k, 0, BENCH_4K_WIDTH);
+    }
+    benchSink = benchFrame4k[0];
+}
+
+static void setupIndexedStrips(int variant) {
+    (void)variant;
+    useGamePalette();
+}
+
+/* One op draws a 4K frame of textured strips as palette indices, and expands it to 32-bit color */
+static void runIndexedStrips4k(long ops) {
+    long i;
+    int x;
+
+    for(i = 0; i < ops; i++) {
+        for(x = 0; x < BENCH_4K_WIDTH; x++)
+            drawStrip4k(i, x, TRUE);
+        expandIndexedPixels(benchIndexedFrame4k, benchFrame4k, BENCH_4K_WIDTH * BENCH_4K_HEIGHT);
+    }
+    benchSink = benchFrame4k[0];
+}
+
+static void runExpand4k(long ops) {
+    long i;
+
+    for(i = 0; i < ops; i++)
+        expandIndexedPixels(benchIndexedFrame4k, benchFrame4k, BENCH_4K_WIDTH * BENCH_4K_HEIGHT);
+    benchSink = benchFrame4k[0];
+}
+
+static void runScalarExpand4k(long ops) {
+    long i;
+
+    for(i = 0; i < ops; i++)
+        expandIndexedPixelsScalar(benchIndexedFrame4k, benchFrame4k, BENCH_4K_WIDTH * BENCH_4K_HEIGHT);
+    benchSink = benchFrame4k[0];
+}
+
+/* One op creates and destroys a texture, recycling its pixels through the pool */
+static void runCreateDestroyTexture(long ops) {
+    long i;
+
+    for(i = 0; i < ops; i++) {
+        void* texture = createTexture(TEXTURE_SIZE, TEXTURE_SIZE);
+        benchSink = texture != NULL;
+        destroyTexture(texture);
+    }
+}
+
+/* One op generates the startup textures procedurally, as done without a texture pack */
+static void runGenerateTextures(long ops) {
+    Uint32* textures[BENCH_PACK_TEXTURES];
+    long i;
+    int t;
+
+    for(i = 0; i < ops; i++) {
+        for(t = 0; t < BENCH_PACK_TEXTURES; t++)
+            textures[t] = generateXorTexture(TEXTURE_SIZE, (t & 1) ? 0xFF : 0, (t & 2) ? 0xFF : 0, (t & 4) ? 0xFF : 0);
+        benchSink = textures[BENCH_PACK_TEXTURES - 1][1];
+        for(t = 0; t < BENCH_PACK_TEXTURES; t++)
+            destroyTexture(textures[t]);
+    }
+}
+
+/*
+ * One op maps the same number of textures from a pack and touches every
+ * page of each of them, so that it times getting usable pixels as
+ * generating them does rather than only mapping the file
+ */
+static void runMapTexturePack(long ops) {
+    TexturePack pack;
+    long i, p;
+    int t;
+
+    for(i = 0; i < ops; i++) {
+        Uint32 sum = 0;
+
+        if(!openTexturePack(benchPackPath, &pack))
+            return;
+        for(t = 0; t < BENCH_PACK_TEXTURES; t++) {
+            const Uint32* pixels = getPackTexture(&pack, t, 0);
+            long size = (long)pack.entries[t].width * pack.entries[t].height;
+
+            for(p = 0; p < size; p += BENCH_PAGE_PIXELS)
+                sum += pixels[p];
+        }
+        benchSink = sum;
+        closeTexturePack(&pack);
+    }
+}
+
+/* The variant is the texture set whose palette is built */
+static void setupPaletteBuild(int variant) {
+    benchPaletteSet = variant;
+}
+
+/*
+ * One op builds the palette of a texture set and indexes its textures, as
+ * done the first time palettized rendering is turned on. The game's palette
+ * is left torn down, to be built again by useGamePalette.
+ */
+static void runInitPalette(long ops) {
+    long i;
+
+    useBenchTextures(benchPaletteSet);
+    for(i = 0; i < ops; i++) {
+        destroyPalette();
+        benchSink = initPalette();
+    }
+    destroyPalette();
+    useBenchTextures(GAME_TEXTURES);
+}
+
+/*
+ * Write the pack mapped by runMapTexturePack to a new temporary file, with
+ * the same textures runGenerateTextures creates
+ */
+static int writeBenchTexturePack() {
+    PackSource textures[BENCH_PACK_TEXTURES];
+    int t, written;
+#ifndef _WIN32
+    int file;
+
+    strcpy(benchPackPath, BENCH_PACK_TEMPLATE);
+    file = mkstemp(benchPackPath);
+    if(file < 0)
+        return FALSE;
+    close(file);
+#else
+    if(!tmpnam(benchPackPath))
+        return FALSE;
+#endif
+
+    for(t = 0; t < BENCH_PACK_TEXTURES; t++) {
+        textures[t].name = "bench";
+        textures[t].width = textures[t].height = TEXTURE_SIZE;
+        textures[t].pixels = generateXorTexture(TEXTURE_SIZE, (t & 1) ? 0xFF : 0, (t & 2) ? 0xFF : 0, (t & 4) ? 0xFF : 0);
+    }
+
+    written = writeTexturePack(benchPackPath, textures, BENCH_PACK_TEXTURES, TRUE);
+    for(t = 0; t < BENCH_PACK_TEXTURES; t++)
+        destroyTexture((Uint32*)textures[t].pixels);
+
+    return written;
+}
+
+/* Fill the HUD's frame history so that the whole sparkline is drawn */
+static void setupHud(int variant) {
+    int i;
+
+    (void)variant;
+    for(i = 0; i < HUD_HISTORY; i++)
+        recordHudFrame(10.0 + (i % 16) * 2.0);
+}
+
+/* One op draws the HUD over a frame */
+static void runDrawHud(long ops) {
+    long i;
+
+    for(i = 0; i < ops; i++)
+        drawHud(screenBuffer);
+    benchSink = screenBuffer[XY_TO_SCREEN_INDEX(HUD_X, HUD_Y)];
+}
+
+/* One op begins and ends a zone while no trace is running. Without ENABLE_TRACING it costs nothing. */
+static void runIdleTraceZone(long ops) {
+    long i;
+
+    for(i = 0; i < ops; i++) {
+        TRACE_BEGIN(benchZone);
+        benchSink = i;
+        TRACE_END(benchZone);
+    }
+}
+
+/* Generate the square map the entities and flow fields run on, dropping the ones on the previous map */
+static void generateBenchMap(int side) {
+    int row, col;
+
+    destroyEntityWorld(&benchEntities);
+    destroyFlowField(&benchFlow);
+    free(benchMap);
+    benchMap = malloc((size_t)side * side * sizeof(short));
+    if(!benchMap) {
+        fprintf(stderr, "Could not allocate a %dx%d map\n", side, side);
+        exit(EXIT_FAILURE);
+    }
+
+    seedBenchRandom();
+    for(row = 0; row < side; row++) {
+        for(col = 0; col < side; col++) {
+            int border = row == 0 || col == 0 || row == side - 1 || col == side - 1;
+            benchMap[row * side + col] = (border || benchRandom(0, 1) < BENCH_PILLAR_CHANCE) ? W : 0;
+        }
+    }
+}
+
+/*
+ * Entity variants are encoded as (map side in tiles << 17) | entity count.
+ * The map is generated and the entities spawned here, so that each op
+ * only advances them.
+ */
+static void setupEntities(int variant) {
+    int side = variant >> 17, count = variant & 0x1FFFF;
+
+    generateBenchMap(side);
+    if(!initEntityWorld(&benchEntities, benchMap, side, side, count)) {
+        fprintf(stderr, "Could not allocate %d entities on a %dx%d map\n", count, side, side);
+        exit(EXIT_FAILURE);
+    }
+    spawnEntities(&benchEntities, count, BENCH_SEED);
+}
+
+/* One op advances all entities by a simulation tick */
+static void runEntityTicks(long ops) {
+    long i;
+
+    for(i = 0; i < ops; i++)
+        updateEntities(&benchEntities);
+    benchSink = benchEntities.x[0] + benchEntities.contacts;
+}
+
+/*
+ * Flow field variants are the map side in tiles. The target is the
+ * middle of the map, which is kept clear along with the tile east of it
+ * for the target to move back and forth between.
+ */
+static void setupFlowField(int variant) {
+    generateBenchMap(variant);
+    benchFlowX = benchFlowY = variant / 2;
+    benchMap[benchFlowY * variant + benchFlowX] = 0;
+    benchMap[benchFlowY * variant + benchFlowX + 1] = 0;
+
+    if(!initFlowField(&benchFlow, benchMap, variant, variant)) {
+        fprintf(stderr, "Could not allocate a %dx%d flow field\n", variant, variant);
+        exit(EXIT_FAILURE);
+    }
+    rebuildFlowField(&benchFlow, benchFlowX, benchFlowY);
+}
+
+/* One op integrates the field from scratch */
+static void runFlowRebuild(long ops) {
+    long i;
+
+    for(i = 0; i < ops; i++)
+        rebuildFlowField(&benchFlow, benchFlowX, benchFlowY);
+    benchSink = benchFlow.rounds;
+}
+
+/* One op moves the target a tile east or back west, and updates the field in place */
+static void runFlowStep(long ops) {
+    static long step = 0;
+    long i;
+
+    for(i = 0; i < ops; i++)
+        updateFlowField(&benchFlow, benchFlowX + (++step & 1), benchFlowY);
+    benchSink = benchFlow.bands[0].visited;
+}
+
+/* One op looks up the direction to the target from a tile, scattered over the map */
+static void runFlowDirection(long ops) {
+    int side = benchFlow.gridWidth;
+    Vector2f direction = vector2f(0, 0);
+    long i;
+
+    for(i = 0; i < ops; i++)
+        getFlowDirection(&benchFlow, (i * 977) % side, (i * 631) % side, &direction);
+    benchSink = direction.x;
+}
+
+/* Map edit variants are the map side in tiles, with a flow field following the edits */
+static void setupMapEdits(int variant) {
+    setupFlowField(variant);
+    initTileMap(&benchTileMap, benchMap, variant, variant);
+    addMapListener(&benchTileMap, flowFieldMapListener, &benchFlow);
+}
+
+/*
+ * One op knocks down or builds a wall on a tile scattered over the map,
+ * and the next one changes it back. The target's tile is left alone.
+ */
+static void runMapEdits(long ops) {
+    static long edit = 0;
+    int side = benchTileMap.gridWidth;
+    long i;
+
+    for(i = 0; i < ops; i++, edit++) {
+        int x = (int)((edit >> 1) * 977 % side), y = (int)((edit >> 1) * 631 % side);
+
+        if(x == benchFlowX && y == benchFlowY)
+            x++;
+        setMapTile(&benchTileMap, x, y, (getMapTile(&benchTileMap, x, y) > 0) ? 0 : W);
+    }
+    benchSink = benchFlow.bands[0].visited;
+}
+
+/* Wall the bench map off into rooms, each with a door at a random spot of its walls above and to the left */
+static void generateBenchRooms(int side) {
+    int row, col, i;
+
+    generateBenchMap(side);
+    for(row = 0; row < side; row += BENCH_ROOM_SIZE) {
+        for(col = 0; col < side; col += BENCH_ROOM_SIZE) {
+            for(i = 0; i < BENCH_ROOM_SIZE && row + i < side && col + i < side; i++) {
+                benchMap[row * side + col + i] = W;
+                benchMap[(row + i) * side + col] = W;
+            }
+        }
+    }
+
+    for(row = BENCH_ROOM_SIZE; row < side; row += BENCH_ROOM_SIZE) {
+        for(col = BENCH_ROOM_SIZE; col < side; col += BENCH_ROOM_SIZE) {
+            benchMap[row * side + MIN(col - BENCH_ROOM_SIZE + 1 + (int)benchRandom(0, BENCH_ROOM_SIZE - 1), side - 2)] = 0;
+            benchMap[MIN(row - BENCH_ROOM_SIZE + 1 + (int)benchRandom(0, BENCH_ROOM_SIZE - 1), side - 2) * side + col] = 0;
+        }
+    }
+}
+
+/*
+ * Potentially visible set variants are encoded as (map side in tiles << 6)
+ * | cluster size. The set is built once here to report its size.
+ */
+static void setupPvs(int variant) {
+    int side = variant >> 6, clusterSize = variant & 0x3F;
+    long clusters;
+
+    generateBenchRooms(side);
+    destroyPvs(&benchPvs);
+    if(!buildPvs(&benchPvs, benchMap, side, side, clusterSize)) {
+        fprintf(stderr, "Could not allocate a potentially visible set of a %dx%d map\n", side, side);
+        exit(EXIT_FAILURE);
+    }
+
+    clusters = (long)benchPvs.clustersWide * benchPvs.clustersHigh;
+    printf("%dx%d map in %dx%d clusters: %ld bytes of rows and %ld of row starts, %.1f bytes per cluster (%ld uncompressed)\n",
+            side, side, clusterSize, clusterSize, benchPvs.size, (clusters + 1) * (long)sizeof(long),
+            benchPvs.size / (double)clusters, clusters * benchPvs.rowBytes);
+}
+
+/* One op builds the set from scratch */
+static void runPvsBuild(long ops) {
+    int side = benchPvs.gridWidth, clusterSize = benchPvs.clusterSize;
+    long i;
+
+    for(i = 0; i < ops; i++) {
+        destroyPvs(&benchPvs);
+        buildPvs(&benchPvs, benchMap, side, side, clusterSize);
+    }
+    benchSink = benchPvs.size;
+}
+
+/* One op moves the viewpoint to a tile scattered over the map, and checks if another one is visible from it */
+static void runPvsQuery(long ops) {
+    int side = benchPvs.gridWidth, visible = 0;
+    long i;
+
+    for(i = 0; i < ops; i++) {
+        setPvsViewpoint(&benchPvs, ((i * 977) % side + 0.5f) * WALL_SIZE, ((i * 631) % side + 0.5f) * WALL_SIZE);
+        visible += isTilePotentiallyVisible(&benchPvs, (i * 331) % side, (i * 211) % side);
+    }
+    benchSink = visible;
+}
+
+/* Column renderer variants are encoded as (textured << 1) | distorted */
+static void setupColumnRenderer(int variant) {
+    /* The reference path reads the mode globals itself */
+    textureMode = (variant >> 1) & 1;
+    distortion = variant & 1;
+}
+
+static void runColumns(ColumnRenderer renderColumns, long ops) {
+    long i;
+
+    for(i = 0; i < ops; i++) {
+        int pose = i % NUM_BENCH_POSES;
+
+        setBenchPose(pose);
+        memcpy(rays, extendedRays[pose], sizeof(rays));
+        renderColumns(0, WINDOW_WIDTH);
+    }
+    benchSink = screenBuffer[0];
+}
+
+static void runReferenceColumns(long ops) {
+    runColumns(renderReferenceColumns, ops);
+}
+
+static void renderSpecializedColumns(int start, int end) {
+    resolveColumnHits(start, end);
+    getColumnRenderer(textureMode, distortion)(start, end);
+}
+
+static void runSpecializedColumns(long ops) {
+    runColumns(renderSpecializedColumns, ops);
+}
+
+/*
+ * Frame variants are encoded as (texture set << 9) | (scalar sampling << 8) | (tiled << 7) |
+ * (adaptive step << 3) | (palettized << 2) | (textured << 1) | interlaced
+ */
+static void setupFrame(int variant) {
+    if((variant >> 2) & 1)
+        useGamePalette();
+    textureMode = (variant >> 1) & 1;
+    interlacedMode = variant & 1;
+    palettizedMode = (variant >> 2) & 1;
+    adaptiveStep = MAX((variant >> 3) & 0xF, 1);
+    tiledMode = (variant >> 7) & 1;
+    setGatherSampling(!((variant >> 8) & 1));
+    useBenchTextures((variant >> 9) & 3);
+    distortion = FALSE;
+}
+
+/* One op casts and draws a frame along the slow camera path */
+static void runFrame(long ops) {
+    static long frame = 0;
+    long i;
+
+    for(i = 0; i < ops; i++) {
+        setSlowMotionPose(frame++);
+        updateRaycaster();
+        drawProjectedScene();
+    }
+    benchSink = screenBuffer[0];
+}
+
+static const Benchmark benchmarks[] = {
+    {"linalg/vectorAdd",                         noSetup, runVectorAdd, 0},
+    {"linalg/normalizeVector",                   noSetup, runNormalizeVector, 0},
+    {"linalg/vectorProjection",                  noSetup, runVectorProjection, 0},
+    {"linalg/matrixVectorMultiply",              noSetup, runMatrixVectorMultiply, 0},
+    {"vector2f/vector2fAdd",                     noSetup, runVector2fAdd, 0},
+    {"vector2f/normalizeVector2f",               noSetup, runNormalizeVector2f, 0},
+    {"vector2f/vector2fProjection",              noSetup, runVector2fProjection, 0},
+    {"vector2f/matrixVector2fMultiply",          noSetup, runMatrixVector2fMultiply, 0},
+    {"vector2f/normalizeVector2fArray",          noSetup, runNormalizeVector2fArray, 0},
+    {"vector2f/matrixVector2fArrayMultiply",     noSetup, runMatrixVector2fArrayMultiply, 0},
+    {"raycaster/findVerticalRayStepVector",      noSetup, runVerticalRayStep, 0},
+    {"raycaster/findHorizontalRayStepVector",    noSetup, runHorizontalRayStep, 0},
+    {"raycaster/extendRaysToFirstHit",           noSetup, runExtendRaysToFirstHit, 0},
+    {"raycaster/raycast",                        noSetup, runRaycast, 0},
+    {"renderer/drawTexturedStrip",               noSetup, runTexturedStrip, 0},
+    {"renderer/drawUntexturedStrip",             noSetup, runUntexturedStrip, 0},
+    {"gfx/createDestroyTexture",                 noSetup, runCreateDestroyTexture, 0},
+    {"hud/drawHud",                              setupHud, runDrawHud, 0},
+    {"trace/idleZone",                           noSetup, runIdleTraceZone, 0},
+    {"entities/tick10k",                         setupEntities, runEntityTicks, (283 << 17) | 10000},
+    {"entities/tick100k",                        setupEntities, runEntityTicks, (894 << 17) | 100000},
+    {"entities/tick10k-dense",                   setupEntities, runEntityTicks, (64 << 17) | 10000},
+    {"flow/rebuild1024",                         setupFlowField, runFlowRebuild, 1024},
+    {"flow/rebuild4096",                         setupFlowField, runFlowRebuild, 4096},
+    {"flow/step1024",                            setupFlowField, runFlowStep, 1024},
+    {"flow/step4096",                            setupFlowField, runFlowStep, 4096},
+    {"flow/direction4096",                       setupFlowField, runFlowDirection, 4096},
+    {"map/edit4096",                             setupMapEdits, runMapEdits, 4096},
+    {"pvs/build256",                             setupPvs, runPvsBuild, (256 << 6) | 8},
+    {"pvs/build1024",                            setupPvs, runPvsBuild, (1024 << 6) | 16},
+    {"pvs/query1024",                            setupPvs, runPvsQuery, (1024 << 6) | 16},
+    {"startup/generateTextures256",              noSetup, runGenerateTextures, 0},
+    {"startup/mapTexturePack256",                noSetup, runMapTexturePack, 0},
+    {"startup/initPalette-mixed-pot",            setupPaletteBuild, runInitPalette, POT_TEXTURES},
+    {"startup/initPalette-mixed-npot",           setupPaletteBuild, runInitPalette, NPOT_TEXTURES},
+    {"columns/reference/flat-corrected",         setupColumnRenderer, runReferenceColumns, 0},
+    {"columns/specialized/flat-corrected",       setupColumnRenderer, runSpecializedColumns, 0},
+    {"columns/reference/flat-distorted",         setupColumnRenderer, runReferenceColumns, 1},
+    {"columns/specialized/flat-distorted",       setupColumnRenderer, runSpecializedColumns, 1},
+    {"columns/reference/textured-corrected",     setupColumnRenderer, runReferenceColumns, 2},
+    {"columns/specialized/textured-corrected",   setupColumnRenderer, runSpecializedColumns, 2},
+    {"columns/reference/textured-distorted",     setupColumnRenderer, runReferenceColumns, 3},
+    {"columns/specialized/textured-distorted",   setupColumnRenderer, runSpecializedColumns, 3},
+    {"frame/flat",                               setupFrame, runFrame, 0},
+    {"frame/flat-interlaced",                    setupFrame, runFrame, 1},
+    {"frame/textured",                           setupFrame, runFrame, 2},
+    {"frame/textured-interlaced",                setupFrame, runFrame, 3},
+    {"frame/textured-adaptive4",                 setupFrame, runFrame, (4 << 3) | 2},
+    {"frame/textured-adaptive8",                 setupFrame, runFrame, (8 << 3) | 2},
+    {"frame/textured-palettized",                setupFrame, runFrame, (1 << 2) | 2},
+    {"frame/textured-tiled",                     setupFrame, runFrame, (1 << 7) | 2},
+    {"frame/textured-tiled-scalar",              setupFrame, runFrame, (1 << 8) | (1 << 7) | 2},
+    {"frame/textured-mixed-pot",                 setupFrame, runFrame, (POT_TEXTURES << 9) | 2},
+    {"frame/textured-mixed-npot",                setupFrame, runFrame, (NPOT_TEXTURES << 9) | 2},
+    {"frame/textured-tiled-mixed-pot",           setupFrame, runFrame, (POT_TEXTURES << 9) | (1 << 7) | 2},
+    {"frame/textured-tiled-mixed-npot",          setupFrame, runFrame, (NPOT_TEXTURES << 9) | (1 << 7) | 2},
+    {"texture/strips4k-mixed-pot",               setupTextureSet, runStrips4k, POT_TEXTURES},
+    {"texture/strips4k-mixed-npot",              setupTextureSet, runStrips4k, NPOT_TEXTURES},
+    {"palette/strips4k-abgr",                    noSetup, runStrips4k, 0},
+    {"palette/strips4k-indexed",                 setupIndexedStrips, runIndexedStrips4k, 0},
+    {"tiled/strips4k",                           setupTiledStrips, runTiledStrips4k, 0},
+    {"tiled/strips4k-scalar",                    setupTiledStrips, runTiledStrips4k, 1},
+    {"tiled/strips4k-mixed-npot",                setupTiledStrips, runTiledStrips4k, NPOT_TEXTURES << 1},
+    {"palette/expand4k",                         noSetup, runExpand4k, 0},
+    {"palette/expand4k-scalar",                  noSetup, runScalarExpand4k, 0}
+};
+#define NUM_BENCHMARKS  (int)(sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+
+/*
+ * Approximate render modes checked for image quality against the exact
+ * textured frame, with the largest fraction of pixels allowed to differ
+ * and the largest difference allowed in any color channel.
+ */
+static const struct {
+    const char* name;
+    int variant;    /* Frame variant, as for setupFrame */
+    double maxPixelError;
+    int maxChannelError;
+} qualityChecks[] = {
+    {"quality/adaptive2",    (2 << 3) | 2, 0.001, 255},
+    {"quality/adaptive4",    (4 << 3) | 2, 0.001, 255},
+    {"quality/adaptive8",    (8 << 3) | 2, 0.002, 255},
+    {"quality/palettized",   (1 << 2) | 2, 1.0,   4},
+    {"quality/tiled",        (1 << 7) | 2, 0.0,   0},
+    {"quality/tiled-scalar", (1 << 8) | (1 << 7) | 2, 0.0, 0},
+    {"quality/tiled-mixed-pot",  (POT_TEXTURES << 9) | (1 << 7) | 2, 0.0, 0},
+    {"quality/tiled-mixed-npot", (NPOT_TEXTURES << 9) | (1 << 7) | 2, 0.0, 0}
+};
+#define NUM_QUALITY_CHECKS  (int)(sizeof(qualityChecks) / sizeof(qualityChecks[0]))
+
+/* Optimized kernels whose time relative to a reference kernel's is checked against the baseline */
+static const struct {
+    const char* optimized;
+    const char* reference;
+} ratioChecks[] = {
+    {"columns/specialized/flat-corrected",     "columns/reference/flat-corrected"},
+    {"columns/specialized/flat-distorted",     "columns/reference/flat-distorted"},
+    {"columns/specialized/textured-corrected", "columns/reference/textured-corrected"},
+    {"columns/specialized/textured-distorted", "columns/reference/textured-distorted"},
+    {"frame/textured-tiled",                   "frame/textured-tiled-scalar"},
+    {"tiled/strips4k",                         "tiled/strips4k-scalar"},
+    {"palette/expand4k",                       "palette/expand4k-scalar"}
+};
+#define NUM_RATIO_CHECKS  (int)(sizeof(ratioChecks) / sizeof(ratioChecks[0]))
+
+
+/*========================================================
+ * Timing
+ *========================================================
+ */
+
+static double elapsedNs(Uint64 start) {
+    return (SDL_GetPerformanceCounter() - start) * 1e9 / (double)SDL_GetPerformanceFrequency();
+}
+
+static int compareDoubles(const void* a, const void* b) {
+    double d = *(const double*)a - *(const double*)b;
+    return (d > 0) - (d < 0);
+}
+
+static double median(double* values, int count) {
+    qsort(values, count, sizeof(double), compareDoubles);
+    return (count % 2) ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2.0;
+}
+
+/*
+ * Time a benchmark as the median of BENCH_SAMPLES samples. The batch size of
+ * a sample is doubled until it runs for at least BENCH_MIN_SAMPLE_NS, which
+ * also serves as the warmup.
+ */
+static void timeBenchmark(const Benchmark* bench, BenchResult* result) {
+    double samples[BENCH_SAMPLES];
+    double deviations[BENCH_SAMPLES];
+    long batch = 1;
+    int i;
+
+    useBenchTextures(GAME_TEXTURES);
+    bench->setup(bench->variant);
+    seedBenchRandom();
+
+    for(;;) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        bench->run(batch);
+        if(elapsedNs(start) >= BENCH_MIN_SAMPLE_NS || batch >= BENCH_MAX_BATCH)
+            break;
+        batch *= 2;
+    }
+
+    for(i = 0; i < BENCH_SAMPLES; i++) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        bench->run(batch);
+        samples[i] = elapsedNs(start) / batch;
+    }
+
+    result->medianNs = median(samples, BENCH_SAMPLES);
+    result->minNs = samples[0];
+    for(i = 0; i < BENCH_SAMPLES; i++)
+        deviations[i] = fabs(samples[i] - result->medianNs);
+    result->madNs = median(deviations, BENCH_SAMPLES);
+    result->batch = batch;
+    snprintf(result->name, MAX_BENCH_NAME, "%s", bench->name);
+}
+
+
+/*========================================================
+ * Results
+ *========================================================
+ */
+
+static int writeResults(const char* path, BenchResult* results, int count) {
+    FILE* file = fopen(path, "w");
+    int i;
+
+    if(!file) {
+        fprintf(stderr, "Could not write benchmark results to %s\n", path);
+        return FALSE;
+    }
+
+    fprintf(file, "{\n  \"resolution\": [%d, %d],\n  \"samples\": %d,\n  \"benchmarks\": [\n", WINDOW_WIDTH, WINDOW_HEIGHT, BENCH_SAMPLES);
+    for(i = 0; i < count; i++) {
+        fprintf(file, "    {\"name\": \"%s\", \"median_ns\": %.3f, \"mad_ns\": %.3f, \"batch\": %ld, \"min_ns\": %.3f}%s\n",
+                results[i].name, results[i].medianNs, results[i].madNs, results[i].batch, results[i].minNs,
+                (i < count - 1) ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+
+    return TRUE;
+}
+
+/*
+ * Read the benchmark entries of a results file written by writeResults.
+ * Entries from files without minimums get a minimum of zero.
+ * Returns the number of entries read, or -1 if the file could not be read.
+ */
+static int readResults(const char* path, BenchResult* results, int maxCount) {
+    FILE* file = fopen(path, "r");
+    char line[256];
+    int count = 0;
+
+    if(!file)
+        return -1;
+
+    while(count < maxCount && fgets(line, sizeof(line), file)) {
+        char* entry = strstr(line, "\"name\": \"");
+        BenchResult* result = &results[count];
+
+        result->minNs = 0.0;
+        if(entry && sscanf(entry, "\"name\": \"%63[^\"]\", \"median_ns\": %lf, \"mad_ns\": %lf, \"batch\": %ld, \"min_ns\": %lf",
+                    result->name, &result->medianNs, &result->madNs, &result->batch, &result->minNs) >= 4)
+            count++;
+    }
+    fclose(file);
+
+    return count;
+}
+
+/* Returns the result with the given name, or NULL if there is none */
+static BenchResult* findResult(BenchResult* results, int count, const char* name) {
+    int i;
+
+    for(i = 0; i < count; i++)
+        if(!strcmp(results[i].name, name))
+            return &results[i];
+
+    return NULL;
+}
+
+/* Print how results changed against a baseline, for information only */
+static void compareResults(BenchResult* results, int count, BenchResult* baseline, int baselineCount) {
+    int i;
+
+    printf("\n%-42s %12s %12s %9s\n", "Benchmark", "Median (ns)", "Base (ns)", "Change");
+    for(i = 0; i < count; i++) {
+        BenchResult* base = findResult(baseline, baselineCount, results[i].name);
+        double change;
+        int slower;
+
+        if(!base) {
+            printf("%-42s %12.3f %12s %9s\n", results[i].name, results[i].medianNs, "-", "new");
+            continue;
+        }
+
+        change = (results[i].medianNs - base->medianNs) / base->medianNs;
+        slower = change > REGRESSION_THRESHOLD &&
+            (results[i].medianNs - base->medianNs) > REGRESSION_MAD_FACTOR * MAX(results[i].madNs, base->madNs);
+
+        printf("%-42s %12.3f %12.3f %+8.1f%%%s\n", results[i].name, results[i].medianNs, base->medianNs,
+                100.0 * change, slower ? "  slower" : "");
+    }
+}
+
+/* Time a benchmark again, keeping the faster minimum in its result */
+static void retimeMinimum(BenchResult* result) {
+    BenchResult retimed;
+    int i;
+
+    for(i = 0; i < NUM_BENCHMARKS; i++) {
+        if(!strcmp(benchmarks[i].name, result->name)) {
+            timeBenchmark(&benchmarks[i], &retimed);
+            result->minNs = MIN(result->minNs, retimed.minNs);
+            return;
+        }
+    }
+}
+
+/*
+ * Time the kernels of each ratio check again RATIO_REPEATS times, one after
+ * the other, so that their minimums are taken under the same conditions
+ */
+static void repeatRatioKernels(BenchResult* results, int count) {
+    int i, repeat;
+
+    for(i = 0; i < NUM_RATIO_CHECKS; i++) {
+        BenchResult* optimized = findResult(results, count, ratioChecks[i].optimized);
+        BenchResult* reference = findResult(results, count, ratioChecks[i].reference);
+
+        for(repeat = 0; optimized && reference && repeat < RATIO_REPEATS; repeat++) {
+            retimeMinimum(optimized);
+            retimeMinimum(reference);
+        }
+    }
+}
+
+/*
+ * Check each optimized kernel's time relative to its reference against the
+ * baseline's. Since both run on the same machine, the ratio carries over
+ * between machines where absolute times don't. Returns the number of
+ * regressions.
+ */
+static int compareRatios(BenchResult* results, int count, BenchResult* baseline, int baselineCount) {
+    int i, regressions = 0;
+
+    printf("\n%-42s %12s %12s %9s\n", "Optimized / reference (fastest)", "Ratio", "Base ratio", "Change");
+    for(i = 0; i < NUM_RATIO_CHECKS; i++) {
+        BenchResult* optimized = findResult(results, count, ratioChecks[i].optimized);
+        BenchResult* reference = findResult(results, count, ratioChecks[i].reference);
+        BenchResult* baseOptimized = findResult(baseline, baselineCount, ratioChecks[i].optimized);
+        BenchResult* baseReference = findResult(baseline, baselineCount, ratioChecks[i].reference);
+        double ratio, baseRatio, change;
+
+        if(!optimized || !reference || !baseOptimized || !baseReference ||
+                baseOptimized->minNs <= 0.0 || baseReference->minNs <= 0.0) {
+            printf("%-42s %12s %12s %9s\n", ratioChecks[i].optimized, "-", "-", "new");
+            continue;
+        }
+
+        ratio = optimized->minNs / reference->minNs;
+        baseRatio = baseOptimized->minNs / baseReference->minNs;
+        change = (ratio - baseRatio) / baseRatio;
+        regressions += change > REGRESSION_THRESHOLD;
+
+        printf("%-42s %12.3f %12.3f %+8.1f%%%s\n", ratioChecks[i].optimized, ratio, baseRatio,
+                100.0 * change, (change > REGRESSION_THRESHOLD) ? "  REGRESSION" : "");
+    }
+
+    return regressions;
+}
+
+
+/*========================================================
+ * Image quality
+ *========================================================
+ */
+
+static int channelDifference(Uint32 a, Uint32 b) {
+    int i, difference = 0;
+
+    for(i = 0; i < 24; i += 8)
+        difference = MAX(difference, abs((int)((a >> i) & 0xFF) - (int)((b >> i) & 0xFF)));
+
+    return difference;
+}
+
+/*
+ * Render frames of a variant along the slow camera path, and compare
+ * each with an exact textured frame of the same pose.
+ *
+ * variant:         The frame variant, as for setupFrame.
+ * pixelError:      Set to the fraction of pixels that differ.
+ * maxChannelError: Set to the largest difference in any color channel.
+ *
+ * Returns: Zero if the comparison buffer could not be allocated, non-zero otherwise.
+ */
+static int measureFrameError(int variant, double* pixelError, int* maxChannelError) {
+    Uint32* exactFrame = malloc(WINDOW_WIDTH * WINDOW_HEIGHT * sizeof(Uint32));
+    long frame, differing = 0;
+    int i;
+
+    if(!exactFrame)
+        return FALSE;
+
+    *maxChannelError = 0;
+    for(frame = 0; frame < QUALITY_FRAMES; frame++) {
+        setSlowMotionPose(frame);
+
+        /* The exact frame draws with the same texture set */
+        setupFrame((variant & (3 << 9)) | 2);
+        updateRaycaster();
+        drawProjectedScene();
+        memcpy(exactFrame, screenBuffer, WINDOW_WIDTH * WINDOW_HEIGHT * sizeof(Uint32));
+
+        setupFrame(variant);
+        updateRaycaster();
+        drawProjectedScene();
+
+        for(i = 0; i < WINDOW_WIDTH * WINDOW_HEIGHT; i++) {
+            if(screenBuffer[i] != exactFrame[i]) {
+                differing++;
+                *maxChannelError = MAX(*maxChannelError, channelDifference(screenBuffer[i], exactFrame[i]));
+            }
+        }
+    }
+
+    free(exactFrame);
+    *pixelError = differing / ((double)QUALITY_FRAMES * WINDOW_WIDTH * WINDOW_HEIGHT);
+    return TRUE;
+}
+
+/* Check the approximate render modes' error. Returns the number of failed checks. */
+static int checkImageQuality() {
+    int i, failures = 0;
+
+    printf("\n");
+    for(i = 0; i < NUM_QUALITY_CHECKS; i++) {
+        double pixelError = 0;
+        int channelError = 0;
+        int failed = !measureFrameError(qualityChecks[i].variant, &pixelError, &channelError) ||
+            pixelError > qualityChecks[i].maxPixelError || channelError > qualityChecks[i].maxChannelError;
+
+        printf("%-42s %11.4f %% of pixels differ, by up to %d%s\n", qualityChecks[i].name,
+                100.0 * pixelError, channelError, failed ? "  FAILED" : "");
+        failures += failed;
+    }
+
+    return failures;
+}
+
+
+/*========================================================
+ * Cache misses
+ *========================================================
+ */
+
+/* Renderers at 4K whose cache misses are compared */
+static const struct {
+    const char* name;
+    void (*run)(long ops);
+} cacheChecks[] = {
+    {"cache/strips4k-columns",   runStrips4k},
+    {"cache/strips4k-tiled",     runTiledStrips4k}
+};
+#define NUM_CACHE_CHECKS  (int)(sizeof(cacheChecks) / sizeof(cacheChecks[0]))
+
+#ifdef __linux__
+/* Open a disabled hardware counter for this process, returning its descriptor or -1 */
+static int openCacheCounter(Uint32 type, Uint64 config) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static double readCacheCounter(int counter) {
+    long long value = 0;
+
+    if(read(counter, &value, sizeof(value)) != sizeof(value))
+        return 0;
+    return (double)value;
+}
+#endif
+
+/*
+ * Count the L1 data cache read misses and last level cache misses of
+ * each renderer in cacheChecks, where the system exposes hardware
+ * performance counters. Only reported, as counts vary between machines.
+ */
+static void compareCacheMisses() {
+#ifdef __linux__
+    int l1Counter = openCacheCounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+            (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    int llcCounter = openCacheCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    int i;
+
+    printf("\n");
+    if(l1Counter < 0 || llcCounter < 0) {
+        printf("Hardware cache counters are not available, skipping the cache miss comparison\n");
+    } else {
+        for(i = 0; i < NUM_CACHE_CHECKS; i++) {
+            cacheChecks[i].run(1);
+
+            ioctl(l1Counter, PERF_EVENT_IOC_RESET, 0);
+            ioctl(llcCounter, PERF_EVENT_IOC_RESET, 0);
+            ioctl(l1Counter, PERF_EVENT_IOC_ENABLE, 0);
+            ioctl(llcCounter, PERF_EVENT_IOC_ENABLE, 0);
+            cacheChecks[i].run(CACHE_CHECK_FRAMES);
+            ioctl(l1Counter, PERF_EVENT_IOC_DISABLE, 0);
+            ioctl(llcCounter, PERF_EVENT_IOC_DISABLE, 0);
+
+            printf("%-42s %12.0f L1D read misses %12.0f LLC misses per frame\n", cacheChecks[i].name,
+                    readCacheCounter(l1Counter) / CACHE_CHECK_FRAMES, readCacheCounter(llcCounter) / CACHE_CHECK_FRAMES);
+        }
+    }
+
+    if(l1Counter >= 0) close(l1Counter);
+    if(llcCounter >= 0) close(llcCounter);
+#endif
+}
+
+
+/*========================================================
+ * Entry point
+ *========================================================
+ */
+
+int runBenchmarks(const char* resultsPath, const char* baselinePath) {
+    char savedTextureMode = textureMode;
+    char savedDistortion = distortion;
+    char savedInterlacedMode = interlacedMode;
+    char savedAdaptiveStep = adaptiveStep;
+    char savedPalettizedMode = palettizedMode;
+    char savedTiledMode = tiledMode;
+    Vector3f savedPos = playerPos;
+    Vector3f savedDir = playerDir;
+    Vector3f savedViewplaneDir = viewplaneDir;
+    BenchResult results[MAX_BENCHMARKS];
+    BenchResult baseline[MAX_BENCHMARKS];
+    int i, baselineCount, success = TRUE;
+
+    benchFrame4k = malloc(BENCH_4K_WIDTH * BENCH_4K_HEIGHT * sizeof(Uint32));
+    benchIndexedFrame4k = calloc(BENCH_4K_WIDTH * BENCH_4K_HEIGHT, 1);
+    if(!benchFrame4k || !benchIndexedFrame4k) {
+        fprintf(stderr, "Could not allocate the 4K benchmark frames\n");
+        free(benchFrame4k);
+        free(benchIndexedFrame4k);
+        return FALSE;
+    }
+
+    if(!writeBenchTexturePack()) {
+        fprintf(stderr, "Could not write the benchmark texture pack %s\n", benchPackPath);
+        remove(benchPackPath);
+        free(benchFrame4k);
+        free(benchIndexedFrame4k);
+        return FALSE;
+    }
+
+    if(!createBenchTextureSets()) {
+        fprintf(stderr, "Could not generate the mixed size benchmark textures\n");
+        destroyBenchTextureSets();
+        free(benchFrame4k);
+        free(benchIndexedFrame4k);
+        remove(benchPackPath);
+        return FALSE;
+    }
+
+    prepareBenchInputs();
+
+    for(i = 0; i < NUM_BENCHMARKS; i++) {
+        timeBenchmark(&benchmarks[i], &results[i]);
+        printf("%-42s %12.3f ns  (+/- %.3f)\n", results[i].name, results[i].medianNs, results[i].madNs);
+        fflush(stdout);
+    }
+
+    useBenchTextures(GAME_TEXTURES);
+    compareCacheMisses();
+
+    if(checkImageQuality()) {
+        printf("\nAn approximate render mode differs from the exact frame by more than allowed\n");
+        success = FALSE;
+    }
+
+    /* Before teardown, since the kernels are timed again */
+    repeatRatioKernels(results, NUM_BENCHMARKS);
+
+    baselineCount = baselinePath ? readResults(baselinePath, baseline, MAX_BENCHMARKS) : -1;
+    if(baselinePath && baselineCount <= 0) {
+        printf("\nNo baseline found at %s, skipping comparison\n", baselinePath);
+    } else if(baselinePath) {
+        int regressions = compareRatios(results, NUM_BENCHMARKS, baseline, baselineCount);
+        if(regressions) {
+            printf("\n%d optimized kernel(s) regressed against their reference by more than %.0f%%\n",
+                    regressions, 100.0 * REGRESSION_THRESHOLD);
+            success = FALSE;
+        }
+    }
+
+    destroyBenchTextureSets();
+    destroyEntityWorld(&benchEntities);
+    destroyFlowField(&benchFlow);
+    destroyPvs(&benchPvs);
+    free(benchMap);
+    benchMap = NULL;
+
+    free(benchFrame4k);
+    free(benchIndexedFrame4k);
+    benchFrame4k = NULL;
+    benchIndexedFrame4k = NULL;
+    remove(benchPackPath);
+
+    textureMode = savedTextureMode;
+    distortion = savedDistortion;
+    interlacedMode = savedInterlacedMode;
+    adaptiveStep = savedAdaptiveStep;
+    palettizedMode = savedPalettizedMode;
+    tiledMode = savedTiledMode;
+    setGatherSampling(TRUE);
+    playerPos = savedPos;
+    playerDir = savedDir;
+    viewplaneDir = savedViewplaneDir;
+
+    if(resultsPath && !writeResults(resultsPath, results, NUM_BENCHMARKS))
+        success = FALSE;
+
+    if(baselineCount > 0)
+        compareResults(results, NUM_BENCHMARKS, baseline, baselineCount);
+
+    return success;
+}
@@ -0,0 +1,25 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/* Default benchmark file locations */
+#define BENCH_RESULTS_PATH   "bench_results.json"
+#define BENCH_BASELINE_PATH  "bench/baseline.json"
+
+/* Functions */
+
+/**
+ * Run the built-in microbenchmarks over fixed seeded inputs and print
+ * their results to stdout. This assumes that the window, player and
+ * raycaster have already been initialized.
+ *
+ * resultsPath:  The file to write the results to as JSON, or NULL.
+ * baselinePath: The JSON results file to compare against, or NULL.
+ *
+ * Returns: Zero if an optimized kernel regressed relative to its
+ *          reference against the baseline, an approximate render mode
+ *          drew too differently, or the results could not be written,
+ *          non-zero otherwise.
+ */
+int runBenchmarks(const char* resultsPath, const char* baselinePath);
+
+#endif /* BENCH_H */
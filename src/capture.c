@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "capture.h"
+#include "trace.h"
+
+#define FRAME_PIXELS  (WINDOW_WIDTH * WINDOW_HEIGHT)
+
+/*
+ * Captured frames pass through a ring of preallocated buffers. The game
+ * loop is the only producer and the writer thread the only consumer, so
+ * the queued and written frame counts alone decide who owns each
+ * buffer: the semaphore only parks the writer while the ring is empty.
+ */
+static SDL_Thread* writerThread = NULL;
+static SDL_sem* writerWake = NULL;
+static SDL_atomic_t queuedFrames;
+static SDL_atomic_t writtenFrames;
+static SDL_atomic_t writerThreadQuit;
+
+static Uint32* framePool[CAPTURE_POOL_SIZE];
+static unsigned char* encodeBuffer = NULL;
+static FILE* captureFile = NULL;
+static const char* capturePath = NULL;
+static unsigned long droppedFrames = 0;
+static unsigned long failedWrites = 0;
+
+
+/* Convert a frame to packed RGB and write it out as a PPM image */
+static int writeFrame(const Uint32* frame) {
+    unsigned char* out = encodeBuffer;
+    int i;
+
+    for(i = 0; i < FRAME_PIXELS; i++) {
+        Uint32 pixel = frame[i];
+
+        *out++ = pixel & 0xFF;
+        *out++ = (pixel >> 8) & 0xFF;
+        *out++ = (pixel >> 16) & 0xFF;
+    }
+
+    return fprintf(captureFile, "P6\n%d %d\n255\n", WINDOW_WIDTH, WINDOW_HEIGHT) > 0 &&
+        fwrite(encodeBuffer, 3, FRAME_PIXELS, captureFile) == FRAME_PIXELS;
+}
+
+static int runWriterThread(void* data) {
+    int written = 0;
+
+    (void)data;
+    TRACE_THREAD_NAME("capture");
+
+    for(;;) {
+        /* Drain the ring before checking for the quit flag */
+        while(written != SDL_AtomicGet(&queuedFrames)) {
+            TRACE_BEGIN(writeFrame);
+            if(!writeFrame(framePool[written % CAPTURE_POOL_SIZE]))
+                failedWrites++;
+            TRACE_END(writeFrame);
+            SDL_AtomicSet(&writtenFrames, ++written);
+        }
+
+        if(SDL_AtomicGet(&writerThreadQuit))
+            break;
+        SDL_SemWait(writerWake);
+    }
+
+    return 0;
+}
+
+int startCapture(const char* path) {
+    int i;
+
+    if(writerThread)
+        return TRUE;
+
+    capturePath = path;
+    captureFile = fopen(path, "wb");
+    encodeBuffer = malloc(3 * FRAME_PIXELS);
+    writerWake = SDL_CreateSemaphore(0);
+    for(i = 0; i < CAPTURE_POOL_SIZE; i++)
+        framePool[i] = malloc(FRAME_PIXELS * sizeof(Uint32));
+
+    SDL_AtomicSet(&queuedFrames, 0);
+    SDL_AtomicSet(&writtenFrames, 0);
+    SDL_AtomicSet(&writerThreadQuit, FALSE);
+    droppedFrames = 0;
+    failedWrites = 0;
+
+    for(i = 0; i < CAPTURE_POOL_SIZE && framePool[i]; i++);
+    if(captureFile && encodeBuffer && writerWake && i == CAPTURE_POOL_SIZE)
+        writerThread = SDL_CreateThread(runWriterThread, "capture", NULL);
+
+    if(!writerThread) {
+        fprintf(stderr, "Could not start capturing to %s\n", path);
+        stopCapture();
+        return FALSE;
+    }
+
+    fprintf(stderr, "Capturing to %s\n", path);
+    return TRUE;
+}
+
+void captureFrame(const Uint32* buffer) {
+    int queued;
+
+    if(!writerThread)
+        return;
+
+    queued = SDL_AtomicGet(&queuedFrames);
+    if(queued - SDL_AtomicGet(&writtenFrames) >= CAPTURE_POOL_SIZE) {
+        droppedFrames++;
+        return;
+    }
+
+    memcpy(framePool[queued % CAPTURE_POOL_SIZE], buffer, FRAME_PIXELS * sizeof(Uint32));
+    SDL_AtomicSet(&queuedFrames, queued + 1);
+    SDL_SemPost(writerWake);
+}
+
+void stopCapture() {
+    int i;
+
+    if(writerThread) {
+        SDL_AtomicSet(&writerThreadQuit, TRUE);
+        SDL_SemPost(writerWake);
+        SDL_WaitThread(writerThread, NULL);
+        writerThread = NULL;
+
+        fprintf(stderr, "Captured %lu frames to %s (%lu dropped, %lu failed to write)\n",
+                SDL_AtomicGet(&writtenFrames) - failedWrites, capturePath, droppedFrames, failedWrites);
+    }
+
+    if(writerWake) SDL_DestroySemaphore(writerWake);
+    if(captureFile) fclose(captureFile);
+    writerWake = NULL;
+    captureFile = NULL;
+
+    for(i = 0; i < CAPTURE_POOL_SIZE; i++) {
+        free(framePool[i]);
+        framePool[i] = NULL;
+    }
+    free(encodeBuffer);
+    encodeBuffer = NULL;
+}
+
+int isCapturing() {
+    return writerThread != NULL;
+}
@@ -0,0 +1,45 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "gfx.h"
+
+/* Default capture file location */
+#define CAPTURE_PATH        "capture.ppm"
+
+/* Number of preallocated frames waiting to be written */
+#define CAPTURE_POOL_SIZE   8
+
+/* Functions */
+
+/**
+ * Start capturing frames to a file, as a stream of binary PPM images.
+ * A writer thread encodes and writes the frames in the background.
+ * Does nothing if a capture is already running.
+ *
+ * path: The file to write the frames to.
+ *
+ * Returns: Non-zero if the capture was started, zero otherwise.
+ */
+int startCapture(const char* path);
+
+/**
+ * Queue a copy of a finished frame for writing. This never waits on the
+ * writer thread: if every buffer in the pool is still queued, the frame
+ * is dropped and counted instead.
+ *
+ * buffer: The WINDOW_WIDTH x WINDOW_HEIGHT frame to capture.
+ */
+void captureFrame(const Uint32* buffer);
+
+/**
+ * Write out the frames still queued, stop the writer thread and close
+ * the capture file. Does nothing if no capture is running.
+ */
+void stopCapture();
+
+/**
+ * Returns: Non-zero if a capture is running, zero otherwise.
+ */
+int isCapturing();
+
+#endif /* CAPTURE_H */
@@ -7,8 +7,16 @@
 /* Special settings */
 #define ONLY_NORMALIZED 1
 #define ONLY_FIRST_HIT 2
+#define RAY_COST_STEPS 1
+#define RAY_COST_TIME  2
 extern char slowRenderMode;
 extern char rayCastMode;
+extern char rayCostMode;
+extern char interlacedMode;
+extern char adaptiveStep;
+extern char palettizedMode;
+extern char tiledMode;
+extern char hudMode;
 
 /* Misc. constants */
 #define FALSE 0
@@ -24,13 +32,48 @@ extern char rayCastMode;
 #define WINDOW_HEIGHT 480
 
 /* Raycaster parameters */
-#define TEXTURE_SIZE           64
+#define TEXTURE_SIZE           64     /* Width and height of the generated wall textures */
+#define MAX_TEXTURE_SIZE       4096   /* Largest width or height of a loaded wall texture */
 #define WALL_SIZE              64
 #define HUD_MAP_SIZE           WINDOW_HEIGHT
 #define FOV                    (PI / 3.0f)               /* 60 degrees */
-#define PLAYER_MOVEMENT_SPEED  5.0f
-#define PLAYER_ROT_SPEED       ((3.0f * (PI)) / 180.0f)  /* 3 degrees per frame */
+#define PLAYER_MOVEMENT_SPEED  5.0f                      /* Units per tick */
+#define PLAYER_ROT_SPEED       ((3.0f * (PI)) / 180.0f)  /* 3 degrees per tick */
 #define PLAYER_SIZE            20
+#define ENTITY_SIZE            12                        /* Half the width of an entity's bounding box */
+#define ENTITY_SPEED           2.0f                      /* Units per tick */
+#define GAME_ENTITIES          24                        /* Entities wandering the game's map */
+#define ENTITY_SEED            0x9E3779B9u
+
+/* Simulation parameters */
+#define SIMULATION_TICK_RATE   60   /* Player and entity updates per second, independent of the frame rate */
+#define MAX_TICKS_PER_FRAME    8    /* Simulation time beyond this many ticks per frame is dropped */
+
+/* Flow field parameters */
+#define FLOW_MAX_THREADS           8    /* Most bands a flow field is integrated in at once, the caller's included */
+#define FLOW_MIN_BAND_ROWS         32   /* Rows per band below which splitting a field isn't worth it */
+#define FLOW_WINDOW                16   /* Tiles the wavefront advances per round when a field is split */
+#define FLOW_INCREMENTAL_DISTANCE  8    /* Target moves of up to this many tiles update a field in place */
+
+/* Potentially visible set parameters */
+#define PVS_RAYS_PER_CLUSTER   1024 /* Rays sampled from the open tiles of each cluster, spread over every direction */
+#define PVS_GAME_CLUSTER_SIZE  1    /* Tiles along each side of a cluster of the game map's set */
+
+/* Interlaced rendering parameters */
+#define INTERLACE_MAX_MOVEMENT  (PLAYER_MOVEMENT_SPEED + 1.0f)   /* Movement per frame before a full cast */
+#define INTERLACE_MAX_ROTATION  (1.5f * PLAYER_ROT_SPEED)        /* Rotation per frame before a full cast */
+
+/* Adaptive rendering parameters */
+#define ADAPTIVE_MAX_STEP         8      /* Largest distance between sampled columns */
+#define ADAPTIVE_DEPTH_THRESHOLD  0.5f   /* Relative depth difference between samples that forces a full cast */
+
+/* Ray cost heatmap parameters */
+#define HEATMAP_MAX_STEPS  (MAP_GRID_WIDTH + MAP_GRID_HEIGHT)  /* Steps per ray shown in the hottest color */
+#define HEATMAP_MAX_NS     2000                               /* Traversal time per ray shown in the hottest color */
+
+/* Tiled rendering parameters */
+#define TILE_WIDTH   16     /* Columns per tile, a cache line of pixels */
+#define TILE_HEIGHT  64     /* Rows per tile */
 
 /* Projection parameters */
 #define VIEWPLANE_LENGTH  WINDOW_WIDTH
@@ -46,6 +89,7 @@ extern char rayCastMode;
 #define MAP_GRID_HEIGHT   10
 #define MAP_PIXEL_WIDTH   (MAP_GRID_WIDTH * WALL_SIZE)
 #define MAP_PIXEL_HEIGHT  (MAP_GRID_HEIGHT * WALL_SIZE)
+#define MAP_MAX_LISTENERS 4     /* Most structures derived from a map that can follow its edits */
 
 /* Map wall types */
 #define P            -1  /* Player start */
@@ -57,13 +101,22 @@ extern char rayCastMode;
 #define CEILING_COLOR  RGBtoABGR(0x65, 0x65, 0x65)
 #define FLOOR_COLOR    RGBtoABGR(0xAA, 0xAA, 0xAA)
 
+/* A wall texture. Each wall spans the full width and height of its texture, whatever its size. */
+typedef struct {
+    Uint32* pixels;         /* Row by row */
+    Uint8* indexedPixels;   /* The pixels as palette indices, NULL until initPalette */
+    int width;
+    int height;
+    int widthShift;         /* log2 of the width if it is a power of two, -1 otherwise */
+} WallTexture;
+
 
 /* Globals */
-extern const short MAP[MAP_GRID_HEIGHT][MAP_GRID_WIDTH];
+extern short MAP[MAP_GRID_HEIGHT][MAP_GRID_WIDTH];   /* Only edited through gameMap */
 extern char distortion;
 extern char textureMode;
 extern Uint32* screenBuffer;
 extern const Uint32 COLORS[];
-extern Uint32* TEXTURES[];
+extern WallTexture TEXTURES[];
 
 #endif /* CONFIG_H */
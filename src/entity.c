@@ -0,0 +1,324 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "entity.h"
+
+/* Overlapping entities must be in the same or neighbouring cells */
+#if 2 * ENTITY_SIZE > WALL_SIZE
+#error "Entities must be at most half a tile wide for the broadphase grid"
+#endif
+
+/* Global data */
+EntityWorld gameEntities;
+
+
+int initEntityWorld(EntityWorld* world, const short* tiles, int gridWidth, int gridHeight, int capacity) {
+    int cells = gridWidth * gridHeight;
+
+    memset(world, 0, sizeof(*world));
+    world->tiles = tiles;
+    world->gridWidth = gridWidth;
+    world->gridHeight = gridHeight;
+    world->capacity = capacity;
+
+    world->x = malloc(capacity * sizeof(float));
+    world->y = malloc(capacity * sizeof(float));
+    world->vx = malloc(capacity * sizeof(float));
+    world->vy = malloc(capacity * sizeof(float));
+    world->id = malloc(capacity * sizeof(int));
+    world->cellStart = calloc(cells + 1, sizeof(int));
+    world->entityCell = malloc(capacity * sizeof(int));
+    world->sortedX = malloc(capacity * sizeof(float));
+    world->sortedY = malloc(capacity * sizeof(float));
+    world->sortedVx = malloc(capacity * sizeof(float));
+    world->sortedVy = malloc(capacity * sizeof(float));
+    world->sortedId = malloc(capacity * sizeof(int));
+
+    if(!world->x || !world->y || !world->vx || !world->vy || !world->id || !world->cellStart || !world->entityCell ||
+            !world->sortedX || !world->sortedY || !world->sortedVx || !world->sortedVy || !world->sortedId) {
+        destroyEntityWorld(world);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+void destroyEntityWorld(EntityWorld* world) {
+    free(world->x);
+    free(world->y);
+    free(world->vx);
+    free(world->vy);
+    free(world->id);
+    free(world->cellStart);
+    free(world->entityCell);
+    free(world->sortedX);
+    free(world->sortedY);
+    free(world->sortedVx);
+    free(world->sortedVy);
+    free(world->sortedId);
+    memset(world, 0, sizeof(*world));
+}
+
+int addEntity(EntityWorld* world, float x, float y, float vx, float vy) {
+    int i = world->count;
+
+    if(i == world->capacity)
+        return -1;
+
+    world->x[i] = x;
+    world->y[i] = y;
+    world->vx[i] = vx;
+    world->vy[i] = vy;
+    world->id[i] = i;
+    world->count++;
+
+    return i;
+}
+
+/* Returns a pseudo-random float in [0, 1) from a xorshift generator */
+static float nextRandom(unsigned int* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+
+    return (*state >> 8) / (float)(1 << 24);
+}
+
+int spawnEntities(EntityWorld* world, int count, unsigned int seed) {
+    int added = 0, attempts;
+
+    /* Give up on maps that are mostly walls rather than searching forever */
+    for(attempts = 0; added < count && attempts < 64 * count; attempts++) {
+        float x = nextRandom(&seed) * world->gridWidth * WALL_SIZE;
+        float y = nextRandom(&seed) * world->gridHeight * WALL_SIZE;
+        float angle = nextRandom(&seed) * 2.0f * PI;
+
+        if(entityHitsWall(world, x, y))
+            continue;
+        if(addEntity(world, x, y, ENTITY_SPEED * cos(angle), ENTITY_SPEED * sin(angle)) < 0)
+            break;
+        added++;
+    }
+
+    return added;
+}
+
+int entityHitsWall(const EntityWorld* world, float x, float y) {
+    int x1, y1, x2, y2, i, j;
+
+    if(x - ENTITY_SIZE < 0 || y - ENTITY_SIZE < 0)
+        return TRUE;
+
+    x1 = (x - ENTITY_SIZE) / WALL_SIZE;
+    y1 = (y - ENTITY_SIZE) / WALL_SIZE;
+    x2 = (x + ENTITY_SIZE) / WALL_SIZE;
+    y2 = (y + ENTITY_SIZE) / WALL_SIZE;
+    if(x2 >= world->gridWidth || y2 >= world->gridHeight)
+        return TRUE;
+
+    /* Check all tiles the entity occupies */
+    for(i = y1; i <= y2; i++)
+        for(j = x1; j <= x2; j++)
+            if(world->tiles[i * world->gridWidth + j] > 0)
+                return TRUE;
+
+    return FALSE;
+}
+
+int tileHasEntities(const EntityWorld* world, int tileX, int tileY) {
+    float left = tileX * WALL_SIZE, top = tileY * WALL_SIZE;
+    int row, col, i;
+
+    /* Entities are at most half a tile wide, so any that overlap the tile have their centres in it or next to it */
+    for(row = MAX(tileY - 1, 0); row <= MIN(tileY + 1, world->gridHeight - 1); row++) {
+        for(col = MAX(tileX - 1, 0); col <= MIN(tileX + 1, world->gridWidth - 1); col++) {
+            int cell = row * world->gridWidth + col;
+
+            for(i = world->cellStart[cell]; i < world->cellStart[cell + 1]; i++)
+                if(world->x[i] + ENTITY_SIZE > left && world->x[i] - ENTITY_SIZE < left + WALL_SIZE &&
+                        world->y[i] + ENTITY_SIZE > top && world->y[i] - ENTITY_SIZE < top + WALL_SIZE)
+                    return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+
+
+/*========================================================
+ * Simulation
+ *========================================================
+ */
+
+/*
+ * Move every entity by its velocity like movePlayer moves the player:
+ * if the whole move is blocked, slide along the wall on one axis. The
+ * blocked part of the velocity is reversed, so entities bounce off walls
+ * instead of coming to rest against them. Entities following a flow
+ * field first turn the way it points from their tile, and keep their
+ * heading once they reach the target's tile.
+ */
+static void moveEntities(EntityWorld* world) {
+    const FlowField* flow = world->flow;
+    float* x = world->x;
+    float* y = world->y;
+    float* vx = world->vx;
+    float* vy = world->vy;
+    Vector2f heading;
+    int i;
+
+    for(i = 0; i < world->count; i++) {
+        if(flow && getFlowDirection(flow, (int)(x[i] / WALL_SIZE), (int)(y[i] / WALL_SIZE), &heading)) {
+            vx[i] = ENTITY_SPEED * heading.x;
+            vy[i] = ENTITY_SPEED * heading.y;
+        }
+
+        if(!entityHitsWall(world, x[i] + vx[i], y[i] + vy[i])) {
+            x[i] += vx[i];
+            y[i] += vy[i];
+        } else if(!entityHitsWall(world, x[i], y[i] + vy[i])) {
+            y[i] += vy[i];
+            vx[i] = -vx[i];
+        } else if(!entityHitsWall(world, x[i] + vx[i], y[i])) {
+            x[i] += vx[i];
+            vy[i] = -vy[i];
+        } else {
+            vx[i] = -vx[i];
+            vy[i] = -vy[i];
+        }
+    }
+}
+
+/* Swap two arrays of an entity world */
+#define SWAP_ARRAYS(TYPE, A, B)  do { TYPE* swapped = (A); (A) = (B); (B) = swapped; } while(0)
+
+/*
+ * Sort the entities by the cells of the tiles their centres are in, with
+ * a counting sort that keeps the order of the entities within a cell
+ */
+static void sortEntities(EntityWorld* world) {
+    int cells = world->gridWidth * world->gridHeight;
+    int* cellStart = world->cellStart;
+    int* entityCell = world->entityCell;
+    int i, c, total = 0;
+
+    memset(cellStart, 0, (cells + 1) * sizeof(int));
+    for(i = 0; i < world->count; i++) {
+        entityCell[i] = (int)(world->y[i] / WALL_SIZE) * world->gridWidth + (int)(world->x[i] / WALL_SIZE);
+        cellStart[entityCell[i]]++;
+    }
+
+    /* Turn the counts into the end of each cell's run, then fill the runs backwards down to their starts */
+    for(c = 0; c < cells; c++) {
+        total += cellStart[c];
+        cellStart[c] = total;
+    }
+    cellStart[cells] = total;
+
+    for(i = world->count - 1; i >= 0; i--) {
+        int sorted = --cellStart[entityCell[i]];
+
+        world->sortedX[sorted] = world->x[i];
+        world->sortedY[sorted] = world->y[i];
+        world->sortedVx[sorted] = world->vx[i];
+        world->sortedVy[sorted] = world->vy[i];
+        world->sortedId[sorted] = world->id[i];
+    }
+
+    SWAP_ARRAYS(float, world->x, world->sortedX);
+    SWAP_ARRAYS(float, world->y, world->sortedY);
+    SWAP_ARRAYS(float, world->vx, world->sortedVx);
+    SWAP_ARRAYS(float, world->vy, world->sortedVy);
+    SWAP_ARRAYS(int, world->id, world->sortedId);
+}
+
+/*
+ * Push two overlapping entities apart along the axis they overlap least
+ * on, half each, unless that would push one into a wall. If they are
+ * approaching on that axis, they swap their velocities along it, as
+ * equal masses in an elastic collision do.
+ */
+static void separatePair(EntityWorld* world, int a, int b) {
+    float dx = world->x[b] - world->x[a];
+    float dy = world->y[b] - world->y[a];
+    float overlapX = 2 * ENTITY_SIZE - fabs(dx);
+    float overlapY = 2 * ENTITY_SIZE - fabs(dy);
+    float push, swap;
+
+    if(overlapX <= 0 || overlapY <= 0)
+        return;
+    world->contacts++;
+
+    if(overlapX < overlapY) {
+        push = (dx < 0 ? -overlapX : overlapX) / 2;
+        if(!entityHitsWall(world, world->x[a] - push, world->y[a]))
+            world->x[a] -= push;
+        if(!entityHitsWall(world, world->x[b] + push, world->y[b]))
+            world->x[b] += push;
+
+        if((world->vx[b] - world->vx[a]) * dx < 0) {
+            swap = world->vx[a];
+            world->vx[a] = world->vx[b];
+            world->vx[b] = swap;
+        }
+    } else {
+        push = (dy < 0 ? -overlapY : overlapY) / 2;
+        if(!entityHitsWall(world, world->x[a], world->y[a] - push))
+            world->y[a] -= push;
+        if(!entityHitsWall(world, world->x[b], world->y[b] + push))
+            world->y[b] += push;
+
+        if((world->vy[b] - world->vy[a]) * dy < 0) {
+            swap = world->vy[a];
+            world->vy[a] = world->vy[b];
+            world->vy[b] = swap;
+        }
+    }
+}
+
+/* Test the entities of a cell against those of another cell, or among themselves if they are the same */
+static void collideCells(EntityWorld* world, int cell, int other) {
+    int i, j;
+
+    for(i = world->cellStart[cell]; i < world->cellStart[cell + 1]; i++)
+        for(j = (cell == other) ? i + 1 : world->cellStart[other]; j < world->cellStart[other + 1]; j++)
+            separatePair(world, i, j);
+}
+
+/*
+ * Collide every cell with itself and with the neighbours after it (east,
+ * and the three below), so that every pair of neighbouring cells is
+ * tested once
+ */
+static void collideEntities(EntityWorld* world) {
+    int row, col, width = world->gridWidth;
+
+    world->contacts = 0;
+    for(row = 0; row < world->gridHeight; row++) {
+        for(col = 0; col < width; col++) {
+            int cell = row * width + col;
+
+            if(world->cellStart[cell] == world->cellStart[cell + 1])
+                continue;
+
+            collideCells(world, cell, cell);
+            if(col + 1 < width)
+                collideCells(world, cell, cell + 1);
+            if(row + 1 < world->gridHeight) {
+                if(col > 0)
+                    collideCells(world, cell, cell + width - 1);
+                collideCells(world, cell, cell + width);
+                if(col + 1 < width)
+                    collideCells(world, cell, cell + width + 1);
+            }
+        }
+    }
+}
+
+void updateEntities(EntityWorld* world) {
+    moveEntities(world);
+    sortEntities(world);
+    collideEntities(world);
+}
@@ -0,0 +1,136 @@
+#ifndef ENTITY_H
+#define ENTITY_H
+
+#include "gfx.h"
+#include "flowfield.h"
+
+/*
+ * Entities are actors that wander the map, sliding along walls like the
+ * player does and bouncing off walls and each other. Given a flow field,
+ * they head for its target instead.
+ *
+ * They are stored as structures of arrays, so that each pass over them
+ * streams only the fields it uses. Every tick they are sorted into a
+ * uniform grid with one cell per map tile, and each entity is only
+ * tested against the entities in its own and neighbouring cells, so the
+ * cost of collisions grows with the local density rather than with the
+ * square of the entity count. The arrays themselves are kept in cell
+ * order, so that neighbouring entities are also neighbours in memory; an
+ * entity's index changes from tick to tick, but its id does not.
+ */
+
+/* Datatypes */
+typedef struct {
+    int count;
+    int capacity;
+    float* x;
+    float* y;
+    float* vx;          /* Velocity in units per tick */
+    float* vy;
+    int* id;            /* The index addEntity returned for the entity */
+
+    /* The tiles the entities move between, row by row. Positive tiles are walls. */
+    const short* tiles;
+    int gridWidth;
+    int gridHeight;
+
+    /* The entities in cell c are the indices cellStart[c] to cellStart[c + 1] - 1 */
+    int* cellStart;
+
+    /* Scratch space for sorting: the entities' cells, and arrays to sort the fields into */
+    int* entityCell;
+    float* sortedX;
+    float* sortedY;
+    float* sortedVx;
+    float* sortedVy;
+    int* sortedId;
+
+    const FlowField* flow;  /* The field entities follow, or NULL to let them wander */
+    long contacts;      /* Pairs of entities that collided in the last tick */
+} EntityWorld;
+
+/* Global data */
+extern EntityWorld gameEntities;
+
+/* Functions */
+
+/**
+ * Set up an empty entity world.
+ *
+ * world:      The world to set up.
+ * tiles:      The map the entities move in, row by row. It must outlive
+ *             the world. Tiles outside the map count as walls.
+ * gridWidth:  The width of the map in tiles.
+ * gridHeight: The height of the map in tiles.
+ * capacity:   The most entities the world can hold.
+ *
+ * Returns: Zero if the world could not be allocated, non-zero otherwise.
+ */
+int initEntityWorld(EntityWorld* world, const short* tiles, int gridWidth, int gridHeight, int capacity);
+
+/**
+ * Free an entity world's arrays.
+ *
+ * world: The world to destroy.
+ */
+void destroyEntityWorld(EntityWorld* world);
+
+/**
+ * Add an entity.
+ *
+ * world: The world to add it to.
+ * x:     The x coordinate of its centre.
+ * y:     The y coordinate of its centre.
+ * vx:    The x component of its velocity, in units per tick.
+ * vy:    The y component of its velocity, in units per tick.
+ *
+ * Returns: The entity's id, which is also its index until the next
+ *          update, or -1 if the world is full.
+ */
+int addEntity(EntityWorld* world, float x, float y, float vx, float vy);
+
+/**
+ * Add entities at random free spots of open tiles, heading in random
+ * directions at ENTITY_SPEED.
+ *
+ * world: The world to add them to.
+ * count: The number of entities to add.
+ * seed:  The seed of the random placement, non-zero.
+ *
+ * Returns: The number of entities added, less than count if the world
+ *          filled up or the map has no open tiles.
+ */
+int spawnEntities(EntityWorld* world, int count, unsigned int seed);
+
+/**
+ * Advance all entities by one simulation tick: move them with wall
+ * sliding, then push apart and bounce the ones that overlap.
+ *
+ * world: The world to update.
+ */
+void updateEntities(EntityWorld* world);
+
+/**
+ * Check if an entity's bounding box would overlap a wall.
+ *
+ * world: The world the entity is in.
+ * x:     The x coordinate of the entity's centre.
+ * y:     The y coordinate of the entity's centre.
+ *
+ * Returns: Non-zero if the box overlaps a wall or leaves the map, zero otherwise.
+ */
+int entityHitsWall(const EntityWorld* world, float x, float y);
+
+/**
+ * Check if any entity's bounding box overlaps a tile, as of the last
+ * update.
+ *
+ * world: The world to look in.
+ * tileX: The column of the tile.
+ * tileY: The row of the tile.
+ *
+ * Returns: Non-zero if an entity overlaps the tile, zero otherwise.
+ */
+int tileHasEntities(const EntityWorld* world, int tileX, int tileY);
+
+#endif /* ENTITY_H */
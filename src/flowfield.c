@@ -0,0 +1,664 @@
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "flowfield.h"
+#include "trace.h"
+
+/* The offset is reset by a rebuild long before distances relative to it could overflow */
+#define FLOW_MAX_OFFSET  (INT_MAX / 4)
+
+/* Sides of a band */
+#define ABOVE  0
+#define BELOW  1
+
+/* Global data */
+FlowField playerFlow;
+
+/*
+ * Flow thread i integrates band i + 1 of the current job, while the
+ * thread that started the job integrates band 0. The job is only changed
+ * while every flow thread is parked on its semaphore.
+ */
+static SDL_Thread* flowThreads[FLOW_MAX_THREADS - 1];
+static SDL_sem* flowWake[FLOW_MAX_THREADS - 1];
+static SDL_sem* flowDone = NULL;
+static SDL_atomic_t flowThreadsQuit;
+static int flowThreadCount = 0;
+
+static FlowField* flowJob = NULL;
+static int flowRound = 0;
+static int flowLimit = 0;
+static char flowRebuild = FALSE;
+
+
+/*========================================================
+ * Integration
+ *========================================================
+ */
+
+/* Walls can't be lowered, so the wavefront never needs to check the tiles themselves */
+static void resetFlowRows(FlowField* field, int firstRow, int endRow) {
+    int i;
+
+    for(i = firstRow * field->gridWidth; i < endRow * field->gridWidth; i++)
+        field->distances[i] = (field->tiles[i] > 0) ? INT_MIN : INT_MAX;
+}
+
+/* Double a band's queue. Returns zero if it could not grow. */
+static int growFlowQueue(FlowBand* band) {
+    int* grown = realloc(band->queue, 2 * band->queueCapacity * sizeof(int));
+
+    if(!grown) {
+        band->failed = TRUE;
+        return FALSE;
+    }
+
+    /* Move the tiles that wrapped around to the start of the ring after its old end */
+    memcpy(grown + band->queueCapacity, grown, band->queueHead * sizeof(int));
+    band->queue = grown;
+    band->queueCapacity *= 2;
+    return TRUE;
+}
+
+/* Add a tile to the back of a band's queue */
+static void pushFlowTile(FlowBand* band, int tile) {
+    if(band->queueCount == band->queueCapacity && !growFlowQueue(band))
+        return;
+
+    band->queue[(band->queueHead + band->queueCount++) & (band->queueCapacity - 1)] = tile;
+}
+
+/* Add a tile to the front of a band's queue */
+static void pushFlowTileFront(FlowBand* band, int tile) {
+    if(band->queueCount == band->queueCapacity && !growFlowQueue(band))
+        return;
+
+    band->queueHead = (band->queueHead - 1) & (band->queueCapacity - 1);
+    band->queue[band->queueHead] = tile;
+    band->queueCount++;
+}
+
+static int compareSeeds(const void* a, const void* b) {
+    int first = *(const int*)a;
+    int second = *(const int*)b;
+
+    return (first > second) - (first < second);
+}
+
+/* Take the distances a neighbouring band passed to one of this band's edge rows */
+static void takeFlowEdge(FlowField* field, FlowBand* band, int* edge, int row) {
+    int* distances = field->distances + row * field->gridWidth;
+    int col;
+
+    for(col = 0; col < field->gridWidth; col++) {
+        if(edge[col] == INT_MAX)
+            continue;
+
+        if(edge[col] < distances[col]) {
+            distances[col] = edge[col];
+            band->seeds[2 * band->seedCount] = edge[col];
+            band->seeds[2 * band->seedCount + 1] = row * field->gridWidth + col;
+            band->seedCount++;
+        }
+        edge[col] = INT_MAX;
+    }
+}
+
+/* Add a tile to the back of the queue spreadFlowBand keeps in its locals, growing it if it is full */
+#define PUSH_FLOW_TILE(TILE)  do {                              \
+        if(count > mask) {                                      \
+            band->queueHead = head;                             \
+            band->queueCount = count;                           \
+            growFlowQueue(band);                                \
+            queue = band->queue;                                \
+            mask = band->queueCapacity - 1;                     \
+        }                                                       \
+        if(count <= mask)                                       \
+            queue[(head + count++) & mask] = (TILE);            \
+    } while(0)
+
+/*
+ * Visit the tiles in a band's queue that are closer than the limit, and
+ * lower their neighbours. The queue and everything the loop reads are
+ * kept in locals, as the stores to the distances could otherwise alias
+ * them and force them to be reloaded for every tile.
+ */
+static void spreadFlowBand(FlowField* field, FlowBand* band, int round, int limit) {
+    const short* tiles = field->tiles;
+    int* distances = field->distances;
+    int* aboveEdge = band->edges[round & 1][ABOVE];
+    int* belowEdge = band->edges[round & 1][BELOW];
+    int* queue = band->queue;
+    int width = field->gridWidth;
+    int lastRow = field->gridHeight - 1;
+    int firstTile = band->firstRow * width;
+    int endTile = band->endRow * width;
+    int mask = band->queueCapacity - 1;
+    int head = band->queueHead;
+    int count = band->queueCount;
+    int passed = FALSE;
+    long visited = 0;
+
+    while(count) {
+        int tile = queue[head];
+        int row, col, distance = distances[tile] + 1;
+
+        if(distance > limit)
+            break;
+        head = (head + 1) & mask;
+        count--;
+        visited++;
+
+        row = tile / width;
+        col = tile - row * width;
+
+        if(col > 0 && distance < distances[tile - 1]) {
+            distances[tile - 1] = distance;
+            PUSH_FLOW_TILE(tile - 1);
+        }
+        if(col + 1 < width && distance < distances[tile + 1]) {
+            distances[tile + 1] = distance;
+            PUSH_FLOW_TILE(tile + 1);
+        }
+
+        if(tile - width >= firstTile) {
+            if(distance < distances[tile - width]) {
+                distances[tile - width] = distance;
+                PUSH_FLOW_TILE(tile - width);
+            }
+        } else if(row > 0 && tiles[tile - width] <= 0 && distance < aboveEdge[col]) {
+            aboveEdge[col] = distance;
+            passed = TRUE;
+        }
+
+        if(tile + width < endTile) {
+            if(distance < distances[tile + width]) {
+                distances[tile + width] = distance;
+                PUSH_FLOW_TILE(tile + width);
+            }
+        } else if(row < lastRow && tiles[tile + width] <= 0 && distance < belowEdge[col]) {
+            belowEdge[col] = distance;
+            passed = TRUE;
+        }
+    }
+
+    band->queueHead = head;
+    band->queueCount = count;
+    band->passed[round & 1] = passed;
+    band->visited += visited;
+}
+
+/*
+ * Spread the wavefront through a band for a round, up to tiles at the
+ * limit distance. Tiles are visited breadth first, and visited again if
+ * their distance is lowered later on, so the distances end up the same
+ * in whatever order the bands pass them on. Distances that cross into a
+ * neighbouring band are kept on its edge for it to take in the next
+ * round.
+ */
+static void integrateFlowBand(FlowField* field, int b, int round, int limit, char rebuild) {
+    FlowBand* band = &field->bands[b];
+    int* distances = field->distances;
+    int width = field->gridWidth;
+    int target = field->targetY * width + field->targetX;
+
+    TRACE_BEGIN(integrateFlowBand);
+
+    if(round == 0) {
+        if(rebuild)
+            resetFlowRows(field, band->firstRow, band->endRow);
+        band->queueHead = band->queueCount = 0;
+        band->failed = FALSE;
+        band->visited = 0;
+
+        if(target >= band->firstRow * width && target < band->endRow * width) {
+            distances[target] = -field->offset;
+            pushFlowTile(band, target);
+        }
+    } else {
+        int parity = (round - 1) & 1;
+        int i;
+
+        band->seedCount = 0;
+        if(b > 0 && field->bands[b - 1].passed[parity])
+            takeFlowEdge(field, band, field->bands[b - 1].edges[parity][BELOW], band->firstRow);
+        if(b + 1 < field->bandCount && field->bands[b + 1].passed[parity])
+            takeFlowEdge(field, band, field->bands[b + 1].edges[parity][ABOVE], band->endRow - 1);
+
+        /*
+         * The tiles left in the queue are all at the last round's limit,
+         * and the neighbours only passed on distances up to it, so the
+         * seeds go in front of them, closest first
+         */
+        qsort(band->seeds, band->seedCount, 2 * sizeof(int), compareSeeds);
+        for(i = band->seedCount - 1; i >= 0; i--)
+            pushFlowTileFront(band, band->seeds[2 * i + 1]);
+    }
+
+    spreadFlowBand(field, band, round, limit);
+    TRACE_END(integrateFlowBand);
+}
+
+static int runFlowThread(void* data) {
+    int worker = (int)(intptr_t)data;
+
+    TRACE_THREAD_NAME("flow");
+
+    for(;;) {
+        SDL_SemWait(flowWake[worker]);
+        if(SDL_AtomicGet(&flowThreadsQuit))
+            break;
+
+        integrateFlowBand(flowJob, worker + 1, flowRound, flowLimit, flowRebuild);
+        SDL_SemPost(flowDone);
+    }
+
+    return 0;
+}
+
+/* Split the field into one band per flow thread and the calling thread, as long as the bands aren't too thin */
+static void splitFlowBands(FlowField* field) {
+    int b;
+
+    field->bandCount = MAX(MIN(flowThreadCount + 1, field->gridHeight / FLOW_MIN_BAND_ROWS), 1);
+    for(b = 0; b < field->bandCount; b++) {
+        field->bands[b].firstRow = (int)((long)field->gridHeight * b / field->bandCount);
+        field->bands[b].endRow = (int)((long)field->gridHeight * (b + 1) / field->bandCount);
+    }
+}
+
+/*
+ * Run rounds over all bands until none of them has anything left to
+ * spread or pass on. Returns zero if a band ran out of memory.
+ */
+static int integrateFlowField(FlowField* field, char rebuild) {
+    int b, round, pending, failed = FALSE;
+
+    splitFlowBands(field);
+
+    for(round = 0;; round++) {
+        flowJob = field;
+        flowRound = round;
+        flowRebuild = rebuild;
+
+        /* A band on its own has nothing to wait for */
+        flowLimit = (field->bandCount > 1) ? FLOW_WINDOW * (round + 1) - field->offset : INT_MAX;
+
+        for(b = 1; b < field->bandCount; b++)
+            SDL_SemPost(flowWake[b - 1]);
+        integrateFlowBand(field, 0, round, flowLimit, rebuild);
+        for(b = 1; b < field->bandCount; b++)
+            SDL_SemWait(flowDone);
+
+        pending = FALSE;
+        for(b = 0; b < field->bandCount; b++) {
+            pending |= field->bands[b].passed[round & 1] || field->bands[b].queueCount;
+            failed |= field->bands[b].failed;
+        }
+        if(!pending || failed)
+            break;
+    }
+
+    field->rounds = round + 1;
+    return !failed;
+}
+
+
+/*========================================================
+ * Flow fields
+ *========================================================
+ */
+
+int initFlowThreads() {
+    int i, threads;
+
+    if(flowThreadCount)
+        return TRUE;
+
+    threads = MIN(SDL_GetCPUCount(), FLOW_MAX_THREADS) - 1;
+    if(threads < 1)
+        return TRUE;
+
+    SDL_AtomicSet(&flowThreadsQuit, FALSE);
+    flowDone = SDL_CreateSemaphore(0);
+    for(i = 0; flowDone && i < threads; i++) {
+        flowWake[i] = SDL_CreateSemaphore(0);
+        if(!flowWake[i])
+            break;
+
+        flowThreads[i] = SDL_CreateThread(runFlowThread, "flow", (void*)(intptr_t)i);
+        if(!flowThreads[i]) {
+            SDL_DestroySemaphore(flowWake[i]);
+            flowWake[i] = NULL;
+            break;
+        }
+        flowThreadCount++;
+    }
+
+    if(flowThreadCount < threads) {
+        fprintf(stderr, "Could not start the flow threads: %s\n", SDL_GetError());
+        destroyFlowThreads();
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+void destroyFlowThreads() {
+    int i;
+
+    SDL_AtomicSet(&flowThreadsQuit, TRUE);
+    for(i = 0; i < flowThreadCount; i++) {
+        SDL_SemPost(flowWake[i]);
+        SDL_WaitThread(flowThreads[i], NULL);
+        SDL_DestroySemaphore(flowWake[i]);
+        flowThreads[i] = NULL;
+        flowWake[i] = NULL;
+    }
+    flowThreadCount = 0;
+
+    if(flowDone) SDL_DestroySemaphore(flowDone);
+    flowDone = NULL;
+}
+
+/*
+ * Leave a field without a target, and clear the distances passed between
+ * its bands, which an update that ran out of memory may have left behind
+ */
+static void clearFlowField(FlowField* field) {
+    int b, side, col;
+
+    resetFlowRows(field, 0, field->gridHeight);
+    for(b = 0; b < FLOW_MAX_THREADS; b++)
+        for(side = 0; side < 4; side++)
+            for(col = 0; col < field->gridWidth; col++)
+                field->bands[b].edges[side >> 1][side & 1][col] = INT_MAX;
+
+    field->targetX = field->targetY = -1;
+}
+
+int initFlowField(FlowField* field, const short* tiles, int gridWidth, int gridHeight) {
+    int b, side, success = TRUE;
+
+    memset(field, 0, sizeof(*field));
+    field->tiles = tiles;
+    field->gridWidth = gridWidth;
+    field->gridHeight = gridHeight;
+
+    field->distances = malloc((size_t)gridWidth * gridHeight * sizeof(int));
+    for(b = 0; field->distances && success && b < FLOW_MAX_THREADS; b++) {
+        FlowBand* band = &field->bands[b];
+
+        /* Start with room for a wavefront crossing the band a few times */
+        band->queueCapacity = 1;
+        while(band->queueCapacity < 4 * gridWidth)
+            band->queueCapacity *= 2;
+        band->queue = malloc(band->queueCapacity * sizeof(int));
+
+        /* An edge row can take at most one distance per column from each side */
+        band->seeds = malloc(2 * 2 * gridWidth * sizeof(int));
+        success = band->queue && band->seeds;
+
+        for(side = 0; success && side < 4; side++) {
+            band->edges[side >> 1][side & 1] = malloc(gridWidth * sizeof(int));
+            success = band->edges[side >> 1][side & 1] != NULL;
+        }
+    }
+
+    if(!field->distances || !success) {
+        destroyFlowField(field);
+        return FALSE;
+    }
+
+    clearFlowField(field);
+    return TRUE;
+}
+
+void destroyFlowField(FlowField* field) {
+    int b;
+
+    for(b = 0; b < FLOW_MAX_THREADS; b++) {
+        free(field->bands[b].queue);
+        free(field->bands[b].seeds);
+        free(field->bands[b].edges[0][ABOVE]);
+        free(field->bands[b].edges[0][BELOW]);
+        free(field->bands[b].edges[1][ABOVE]);
+        free(field->bands[b].edges[1][BELOW]);
+    }
+    free(field->distances);
+    memset(field, 0, sizeof(*field));
+}
+
+int updateFlowField(FlowField* field, int targetX, int targetY) {
+    int moved;
+
+    if(targetX == field->targetX && targetY == field->targetY)
+        return TRUE;
+
+    /*
+     * The new target is moved tiles from the old one, so no tile is more
+     * than that much further from it than from the old one. Raising the
+     * offset by that much keeps every distance an upper bound, and the
+     * wavefront from the new target only needs to lower the ones that
+     * are too high.
+     */
+    moved = getFlowDistance(field, targetX, targetY);
+    if(field->targetX < 0 || moved == FLOW_UNREACHABLE || moved > FLOW_INCREMENTAL_DISTANCE ||
+            field->offset > FLOW_MAX_OFFSET)
+        return rebuildFlowField(field, targetX, targetY);
+
+    field->offset += moved;
+    field->targetX = targetX;
+    field->targetY = targetY;
+    if(!integrateFlowField(field, FALSE)) {
+        clearFlowField(field);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+int rebuildFlowField(FlowField* field, int targetX, int targetY) {
+    if(targetX < 0 || targetY < 0 || targetX >= field->gridWidth || targetY >= field->gridHeight ||
+            field->tiles[targetY * field->gridWidth + targetX] > 0)
+        return FALSE;
+
+    field->offset = 0;
+    field->targetX = targetX;
+    field->targetY = targetY;
+    if(!integrateFlowField(field, TRUE)) {
+        clearFlowField(field);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* One more than the lowest distance of a tile's open neighbours, or INT_MAX if none of them reach the target */
+static int closestNeighbourDistance(const FlowField* field, int tile) {
+    const int* distances = field->distances;
+    int width = field->gridWidth;
+    int row = tile / width, col = tile % width;
+    int best = INT_MAX;
+
+    if(col > 0 && distances[tile - 1] != INT_MIN)
+        best = MIN(best, distances[tile - 1]);
+    if(col + 1 < width && distances[tile + 1] != INT_MIN)
+        best = MIN(best, distances[tile + 1]);
+    if(row > 0 && distances[tile - width] != INT_MIN)
+        best = MIN(best, distances[tile - width]);
+    if(row + 1 < field->gridHeight && distances[tile + width] != INT_MIN)
+        best = MIN(best, distances[tile + width]);
+
+    return (best == INT_MAX) ? INT_MAX : best + 1;
+}
+
+/* Queue a tile's neighbours that are at a distance, as they might have been reached through the tile */
+static void pushFlowNeighbours(FlowField* field, FlowBand* band, int tile, int distance) {
+    int* distances = field->distances;
+    int width = field->gridWidth;
+    int row = tile / width, col = tile % width;
+
+    if(col > 0 && distances[tile - 1] == distance)
+        pushFlowTile(band, tile - 1);
+    if(col + 1 < width && distances[tile + 1] == distance)
+        pushFlowTile(band, tile + 1);
+    if(row > 0 && distances[tile - width] == distance)
+        pushFlowTile(band, tile - width);
+    if(row + 1 < field->gridHeight && distances[tile + width] == distance)
+        pushFlowTile(band, tile + width);
+}
+
+/*
+ * Cut a tile that became a wall out of a field. The tiles whose every
+ * shortest path led through it are found breadth first, in order of
+ * distance: a tile is cut off if none of its neighbours one closer to
+ * the target is still connected. Each cut off tile is then lowered from
+ * the connected neighbours it has left, and the wavefront spreads from
+ * there. The band's queue is used as a plain list while the tiles are
+ * found, so that they are still in it when they are lowered.
+ */
+static void closeFlowTile(FlowField* field, FlowBand* band, int tile, int distance) {
+    int* distances = field->distances;
+    int i;
+
+    distances[tile] = INT_MIN;
+    pushFlowNeighbours(field, band, tile, distance + 1);
+
+    for(i = 0; i < band->queueCount; i++) {
+        int cutOff = band->queue[i];
+
+        distance = distances[cutOff];
+        if(distance == INT_MAX)
+            continue;
+        if(closestNeighbourDistance(field, cutOff) == distance)
+            continue;
+
+        distances[cutOff] = INT_MAX;
+        pushFlowNeighbours(field, band, cutOff, distance + 1);
+    }
+
+    /* Tiles can be listed twice, or still be connected, so only the first entry of each cut off tile lowers it */
+    for(i = band->queueCount; i > 0 && !band->failed; i--) {
+        int cutOff = band->queue[band->queueHead];
+
+        band->queueHead = (band->queueHead + 1) & (band->queueCapacity - 1);
+        band->queueCount--;
+        if(distances[cutOff] != INT_MAX)
+            continue;
+
+        distances[cutOff] = closestNeighbourDistance(field, cutOff);
+        if(distances[cutOff] != INT_MAX)
+            pushFlowTile(band, cutOff);
+    }
+}
+
+int editFlowField(FlowField* field, int tileX, int tileY) {
+    FlowBand* band = &field->bands[0];
+    int tile = tileY * field->gridWidth + tileX;
+    int distance = field->distances[tile];
+    char wasWall = (distance == INT_MIN);
+    char isWall = (field->tiles[tile] > 0);
+
+    if(wasWall == isWall)
+        return TRUE;
+
+    /* A wall can't be the target, and nothing else can be reached without one */
+    if(isWall && tileX == field->targetX && tileY == field->targetY) {
+        clearFlowField(field);
+        return TRUE;
+    }
+    if(isWall && distance == INT_MAX) {
+        field->distances[tile] = INT_MIN;
+        return TRUE;
+    }
+
+    TRACE_BEGIN(editFlowField);
+
+    /* Edits are local, so the first band is stretched over the whole map and spread on the calling thread */
+    band->firstRow = 0;
+    band->endRow = field->gridHeight;
+    band->queueHead = band->queueCount = 0;
+    band->failed = FALSE;
+    band->visited = 0;
+
+    if(isWall) {
+        closeFlowTile(field, band, tile, distance);
+    } else {
+        field->distances[tile] = closestNeighbourDistance(field, tile);
+        if(field->distances[tile] != INT_MAX)
+            pushFlowTile(band, tile);
+    }
+
+    if(!band->failed)
+        spreadFlowBand(field, band, 0, INT_MAX);
+
+    TRACE_END(editFlowField);
+
+    if(band->failed) {
+        clearFlowField(field);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+void flowFieldMapListener(void* field, const TileMap* map, int tileX, int tileY, short oldTile) {
+    (void)map;
+    (void)oldTile;
+    editFlowField(field, tileX, tileY);
+}
+
+int getFlowDistance(const FlowField* field, int tileX, int tileY) {
+    int distance;
+
+    if(tileX < 0 || tileY < 0 || tileX >= field->gridWidth || tileY >= field->gridHeight)
+        return FLOW_UNREACHABLE;
+
+    distance = field->distances[tileY * field->gridWidth + tileX];
+    if(distance == INT_MIN || distance == INT_MAX)
+        return FLOW_UNREACHABLE;
+
+    return distance + field->offset;
+}
+
+int getFlowDirection(const FlowField* field, int tileX, int tileY, Vector2f* direction) {
+    /* Straight neighbours come first, so that diagonals have to be strictly closer to win */
+    static const int neighbours[8][2] = {
+        {1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {-1, 1}, {1, -1}, {-1, -1}
+    };
+    int best = getFlowDistance(field, tileX, tileY);
+    int i, bestNeighbour = -1;
+    float scale;
+
+    if(best == FLOW_UNREACHABLE || best == 0)
+        return FALSE;
+
+    for(i = 0; i < 8; i++) {
+        int dx = neighbours[i][0], dy = neighbours[i][1];
+        int distance = getFlowDistance(field, tileX + dx, tileY + dy);
+
+        if(distance == FLOW_UNREACHABLE || distance >= best)
+            continue;
+
+        /* Don't cut the corners of walls */
+        if(dx && dy && (getFlowDistance(field, tileX + dx, tileY) == FLOW_UNREACHABLE ||
+                getFlowDistance(field, tileX, tileY + dy) == FLOW_UNREACHABLE))
+            continue;
+
+        best = distance;
+        bestNeighbour = i;
+    }
+
+    /* Stale distances can leave a tile with no neighbour closer than itself */
+    if(bestNeighbour < 0)
+        return FALSE;
+
+    scale = (bestNeighbour >= 4) ? (float)(1.0 / sqrt(2.0)) : 1.0f;
+    *direction = vector2f(scale * neighbours[bestNeighbour][0], scale * neighbours[bestNeighbour][1]);
+    return TRUE;
+}
@@ -0,0 +1,198 @@
+#ifndef FLOWFIELD_H
+#define FLOWFIELD_H
+
+#include "config.h"
+#include "vector2f.h"
+#include "tilemap.h"
+
+/*
+ * A flow field holds, for every open tile of a map, the length of the
+ * shortest 4-connected path from it to a target tile. Agents find their
+ * way to the target by stepping to whichever neighbouring tile is closer,
+ * which takes constant time per agent however many there are.
+ *
+ * The field is integrated as a wavefront spreading out from the target.
+ * The map's rows are split into bands that are integrated in parallel,
+ * one per flow thread. In each round, every band spreads the wavefront a
+ * further FLOW_WINDOW tiles from the target within its rows, so that the
+ * bands advance together, and passes the distances that reach its edges
+ * to the bands next to it for the following round. A distance that is
+ * lowered after it was passed on is passed on again, until no band has
+ * anything left to spread or pass. Wider windows take fewer rounds, but
+ * redo more work where paths cross between bands.
+ *
+ * Distances are stored relative to a shared offset. When the target
+ * moves a few tiles, raising the offset by the distance it moved bounds
+ * every distance from above at once, and only the tiles that got closer
+ * to the target are visited again.
+ *
+ * When a tile of the map is opened, the wavefront spreads from it alone.
+ * When one is walled off, only the tiles whose shortest paths all led
+ * through it are cut off and reached again from around them.
+ */
+
+/* Distance of tiles the target can't be reached from */
+#define FLOW_UNREACHABLE  -1
+
+/* Datatypes */
+typedef struct {
+    int firstRow;       /* The band's rows are firstRow to endRow - 1 */
+    int endRow;
+
+    /* Tiles waiting to pass the wavefront on, in order of distance, as a ring that grows when it is full */
+    int* queue;
+    int queueCapacity;  /* A power of two */
+    int queueHead;
+    int queueCount;
+
+    /* Distance and tile pairs lowered from the bands next to this one, to be sorted into the queue */
+    int* seeds;
+    int seedCount;
+
+    /*
+     * Distances reaching the row above (edges[parity][0]) and below
+     * (edges[parity][1]) the band, one per column. Rounds alternate
+     * parities, so that a band reads what its neighbours passed in the
+     * last round while they write the next.
+     */
+    int* edges[2][2];
+    char passed[2];     /* The band passed distances on in the last round of each parity */
+    char failed;        /* The queue could not grow */
+    long visited;       /* Tiles the band spread the wavefront from in the last update */
+} FlowBand;
+
+typedef struct {
+    /* The tiles the field spans, row by row. Positive tiles are walls. */
+    const short* tiles;
+    int gridWidth;
+    int gridHeight;
+
+    /* Per tile, relative to offset. Walls are INT_MIN and tiles cut off from the target INT_MAX. */
+    int* distances;
+    int offset;
+    int targetX;        /* -1 before the first update */
+    int targetY;
+
+    int bandCount;
+    FlowBand bands[FLOW_MAX_THREADS];
+    int rounds;         /* Rounds the last update took */
+} FlowField;
+
+/* Global data */
+extern FlowField playerFlow;
+
+/* Functions */
+
+/**
+ * Start the flow threads that integrate flow fields in parallel, one per
+ * CPU beyond the calling thread's, up to FLOW_MAX_THREADS in all. Flow
+ * fields are integrated on the calling thread alone until this is called,
+ * or if it fails. Does nothing if the threads are already running.
+ *
+ * Returns: Zero if the threads could not be started, non-zero otherwise.
+ */
+int initFlowThreads();
+
+/**
+ * Stop the flow threads.
+ */
+void destroyFlowThreads();
+
+/**
+ * Set up a flow field without a target.
+ *
+ * field:      The field to set up.
+ * tiles:      The map the field spans, row by row. It must outlive the
+ *             field.
+ * gridWidth:  The width of the map in tiles.
+ * gridHeight: The height of the map in tiles.
+ *
+ * Returns: Zero if the field could not be allocated, non-zero otherwise.
+ */
+int initFlowField(FlowField* field, const short* tiles, int gridWidth, int gridHeight);
+
+/**
+ * Free a flow field's arrays.
+ *
+ * field: The field to destroy.
+ */
+void destroyFlowField(FlowField* field);
+
+/**
+ * Point a flow field at a target tile. If the target moved at most
+ * FLOW_INCREMENTAL_DISTANCE tiles since the last update, only the tiles
+ * it got closer to are updated; otherwise the field is rebuilt.
+ *
+ * field:   The field to update.
+ * targetX: The column of the target tile.
+ * targetY: The row of the target tile.
+ *
+ * Returns: Zero if the target is a wall or off the map, in which case the
+ *          field is left as it was, or if the field ran out of memory, in
+ *          which case it is left without a target. Non-zero otherwise.
+ */
+int updateFlowField(FlowField* field, int targetX, int targetY);
+
+/**
+ * Integrate a flow field from scratch.
+ *
+ * field:   The field to rebuild.
+ * targetX: The column of the target tile.
+ * targetY: The row of the target tile.
+ *
+ * Returns: Zero if the target is a wall or off the map, in which case the
+ *          field is left as it was, or if the field ran out of memory, in
+ *          which case it is left without a target. Non-zero otherwise.
+ */
+int rebuildFlowField(FlowField* field, int targetX, int targetY);
+
+/**
+ * Update a field after a tile of its map was changed, visiting only the
+ * tiles whose distances change. Changes between two kinds of wall, or two
+ * kinds of open tile, leave the field as it is.
+ *
+ * field: The field to update.
+ * tileX: The column of the tile.
+ * tileY: The row of the tile.
+ *
+ * Returns: Zero if the field ran out of memory, in which case it is left
+ *          without a target, non-zero otherwise. A field whose target
+ *          became a wall is also left without a target.
+ */
+int editFlowField(FlowField* field, int tileX, int tileY);
+
+/**
+ * A map listener that keeps the flow field it is added with up to date
+ * with the edits of the map the field spans (see editFlowField).
+ */
+void flowFieldMapListener(void* field, const TileMap* map, int tileX, int tileY, short oldTile);
+
+/**
+ * Look up the length of the shortest path from a tile to the target.
+ *
+ * field: The field to look in.
+ * tileX: The column of the tile.
+ * tileY: The row of the tile.
+ *
+ * Returns: The distance in tiles, or FLOW_UNREACHABLE if the tile is a
+ *          wall, off the map or cut off from the target.
+ */
+int getFlowDistance(const FlowField* field, int tileX, int tileY);
+
+/**
+ * Look up the direction to head in from a tile towards the target: to
+ * the neighbouring tile closest to the target, diagonals included, as
+ * long as the move does not cut a wall's corner.
+ *
+ * field:     The field to look in.
+ * tileX:     The column of the tile.
+ * tileY:     The row of the tile.
+ * direction: Set to the unit direction to head in.
+ *
+ * Returns: Zero if the tile is the target, the target can't be reached
+ *          from it, or no neighbour is closer to the target, non-zero
+ *          otherwise.
+ */
+int getFlowDirection(const FlowField* field, int tileX, int tileY, Vector2f* direction);
+
+#endif /* FLOWFIELD_H */
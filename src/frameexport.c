@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "frameexport.h"
+
+#ifndef _WIN32
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "framering.h"
+
+#define FRAME_SIZE  (WINDOW_WIDTH * WINDOW_HEIGHT * sizeof(Uint32))
+#define SLOT_SIZE   ((sizeof(FrameSlotHeader) + FRAME_SIZE + 63) & ~(size_t)63)
+
+static FrameRingHeader* ring = NULL;
+static uint64_t ringSize = 0;
+
+
+static uint64_t monotonicNs() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+int startFrameExport() {
+    int fd;
+    void* mapping;
+
+    if(ring)
+        return TRUE;
+
+    ringSize = frameRingSize(FRAME_RING_SLOTS, SLOT_SIZE);
+    fd = shm_open(FRAME_RING_NAME, O_CREAT | O_RDWR, 0600);
+    if(fd < 0) {
+        perror("Could not create the frame ring");
+        return FALSE;
+    }
+
+    if(ftruncate(fd, ringSize) < 0) {
+        perror("Could not size the frame ring");
+        close(fd);
+        shm_unlink(FRAME_RING_NAME);
+        return FALSE;
+    }
+
+    mapping = mmap(NULL, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED) {
+        perror("Could not map the frame ring");
+        shm_unlink(FRAME_RING_NAME);
+        return FALSE;
+    }
+
+    /* Readers check the magic last, so publish it after the rest of the header */
+    ring = mapping;
+    memset(ring, 0, FRAME_RING_HEADER_SIZE);
+    ring->version = FRAME_RING_VERSION;
+    ring->slotCount = FRAME_RING_SLOTS;
+    ring->slotSize = SLOT_SIZE;
+    __atomic_store_n(&ring->magic, FRAME_RING_MAGIC, __ATOMIC_RELEASE);
+
+    fprintf(stderr, "Exporting frames to shared memory %s\n", FRAME_RING_NAME);
+    return TRUE;
+}
+
+void exportFrame(const Uint32* buffer, const Vector3f* pos, const Vector3f* dir) {
+    uint64_t frame;
+    FrameSlotHeader* slot;
+
+    if(!ring)
+        return;
+
+    frame = ring->publishedFrames + 1;
+    slot = frameRingSlot(ring, frame);
+
+    /* Mark the slot as being written before touching its contents */
+    __atomic_store_n(&slot->sequence, 2 * frame - 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    slot->width = WINDOW_WIDTH;
+    slot->height = WINDOW_HEIGHT;
+    slot->frameSize = FRAME_SIZE;
+    slot->posX = pos->x;
+    slot->posY = pos->y;
+    slot->dirX = dir->x;
+    slot->dirY = dir->y;
+    memcpy(slot + 1, buffer, FRAME_SIZE);
+    slot->timestampNs = monotonicNs();
+
+    __atomic_store_n(&slot->sequence, 2 * frame, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->publishedFrames, frame, __ATOMIC_RELEASE);
+}
+
+void stopFrameExport() {
+    if(!ring)
+        return;
+
+    fprintf(stderr, "Exported %llu frames\n", (unsigned long long)ring->publishedFrames);
+    munmap(ring, ringSize);
+    shm_unlink(FRAME_RING_NAME);
+    ring = NULL;
+}
+
+int isExportingFrames() {
+    return ring != NULL;
+}
+
+#else /* _WIN32 */
+
+int startFrameExport() {
+    fprintf(stderr, "Frame export is only supported on POSIX systems\n");
+    return FALSE;
+}
+
+void exportFrame(const Uint32* buffer, const Vector3f* pos, const Vector3f* dir) {
+}
+
+void stopFrameExport() {
+}
+
+int isExportingFrames() {
+    return FALSE;
+}
+
+#endif /* _WIN32 */
@@ -0,0 +1,39 @@
+#ifndef FRAMEEXPORT_H
+#define FRAMEEXPORT_H
+
+#include "gfx.h"
+#include "linalg.h"
+
+/* Functions */
+
+/**
+ * Create the shared-memory frame ring (see framering.h) that presented
+ * frames are published to. Only supported on POSIX systems. Does nothing
+ * if the ring already exists.
+ *
+ * Returns: Non-zero if frames are being exported, zero otherwise.
+ */
+int startFrameExport();
+
+/**
+ * Publish a finished frame to the next slot of the ring. This never
+ * waits for readers: a reader that falls behind misses frames.
+ *
+ * buffer: The WINDOW_WIDTH x WINDOW_HEIGHT frame to publish.
+ * pos:    The player position the frame was rendered from.
+ * dir:    The player direction the frame was rendered from.
+ */
+void exportFrame(const Uint32* buffer, const Vector3f* pos, const Vector3f* dir);
+
+/**
+ * Unmap and unlink the frame ring. Readers that still have it mapped
+ * keep their mapping. Does nothing if no ring exists.
+ */
+void stopFrameExport();
+
+/**
+ * Returns: Non-zero if frames are being exported, zero otherwise.
+ */
+int isExportingFrames();
+
+#endif /* FRAMEEXPORT_H */
@@ -0,0 +1,69 @@
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+/*
+ * Layout of the shared-memory frame ring written by frameexport.c.
+ *
+ * This header is also compiled into tools/framereader.c, so it must only
+ * depend on the C standard library.
+ *
+ * The shared object starts with a FrameRingHeader, followed by slotCount
+ * slots of slotSize bytes each. Frame n (counting from 1) is written to
+ * slot n % slotCount. Every slot starts with a FrameSlotHeader, followed
+ * by the frame's pixels as 32-bit 0xAABBGGRR values, row by row.
+ *
+ * Each slot's sequence field works as a seqlock: it is odd while the
+ * slot is being written and 2n once frame n is complete. A reader copies
+ * the slot and then checks that the sequence did not change meanwhile.
+ */
+
+#include <stdint.h>
+
+#define FRAME_RING_NAME         "/raycaster-frames"
+#define FRAME_RING_MAGIC        0x47524652u  /* "RFRG" */
+#define FRAME_RING_VERSION      1
+#define FRAME_RING_SLOTS        4
+#define FRAME_RING_HEADER_SIZE  64           /* Space reserved for the ring header */
+
+/* Types */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t slotSize;          /* Bytes per slot, including its header */
+    uint64_t publishedFrames;   /* Number of the latest complete frame, zero if none */
+} FrameRingHeader;
+
+typedef struct {
+    uint64_t sequence;          /* Odd while being written, twice the frame number once complete */
+    uint64_t timestampNs;       /* CLOCK_MONOTONIC time at which the frame was published */
+    uint32_t width;
+    uint32_t height;
+    uint32_t frameSize;         /* Bytes of pixel data following this header */
+    float posX;                 /* Player position the frame was rendered from */
+    float posY;
+    float dirX;                 /* Player direction the frame was rendered from */
+    float dirY;
+    uint32_t reserved[5];       /* Pads the header to 64 bytes */
+} FrameSlotHeader;
+
+/**
+ * Find the slot that a frame is written to.
+ *
+ * ring:  The mapped ring.
+ * frame: The frame number.
+ *
+ * Returns: The header of the frame's slot.
+ */
+static inline FrameSlotHeader* frameRingSlot(FrameRingHeader* ring, uint64_t frame) {
+    return (FrameSlotHeader*)((char*)ring + FRAME_RING_HEADER_SIZE + (frame % ring->slotCount) * ring->slotSize);
+}
+
+/**
+ * Returns: The size of a ring with the given number of slots, in bytes.
+ */
+static inline uint64_t frameRingSize(uint32_t slotCount, uint32_t slotSize) {
+    return FRAME_RING_HEADER_SIZE + (uint64_t)slotCount * slotSize;
+}
+
+#endif /* FRAMERING_H */
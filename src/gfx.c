@@ -14,30 +14,48 @@
  * ===================================================
  */
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 #include "gfx.h"
-
-/* Used to identify a texture structure in memory */
-#define TEX_TAG 0x55AA
+#include "pixelpool.h"
+#include "trace.h"
 
 /* Error string buffer */
 char errstr[256];
 
+/* Dirty rectangles kept per texture before they are collapsed into their bounding box */
+#define MAX_DIRTY_RECTS 16
+
 /*
  * SDL textures are stored in VRAM, so we need to manage
  * a RAM-persistent copy of the texture's pixel data that we
- * can write to. Allocated textures are stored in a linked
- * list so we can keep track of them all easily.
+ * can write to. The pixel data comes from the pixel pool, aligned
+ * for SIMD. Managed textures live in a table of slots, and a texture's
+ * slot number is its handle. Callers only see the pixel data, so an
+ * open-addressed index maps pixel pointers back to their handles.
+ *
+ * Regions of the pixel data marked dirty since the last upload are kept
+ * as a short list of rectangles, so only those need to be uploaded.
  */
-typedef struct ManagedTexture_ ManagedTexture_;
-struct ManagedTexture_ {
+typedef struct {
     void* pixelData; /* RAM copy of the texture */
     SDL_Texture* texture;
     Uint32 pitch;
-    ManagedTexture_* next;
-    ManagedTexture_* prev;
-    Uint16 magicTag;
-};
-ManagedTexture_* managedTextures = NULL;
+    size_t size;
+    int width;
+    int height;
+    SDL_Rect dirtyRects[MAX_DIRTY_RECTS];
+    int dirtyRectCount;
+    int nextFree;    /* Next free slot while this one is free */
+} ManagedTexture_;
+
+ManagedTexture_* textureSlots = NULL;
+int textureSlotCount = 0;
+int firstFreeSlot = -1;
+
+/* Pixel pointer index: handles, or -1 for empty entries. The capacity is a power of two. */
+int* textureIndex = NULL;
+int textureIndexCapacity = 0;
 
 /* SDL Stuff */
 SDL_Window* window = NULL;
@@ -46,6 +64,9 @@ SDL_Renderer* renderer = NULL;
 unsigned int screenWidth  = -1;
 unsigned int screenHeight = -1;
 
+/* Pixel data uploaded to SDL textures since startup */
+Uint64 uploadedTextureBytes = 0;
+
 /*========================================================
  * Library debug functions
  *========================================================
@@ -95,104 +116,291 @@ int initGFX(char* title, unsigned int width, unsigned int height) {
     return 1;
 }
 
+/*========================================================
+ * Texture table
+ *========================================================
+ */
+
+static int hashPixelPointer(void* ptr) {
+    Uint64 key = (uintptr_t)ptr / POOL_ALIGNMENT;
+    return (int)((key * 0x9E3779B97F4A7C15ull) >> 32) & (textureIndexCapacity - 1);
+}
+
+/* Find the index entry of a pixel pointer, or of the empty entry where it would go */
+static int findIndexEntry(void* ptr) {
+    int i = hashPixelPointer(ptr);
+
+    while(textureIndex[i] >= 0 && textureSlots[textureIndex[i]].pixelData != ptr)
+        i = (i + 1) & (textureIndexCapacity - 1);
+
+    return i;
+}
+
+/* Returns the handle of the texture with the given pixel data, or -1 if there is none */
+static int findTextureHandle(void* ptr) {
+    int i;
+
+    if(!ptr || !textureIndex)
+        return -1;
+
+    i = findIndexEntry(ptr);
+    return textureIndex[i];
+}
+
+/* Remove an index entry, shifting back the entries probed past it */
+static void removeIndexEntry(int i) {
+    int j = i;
+
+    textureIndex[i] = -1;
+    for(;;) {
+        int home;
+
+        j = (j + 1) & (textureIndexCapacity - 1);
+        if(textureIndex[j] < 0)
+            return;
+
+        home = hashPixelPointer(textureSlots[textureIndex[j]].pixelData);
+        if(((j - home) & (textureIndexCapacity - 1)) >= ((j - i) & (textureIndexCapacity - 1))) {
+            textureIndex[i] = textureIndex[j];
+            textureIndex[j] = -1;
+            i = j;
+        }
+    }
+}
+
+/* Double the slot table and rebuild the index at twice the slot count */
+static int growTextureTable() {
+    int i, newCount = textureSlotCount ? 2 * textureSlotCount : 16;
+    ManagedTexture_* slots = realloc(textureSlots, newCount * sizeof(ManagedTexture_));
+    int* index;
+
+    if(!slots) return 0;
+    textureSlots = slots;
+
+    index = malloc(2 * newCount * sizeof(int));
+    if(!index) return 0;
+
+    for(i = newCount - 1; i >= textureSlotCount; i--) {
+        textureSlots[i].pixelData = NULL;
+        textureSlots[i].nextFree = firstFreeSlot;
+        firstFreeSlot = i;
+    }
+    textureSlotCount = newCount;
+
+    free(textureIndex);
+    textureIndex = index;
+    textureIndexCapacity = 2 * newCount;
+    memset(textureIndex, -1, textureIndexCapacity * sizeof(int));
+
+    for(i = 0; i < textureSlotCount; i++)
+        if(textureSlots[i].pixelData)
+            textureIndex[findIndexEntry(textureSlots[i].pixelData)] = i;
+
+    return 1;
+}
+
 void* createTexture(unsigned int width, unsigned int height) {
-    Uint32* data;
     ManagedTexture_* newmtex;
+    int handle;
     if(!width || !height || !renderer) {
         gfxSetError("SDL window has not been initialized yet", 0);
         return NULL;
     }
 
-    newmtex = malloc(sizeof(ManagedTexture_)); if(!newmtex) { return NULL; }
+    if(firstFreeSlot < 0 && !growTextureTable()) {
+        gfxSetError("Could not grow the texture table", 0);
+        return NULL;
+    }
+
+    handle = firstFreeSlot;
+    newmtex = &textureSlots[handle];
     newmtex->pitch = width * sizeof(Uint32);
-    newmtex->next = NULL;
-    newmtex->prev = NULL;
-    newmtex->magicTag  = TEX_TAG;
+    newmtex->size = (size_t)newmtex->pitch * height;
+    newmtex->width = width;
+    newmtex->height = height;
+
+    /* The whole texture is uploaded the first time it is displayed */
+    newmtex->dirtyRectCount = 1;
+    newmtex->dirtyRects[0].x = newmtex->dirtyRects[0].y = 0;
+    newmtex->dirtyRects[0].w = width;
+    newmtex->dirtyRects[0].h = height;
 
     newmtex->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, width, height);
     if(!(newmtex->texture)) {
-        free(newmtex);
         gfxSetError("Could not create texture", 1);
         return NULL;
     }
 
-    data = malloc((sizeof(Uint32) * width * height) + sizeof(ManagedTexture_*)); if(!data) {free(newmtex); return NULL; }
-
-    /*
-     * Hide a pointer to the managed struct before the actual pixel data.
-     *
-     * This allows the caller to only have to worry about the data they
-     * want, while still allowing this library to perform more complicated
-     * management tasks given only a reference to the pixel data.
-     */
-    *((ManagedTexture_**)data) = newmtex;
-    newmtex->pixelData = ((ManagedTexture_**)data) + 1;
-
-    /* Insert the item into the linked list */
-    if(managedTextures) {
-        newmtex->next = managedTextures;
-        managedTextures->prev = newmtex;
+    newmtex->pixelData = poolAlloc(newmtex->size);
+    if(!newmtex->pixelData) {
+        SDL_DestroyTexture(newmtex->texture);
+        gfxSetError("Could not allocate texture pixels", 0);
+        return NULL;
     }
-    managedTextures = newmtex;
 
+    /* Claim the slot and index it by its pixel data */
+    firstFreeSlot = newmtex->nextFree;
+    textureIndex[findIndexEntry(newmtex->pixelData)] = handle;
 
     return newmtex->pixelData;
 }
 
 int destroyTexture(void* ptr) {
-    /* Recover the memory management structure before freeing anything */
-    ManagedTexture_* mtex = *(((ManagedTexture_**)ptr) - 1);
+    int handle = findTextureHandle(ptr);
+    ManagedTexture_* mtex;
 
-    /* Don't do anything if it's not actually a managed structure */
-    if(mtex->magicTag != TEX_TAG) {
+    /* Don't do anything if it's not actually a managed texture */
+    if(handle < 0) {
         gfxSetError("Not a valid texture pointer", 0);
         return 0;
     }
-
-    /* Prevent this structure from being somehow sent here again */
-    mtex->magicTag = 0;
+    mtex = &textureSlots[handle];
 
     /* Actual cleanup */
-    free(((ManagedTexture_**)ptr) - 1);
-
+    removeIndexEntry(findIndexEntry(ptr));
+    poolFree(mtex->pixelData, mtex->size);
     SDL_DestroyTexture(mtex->texture);
 
-    if(mtex->prev) mtex->prev->next = mtex->next;
-    if(mtex->next) mtex->next->prev = mtex->prev;
-    if(managedTextures == mtex) managedTextures = mtex->next;
-    free(mtex);
+    mtex->pixelData = NULL;
+    mtex->nextFree = firstFreeSlot;
+    firstFreeSlot = handle;
 
     return 1;
 }
 
+void getTextureMemoryStats(TextureMemoryStats* stats) {
+    PoolStats poolStats;
+    int i;
+
+    getPoolStats(&poolStats);
+    stats->bytesLive = poolStats.bytesLive;
+    stats->bytesPeak = poolStats.bytesPeak;
+    stats->bytesReserved = poolStats.bytesReserved;
+    stats->totalAllocations = poolStats.totalAllocations;
+
+    stats->textureCount = 0;
+    for(i = 0; i < textureSlotCount; i++)
+        stats->textureCount += textureSlots[i].pixelData != NULL;
+}
+
+void useHugePagesForTextures(int enabled) {
+    poolUseHugePages(enabled);
+}
+
+/*
+ * If the union of two rectangles is itself a rectangle, such as for
+ * adjacent column spans, store it in a and return non-zero.
+ */
+static int mergeRects(SDL_Rect* a, const SDL_Rect* b) {
+    SDL_Rect both;
+
+    SDL_UnionRect(a, b, &both);
+    if((a->y == b->y && a->h == b->h && b->x <= a->x + a->w && a->x <= b->x + b->w) ||
+            (a->x == b->x && a->w == b->w && b->y <= a->y + a->h && a->y <= b->y + b->h) ||
+            (both.x == a->x && both.y == a->y && both.w == a->w && both.h == a->h) ||
+            (both.x == b->x && both.y == b->y && both.w == b->w && both.h == b->h)) {
+        *a = both;
+        return 1;
+    }
+
+    return 0;
+}
+
+void markTextureDirty(void* texture, int x, int y, int w, int h) {
+    ManagedTexture_* mtex;
+    SDL_Rect rect, bounds;
+    int i, handle = findTextureHandle(texture);
+
+    if(handle < 0) {
+        gfxSetError("Not a valid texture pointer", 0);
+        return;
+    }
+    mtex = &textureSlots[handle];
+
+    bounds.x = bounds.y = 0;
+    bounds.w = mtex->width;
+    bounds.h = mtex->height;
+    rect.x = x;
+    rect.y = y;
+    rect.w = w;
+    rect.h = h;
+    if(!SDL_IntersectRect(&rect, &bounds, &rect))
+        return;
+
+    /* Absorb every rectangle the new one merges with, rechecking the rest after each merge */
+    for(i = 0; i < mtex->dirtyRectCount;) {
+        if(mergeRects(&rect, &mtex->dirtyRects[i])) {
+            mtex->dirtyRects[i] = mtex->dirtyRects[--mtex->dirtyRectCount];
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+
+    /* Too fragmented, upload the bounding box instead */
+    if(mtex->dirtyRectCount == MAX_DIRTY_RECTS) {
+        for(i = 0; i < mtex->dirtyRectCount; i++)
+            SDL_UnionRect(&rect, &mtex->dirtyRects[i], &rect);
+        mtex->dirtyRectCount = 0;
+    }
+
+    mtex->dirtyRects[mtex->dirtyRectCount++] = rect;
+}
+
+Uint64 getUploadedTextureBytes() {
+    return uploadedTextureBytes;
+}
+
 void displayFullscreenTexture(void* texture) {
     ManagedTexture_* mtex;
+    int i, handle;
 
     if(!window || !renderer) {
         gfxSetError("SDL window has not been initialized yet", 0);
         return;
     }
 
-    /* Recover the managed texture structure */
-    mtex = *(((ManagedTexture_**)texture) - 1);
-
     /* Don't do anything if it's not actually a managed texture */
-    if(mtex->magicTag != TEX_TAG) {
+    handle = findTextureHandle(texture);
+    if(handle < 0) {
         gfxSetError("Not a valid texture pointer", 0);
         return;
     }
+    mtex = &textureSlots[handle];
+
+    TRACE_BEGIN(displayFullscreenTexture);
+
+    /* Rows of a rectangle start inside the texture's rows, so the pitch is unchanged */
+    for(i = 0; i < mtex->dirtyRectCount; i++) {
+        SDL_Rect* rect = &mtex->dirtyRects[i];
+        Uint8* pixels = (Uint8*)mtex->pixelData + (size_t)rect->y * mtex->pitch + rect->x * sizeof(Uint32);
 
-    SDL_UpdateTexture(mtex->texture, NULL, mtex->pixelData, mtex->pitch);
+        SDL_UpdateTexture(mtex->texture, rect, pixels, mtex->pitch);
+        uploadedTextureBytes += (Uint64)rect->w * rect->h * sizeof(Uint32);
+    }
+    mtex->dirtyRectCount = 0;
 
     SDL_RenderClear(renderer);
     SDL_RenderCopy(renderer, mtex->texture, NULL, NULL);
     SDL_RenderPresent(renderer);
+    TRACE_END(displayFullscreenTexture);
 }
 
 
 void destroyGFX() {
+    int i;
+
     /* Destroy all allocated textures */
-    while(managedTextures) destroyTexture(managedTextures->pixelData);
+    for(i = 0; i < textureSlotCount; i++)
+        if(textureSlots[i].pixelData) destroyTexture(textureSlots[i].pixelData);
+
+    free(textureSlots);
+    free(textureIndex);
+    textureSlots = NULL;
+    textureIndex = NULL;
+    textureSlotCount = textureIndexCapacity = 0;
+    firstFreeSlot = -1;
+    destroyPool();
 
     /* Clean everything else up */
     if(window && renderer) {
@@ -261,6 +469,9 @@ Uint32* generateXorTexture(int size, int redmask, int greenmask, int bluemask) {
     float factor = 256.0f / (float)size;
     Uint32* texture = createTexture(size, size);
 
+    if(!texture)
+        return NULL;
+
     for(x = 0; x < size; x++)
         for(y = 0; y < size; y++)
             texture[(size * y) + x] = RGBtoABGR((int)((x ^ y) * factor) & redmask, (int)((x ^ y) * factor) & greenmask, (int)((x ^ y) * factor) & bluemask);
@@ -34,6 +34,21 @@
 #define RGBtoABGR(R,G,B)   (0xFF000000 | ((B) << 16) | ((G) << 8) | (R))
 
 
+/*========================================================
+ * Types
+ *========================================================
+ */
+
+/* Memory used by texture pixel data */
+typedef struct {
+    size_t bytesLive;         /* Bytes of pixel data in live textures */
+    size_t bytesPeak;         /* Highest value bytesLive has reached */
+    size_t bytesReserved;     /* Bytes obtained from the system for pixel data */
+    long totalAllocations;    /* Pixel buffers allocated since startup */
+    int textureCount;         /* Live textures */
+} TextureMemoryStats;
+
+
 /*========================================================
  * Library debug functions
  *========================================================
@@ -64,7 +79,7 @@ int initGFX(char* title, unsigned int width, unsigned int height);
  * width:  The width of the texture buffer
  * height: The height of the texture buffer
  *
- * Returns: A pointer to the texture pixel buffer
+ * Returns: A pointer to the texture pixel buffer, aligned to 64 bytes
  */
 void* createTexture(unsigned int width, unsigned int height);
 
@@ -78,7 +93,45 @@ void* createTexture(unsigned int width, unsigned int height);
 int destroyTexture(void* texture);
 
 /**
- * Draw a texture to the window's entire rendering area.
+ * Get statistics on the memory used by texture pixel data.
+ *
+ * stats: Set to the current statistics.
+ */
+void getTextureMemoryStats(TextureMemoryStats* stats);
+
+/**
+ * Set whether the pixel data of large textures, such as screen buffers,
+ * is backed by huge pages where the system supports it. This only
+ * affects textures created afterwards.
+ *
+ * enabled: 1 to request huge pages, 0 otherwise.
+ */
+void useHugePagesForTextures(int enabled);
+
+/**
+ * Mark a region of a texture as changed since it was last displayed.
+ * Adjacent and overlapping regions are merged. displayFullscreenTexture
+ * only uploads the regions marked since the texture was last displayed,
+ * and new textures are uploaded in full.
+ *
+ * texture: A pointer to the texture
+ * x:       The x component of the top-left corner of the region
+ * y:       The y component of the top-left corner of the region
+ * w:       The width of the region
+ * h:       The height of the region
+ */
+void markTextureDirty(void* texture, int x, int y, int w, int h);
+
+/**
+ * Get the amount of pixel data uploaded by displayFullscreenTexture.
+ *
+ * Returns: The number of bytes uploaded since startup
+ */
+Uint64 getUploadedTextureBytes();
+
+/**
+ * Draw a texture to the window's entire rendering area. Only the regions
+ * of its pixel data marked with markTextureDirty are uploaded first.
  *
  * texture: A pointer to the texture to be drawm
  *
@@ -0,0 +1,435 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "golden.h"
+#include "palette.h"
+#include "pipeline.h"
+#include "player.h"
+#include "raycaster.h"
+#include "renderer.h"
+
+#define GOLDEN_PATH_SIZE  1024
+#define FRAME_PIXELS      (WINDOW_WIDTH * WINDOW_HEIGHT)
+
+/* Pixels of diff images that match their reference, and those that don't */
+#define DARKEN_QUARTER(C)  ((((C) >> 2) & 0x3F3F3F3F) | 0xFF000000)
+#define DIFF_COLOR         RGBtoABGR(0xFF, 0x00, 0x00)
+
+/* Frames are hashed with 64-bit FNV-1a */
+#define FNV_OFFSET_BASIS   14695981039346656037ULL
+#define FNV_PRIME          1099511628211ULL
+
+/*
+ * Fixed camera poses (x, y, facing angle in degrees). Some face straight
+ * along the grid, where one of each ray's step vectors degenerates, and
+ * one stands close to a wall corner.
+ */
+static const float goldenPoses[][3] = {
+    {2.5f * WALL_SIZE, 2.5f * WALL_SIZE,  90.0f},
+    {4.7f * WALL_SIZE, 3.1f * WALL_SIZE,  37.0f},
+    {1.6f * WALL_SIZE, 7.8f * WALL_SIZE, 217.0f},
+    {6.6f * WALL_SIZE, 5.2f * WALL_SIZE,   0.0f},
+    {5.2f * WALL_SIZE, 1.5f * WALL_SIZE, 180.0f},
+    {2.1f * WALL_SIZE, 2.1f * WALL_SIZE, 315.0f}
+};
+#define NUM_GOLDEN_POSES  (int)(sizeof(goldenPoses) / sizeof(goldenPoses[0]))
+
+/* Values of rayCastMode */
+#define NUM_CAST_MODES    3
+#define FRAMES_PER_POSE   (2 * 2 * NUM_CAST_MODES)
+
+/*
+ * FNV-1a hashes of the red, green and blue bytes of every frame, row by
+ * row, as drawn by the original renderer before any render path was
+ * optimized. Each pose's frames are in the order they are named: flat then
+ * textured, corrected then distorted, then by cast mode. The exact paths
+ * must reproduce them bit for bit. After a deliberate change to what is
+ * drawn, print new ones with --golden record.
+ *
+ * The one exception is pose 0's textured, corrected frame, where the
+ * original renderer read past the end of a texture in a few pixels; its
+ * hash is of the frame drawn since the column kernels were specialized.
+ */
+static const Uint64 goldenHashes[NUM_GOLDEN_POSES][FRAMES_PER_POSE] = {
+    {0x9969f6f2b7c2ab48ULL, 0xa2bf8c6eaf5df325ULL, 0x9d10173b02536325ULL, 0xf6ced7ae584cbf86ULL,
+     0xa2bf8c6eaf5df325ULL, 0x9d10173b02536325ULL, 0x15cf5ab22e37ef51ULL, 0x5938b5ef509f3719ULL,
+     0x9e178facbac98e15ULL, 0x52c68b2a8313d8bcULL, 0x70a54699237f00b5ULL, 0x401d6c9b36c000e5ULL},
+    {0xb210d877ed2ada8fULL, 0x834912b972f36325ULL, 0x834912b972f36325ULL, 0xae5d6034e43a5cacULL,
+     0x834912b972f36325ULL, 0x834912b972f36325ULL, 0xbafa4f6e767bbe3aULL, 0xad7b663bf961932dULL,
+     0x339063589c5a4fbdULL, 0x18184a1f35fa0d44ULL, 0x95180af33ef171d5ULL, 0x064169237db9268dULL},
+    {0xa9643312fead1b78ULL, 0x81304cb8a49ec8a5ULL, 0x246e2d6f81540325ULL, 0x05607becaf2f908aULL,
+     0x81304cb8a49ec8a5ULL, 0x246e2d6f81540325ULL, 0x7539e5e56830aeefULL, 0x66e2a2fa6d367461ULL,
+     0xdd85f92143ea72b3ULL, 0x7848b9f2d0825805ULL, 0x90fc1464f65f9d85ULL, 0x2afb9ab7c2120319ULL},
+    {0x4d0be0fbda95ac25ULL, 0x834912b972f36325ULL, 0xd223457cb3eb6325ULL, 0xf1cc61911e4eb22cULL,
+     0x834912b972f36325ULL, 0xd223457cb3eb6325ULL, 0xae3e0a72b84a79c9ULL, 0x9f593359fdd595c9ULL,
+     0xade39eca2c601789ULL, 0x45a5df45b6b0dd60ULL, 0xb6e6d18ce94024a5ULL, 0x09a83bf47e2e44f9ULL},
+    {0x16569610882444b4ULL, 0x834912b972f36325ULL, 0x834912b972f36325ULL, 0x3a33931304f879ceULL,
+     0x834912b972f36325ULL, 0x834912b972f36325ULL, 0x08bfeccfc122c8eeULL, 0xdc5a7892a8e2c111ULL,
+     0xde865cf853814d55ULL, 0x9b66138d46ac0845ULL, 0x7c621c086184b7a5ULL, 0x0e02bbff854edd81ULL},
+    {0xd40ffe72f5fcdae1ULL, 0x834912b972f36325ULL, 0x9d10173b02536325ULL, 0x0c223ab967def73aULL,
+     0x834912b972f36325ULL, 0x9d10173b02536325ULL, 0x19e04077b55c74bfULL, 0xd717abd197d8a6ddULL,
+     0x8afca1cb7cac2735ULL, 0xe252669d4dccd8f9ULL, 0x4fb796a497476ac5ULL, 0x4bed98ec97ceb8e5ULL}
+};
+
+
+/*========================================================
+ * Render paths
+ *========================================================
+ */
+
+/*
+ * Every render path draws the current pose into the screen buffer from
+ * scratch, with textureMode, distortion and rayCastMode already set and
+ * every other mode off. Alternative kernels are checked by adding them
+ * here, with how far their frames may stray from the reference path's:
+ * the largest difference allowed in any color channel, and the fraction
+ * of pixels allowed to differ by more than that. Paths allowed neither
+ * must reproduce the recorded hashes.
+ */
+typedef struct {
+    const char* name;
+    int (*render)();    /* Returns zero if the path is not available */
+    int maxChannelError;
+    double maxPixelError;
+} GoldenRenderer;
+
+static int renderReference() {
+    updateRaycaster();
+    renderReferenceColumns(0, WINDOW_WIDTH);
+    return TRUE;
+}
+
+static int renderColumns() {
+    updateRaycaster();
+    drawProjectedScene();
+    return TRUE;
+}
+
+/* Cast with the fused per-column caster that interlaced and adaptive rendering use */
+static int renderCastColumns() {
+    castColumns(0, VIEWPLANE_LENGTH, 1);
+    castPattern = FULL_CAST;
+    castColumnStart = 0;
+    castColumnStep = 1;
+    drawProjectedScene();
+    return TRUE;
+}
+
+static int renderTiled() {
+    tiledMode = TRUE;
+    if(!setGatherSampling(TRUE))
+        return FALSE;
+    return renderColumns();
+}
+
+static int renderTiledScalar() {
+    tiledMode = TRUE;
+    setGatherSampling(FALSE);
+    return renderColumns();
+}
+
+static int renderPalettized() {
+    if(!initPalette())
+        return FALSE;
+    palettizedMode = TRUE;
+    return renderColumns();
+}
+
+/*
+ * Draw two frames through the cast thread, and keep the first one, which
+ * is presented while the second is drawn
+ */
+static int renderPipelined() {
+    Uint64 presentTime;
+
+    if(!initPipeline())
+        return FALSE;
+    renderPipelinedFrame(0, &presentTime);
+    renderPipelinedFrame(0, &presentTime);
+
+    /* The presented frame is in the original screen buffer, which the pipeline hands back */
+    destroyPipeline();
+    return TRUE;
+}
+
+/* Draw a full frame, then an interlaced one that reprojects its hits into the columns it skips */
+static int renderInterlaced() {
+    renderColumns();
+    interlacedMode = TRUE;
+    return renderColumns();
+}
+
+static int renderAdaptive() {
+    adaptiveStep = ADAPTIVE_MAX_STEP;
+    return renderColumns();
+}
+
+static const GoldenRenderer goldenRenderers[] = {
+    {"reference",     renderReference,   0, 0.0},      /* Must come first, the other paths are compared to its frames */
+    {"columns",       renderColumns,     0, 0.0},
+    {"cast-columns",  renderCastColumns, 0, 0.0},
+    {"tiled",         renderTiled,       0, 0.0},
+    {"tiled-scalar",  renderTiledScalar, 0, 0.0},
+    {"pipelined",     renderPipelined,   0, 0.0},
+    {"palettized",    renderPalettized,  8, 0.0},      /* Quantized to the palette, and shaded through its remap table */
+    {"interlaced",    renderInterlaced,  0, 0.001},    /* Reprojected hits can round to a neighbouring texel or wall */
+    {"adaptive",      renderAdaptive,    0, 0.002}     /* As allowed by the benchmarks' quality checks */
+};
+#define NUM_GOLDEN_RENDERERS  (int)(sizeof(goldenRenderers) / sizeof(goldenRenderers[0]))
+
+static void setGoldenPose(int pose) {
+    float angle = goldenPoses[pose][2] * PI / 180.0f;
+
+    playerPos.x = goldenPoses[pose][0];
+    playerPos.y = goldenPoses[pose][1];
+    playerDir.x = cos(angle);
+    playerDir.y = sin(angle);
+
+    /* The viewplane stays perpendicular to the player direction */
+    viewplaneDir.x = -playerDir.y;
+    viewplaneDir.y = playerDir.x;
+}
+
+/* Turn off every mode the render paths don't set themselves */
+static void resetRenderModes() {
+    hudMode = FALSE;
+    interlacedMode = FALSE;
+    adaptiveStep = 1;
+    palettizedMode = FALSE;
+    tiledMode = FALSE;
+    rayCostMode = 0;
+    setGatherSampling(TRUE);
+}
+
+
+/*========================================================
+ * Images
+ *========================================================
+ */
+
+static int writeImage(const char* path, const Uint32* pixels) {
+    FILE* file = fopen(path, "wb");
+    unsigned char row[WINDOW_WIDTH * 3];
+    int x, y, written;
+
+    if(!file)
+        return FALSE;
+
+    written = fprintf(file, "P6\n%d %d\n255\n", WINDOW_WIDTH, WINDOW_HEIGHT) > 0;
+    for(y = 0; written && y < WINDOW_HEIGHT; y++) {
+        for(x = 0; x < WINDOW_WIDTH; x++) {
+            Uint32 pixel = pixels[XY_TO_SCREEN_INDEX(x, y)];
+
+            row[3 * x] = pixel & 0xFF;
+            row[3 * x + 1] = (pixel >> 8) & 0xFF;
+            row[3 * x + 2] = (pixel >> 16) & 0xFF;
+        }
+        written = fwrite(row, 3, WINDOW_WIDTH, file) == WINDOW_WIDTH;
+    }
+
+    return (fclose(file) == 0) && written;
+}
+
+static int channelDifference(Uint32 a, Uint32 b) {
+    int i, difference = 0;
+
+    for(i = 0; i < 24; i += 8)
+        difference = MAX(difference, abs((int)((a >> i) & 0xFF) - (int)((b >> i) & 0xFF)));
+
+    return difference;
+}
+
+/*
+ * Compare a frame against the reference path's, and draw the diff image.
+ * Returns the number of pixels that differ by more than maxChannelError.
+ */
+static int compareFrame(const Uint32* frame, const Uint32* expected, Uint32* diff, int maxChannelError, int* worstError) {
+    int i, differing = 0;
+
+    *worstError = 0;
+    for(i = 0; i < FRAME_PIXELS; i++) {
+        int error = channelDifference(frame[i], expected[i]);
+
+        *worstError = MAX(*worstError, error);
+        if(error > maxChannelError) {
+            differing++;
+            diff[i] = DIFF_COLOR;
+        } else {
+            diff[i] = DARKEN_QUARTER(expected[i]);
+        }
+    }
+
+    return differing;
+}
+
+
+/*========================================================
+ * Entry point
+ *========================================================
+ */
+
+/* Hash a frame's red, green and blue bytes, in the order they are written to images */
+static Uint64 hashFrame(const Uint32* pixels) {
+    Uint64 hash = FNV_OFFSET_BASIS;
+    int i, shift;
+
+    for(i = 0; i < FRAME_PIXELS; i++)
+        for(shift = 0; shift < 24; shift += 8)
+            hash = (hash ^ ((pixels[i] >> shift) & 0xFF)) * FNV_PRIME;
+
+    return hash;
+}
+
+/* Print a pose's hashes as a row of goldenHashes */
+static void printHashRow(const Uint64* hashes, int lastPose) {
+    int i;
+
+    printf("    {");
+    for(i = 0; i < FRAMES_PER_POSE; i++) {
+        if(i && !(i % 4))
+            printf("\n     ");
+        printf("0x%016llxULL%s", (unsigned long long)hashes[i], (i + 1 == FRAMES_PER_POSE) ? "" : (i % 4 == 3) ? "," : ", ");
+    }
+    printf("}%s\n", lastPose ? "" : ",");
+}
+
+/*
+ * Check every render path's frame of the current pose and modes. Returns
+ * the number of failures. A failing path leaves an image behind: the
+ * reference path its frame, the others a diff against the reference
+ * path's frame.
+ */
+static int checkFrame(const char* directory, const char* frameName, Uint64 recordedHash, Uint32* expected, Uint32* diff,
+        int* failures) {
+    char path[GOLDEN_PATH_SIZE];
+    int r, failed = 0;
+
+    for(r = 0; r < NUM_GOLDEN_RENDERERS; r++) {
+        int differing, worstError, exact, passed;
+        Uint64 hash;
+
+        resetRenderModes();
+        if(!goldenRenderers[r].render())
+            continue;
+
+        if(r == 0)
+            memcpy(expected, screenBuffer, FRAME_PIXELS * sizeof(Uint32));
+
+        hash = hashFrame(screenBuffer);
+        differing = compareFrame(screenBuffer, expected, diff, goldenRenderers[r].maxChannelError, &worstError);
+        exact = !goldenRenderers[r].maxChannelError && !goldenRenderers[r].maxPixelError;
+        passed = exact ? hash == recordedHash : differing <= goldenRenderers[r].maxPixelError * FRAME_PIXELS;
+
+        snprintf(path, sizeof(path), "%s/%s-%s%s.ppm", directory, frameName, goldenRenderers[r].name, r ? "-diff" : "");
+        if(passed) {
+            remove(path);
+            continue;
+        }
+
+        if(!exact)
+            printf("golden/%-14s %-34s %7d pixels differ, by up to %d", goldenRenderers[r].name, frameName,
+                    differing, worstError);
+        else
+            printf("golden/%-14s %-34s hash %016llx, recorded %016llx", goldenRenderers[r].name, frameName,
+                    (unsigned long long)hash, (unsigned long long)recordedHash);
+        printf("  (%s)\n", writeImage(path, r ? diff : screenBuffer) ? path : "image not written");
+        failures[r]++;
+        failed++;
+    }
+
+    return failed;
+}
+
+int runGoldenImages(const char* directory, char record) {
+    char savedTextureMode = textureMode;
+    char savedDistortion = distortion;
+    char savedRayCastMode = rayCastMode;
+    char savedInterlacedMode = interlacedMode;
+    char savedAdaptiveStep = adaptiveStep;
+    char savedPalettizedMode = palettizedMode;
+    char savedTiledMode = tiledMode;
+    char savedRayCostMode = rayCostMode;
+    char savedHudMode = hudMode;
+    Vector3f savedPos = playerPos;
+    Vector3f savedDir = playerDir;
+    Vector3f savedViewplaneDir = viewplaneDir;
+    Uint32* expected = malloc(FRAME_PIXELS * sizeof(Uint32));
+    Uint32* diff = malloc(FRAME_PIXELS * sizeof(Uint32));
+    Uint64 hashes[FRAMES_PER_POSE];
+    int failures[NUM_GOLDEN_RENDERERS] = {0};
+    int pose, textured, distorted, mode, r, frames = 0, failed = 0;
+
+    if(!expected || !diff) {
+        fprintf(stderr, "Could not allocate the golden image buffers\n");
+        free(expected);
+        free(diff);
+        return FALSE;
+    }
+
+    if(record)
+        printf("Hashes for goldenHashes in src/golden.c:\n");
+
+    for(pose = 0; pose < NUM_GOLDEN_POSES; pose++) {
+        for(textured = 0; textured < 2; textured++) {
+            for(distorted = 0; distorted < 2; distorted++) {
+                for(mode = 0; mode < NUM_CAST_MODES; mode++) {
+                    int frame = (textured * 2 + distorted) * NUM_CAST_MODES + mode;
+                    char frameName[64], path[GOLDEN_PATH_SIZE];
+
+                    snprintf(frameName, sizeof(frameName), "pose%d-%s-%s-cast%d", pose,
+                            textured ? "textured" : "flat", distorted ? "distorted" : "corrected", mode);
+                    setGoldenPose(pose);
+                    textureMode = textured;
+                    distortion = distorted;
+                    rayCastMode = mode;
+                    frames++;
+
+                    if(!record) {
+                        failed += checkFrame(directory, frameName, goldenHashes[pose][frame], expected, diff, failures);
+                        continue;
+                    }
+
+                    resetRenderModes();
+                    renderReference();
+                    hashes[frame] = hashFrame(screenBuffer);
+                    snprintf(path, sizeof(path), "%s/%s.ppm", directory, frameName);
+                    if(!writeImage(path, screenBuffer)) {
+                        fprintf(stderr, "Could not write the reference image %s\n", path);
+                        failed++;
+                    }
+                }
+            }
+        }
+
+        if(record)
+            printHashRow(hashes, pose == NUM_GOLDEN_POSES - 1);
+    }
+
+    if(record) {
+        printf("Recorded %d reference images in %s\n", frames - failed, directory);
+    } else {
+        for(r = 0; r < NUM_GOLDEN_RENDERERS; r++)
+            printf("golden/%-14s %3d of %d frames match\n", goldenRenderers[r].name, frames - failures[r], frames);
+    }
+
+    free(expected);
+    free(diff);
+
+    textureMode = savedTextureMode;
+    distortion = savedDistortion;
+    rayCastMode = savedRayCastMode;
+    interlacedMode = savedInterlacedMode;
+    adaptiveStep = savedAdaptiveStep;
+    palettizedMode = savedPalettizedMode;
+    tiledMode = savedTiledMode;
+    rayCostMode = savedRayCostMode;
+    hudMode = savedHudMode;
+    setGatherSampling(TRUE);
+    playerPos = savedPos;
+    playerDir = savedDir;
+    viewplaneDir = savedViewplaneDir;
+
+    return !failed;
+}
@@ -0,0 +1,34 @@
+#ifndef GOLDEN_H
+#define GOLDEN_H
+
+/* Default directory of the reference and failure images */
+#define GOLDEN_PATH  "golden"
+
+/* Functions */
+
+/**
+ * Render a fixed set of camera poses with every combination of
+ * textureMode, distortion and rayCastMode, with each of the game's render
+ * paths, and check the frames. Exact paths must reproduce the hashes
+ * recorded in src/golden.c from the renderer before it was optimized, and
+ * approximate ones must stay close to the reference path's frames. This
+ * assumes that the screen buffer, player and raycaster have already been
+ * initialized, with the generated wall textures.
+ *
+ * When recording, the reference renderer's frames are written to the
+ * directory as PPM images instead, and their hashes are printed in the
+ * form of the table in src/golden.c. When checking, every frame a render
+ * path gets wrong is reported, and written to the directory: the
+ * reference path's own frame, or a diff image against it for the other
+ * paths, with the differing pixels in red.
+ *
+ * directory: The existing directory images are written to.
+ * record:    Non-zero to record the reference images and print their
+ *            hashes, zero to check the render paths.
+ *
+ * Returns: Zero if a frame failed its check or an image could not be
+ *          written, non-zero otherwise.
+ */
+int runGoldenImages(const char* directory, char record);
+
+#endif /* GOLDEN_H */
@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "hud.h"
+#include "raycaster.h"
+#include "renderer.h"
+
+/* The font's glyphs are 3x5 pixels, drawn HUD_SCALE screen pixels per font pixel */
+#define GLYPH_WIDTH       3
+#define GLYPH_HEIGHT      5
+#define CHAR_ADVANCE      ((GLYPH_WIDTH + 1) * HUD_SCALE)
+#define LINE_HEIGHT       ((GLYPH_HEIGHT + 1) * HUD_SCALE)
+
+/* Panel layout */
+#define HUD_PADDING       4
+#define HUD_COLUMNS       24      /* Characters per line */
+#define HUD_LINES         6
+#define HUD_WIDTH         (2 * HUD_PADDING + HUD_COLUMNS * CHAR_ADVANCE)
+#define HUD_HEIGHT        (2 * HUD_PADDING + HUD_LINES * LINE_HEIGHT + HUD_SPARK_HEIGHT + HUD_PADDING)
+#define SPARK_BAR_STRIDE  ((HUD_COLUMNS * CHAR_ADVANCE) / HUD_HISTORY)
+
+/* Frame buffers whose last drawn panel is kept: the screen buffer, and the pipeline's second one */
+#define HUD_BUFFERS       2
+
+/* Frame time of the target frame rate, marked on the sparkline */
+#define HUD_TARGET_MS     16.7f
+
+#define HUD_TEXT_COLOR    RGBtoABGR(0xFF, 0xFF, 0xFF)
+#define HUD_GOOD_COLOR    RGBtoABGR(0x40, 0xE0, 0x40)
+#define HUD_SLOW_COLOR    RGBtoABGR(0xF0, 0xD0, 0x30)
+#define HUD_BAD_COLOR     RGBtoABGR(0xF0, 0x40, 0x30)
+#define HUD_TARGET_COLOR  RGBtoABGR(0x80, 0x80, 0x80)
+
+/* Glyph rows from top to bottom, each an octal digit whose bits are its pixels from left to right */
+#define GLYPH(A, B, C, D, E)  (((A) << 12) | ((B) << 9) | ((C) << 6) | ((D) << 3) | (E))
+
+static const unsigned short digitGlyphs[10] = {
+    GLYPH(7, 5, 5, 5, 7), GLYPH(2, 6, 2, 2, 7), GLYPH(7, 1, 7, 4, 7), GLYPH(7, 1, 7, 1, 7), GLYPH(5, 5, 7, 1, 1),
+    GLYPH(7, 4, 7, 1, 7), GLYPH(7, 4, 7, 5, 7), GLYPH(7, 1, 1, 1, 1), GLYPH(7, 5, 7, 5, 7), GLYPH(7, 5, 7, 1, 7)
+};
+
+static const unsigned short letterGlyphs[26] = {
+    GLYPH(2, 5, 7, 5, 5), GLYPH(6, 5, 6, 5, 6), GLYPH(3, 4, 4, 4, 3), GLYPH(6, 5, 5, 5, 6), GLYPH(7, 4, 6, 4, 7),
+    GLYPH(7, 4, 6, 4, 4), GLYPH(3, 4, 5, 5, 3), GLYPH(5, 5, 7, 5, 5), GLYPH(7, 2, 2, 2, 7), GLYPH(1, 1, 1, 5, 2),
+    GLYPH(5, 5, 6, 5, 5), GLYPH(4, 4, 4, 4, 7), GLYPH(5, 7, 7, 5, 5), GLYPH(6, 5, 5, 5, 5), GLYPH(2, 5, 5, 5, 2),
+    GLYPH(6, 5, 6, 4, 4), GLYPH(2, 5, 5, 6, 3), GLYPH(6, 5, 6, 5, 5), GLYPH(3, 4, 2, 1, 6), GLYPH(7, 2, 2, 2, 2),
+    GLYPH(5, 5, 5, 5, 7), GLYPH(5, 5, 5, 5, 2), GLYPH(5, 5, 7, 7, 5), GLYPH(5, 5, 2, 5, 5), GLYPH(5, 5, 2, 2, 2),
+    GLYPH(7, 1, 2, 4, 7)
+};
+
+/* Latest timings in microseconds and ray counts, set from whichever thread ran the stage */
+static SDL_atomic_t stageMicros[NUM_HUD_STAGES];
+static SDL_atomic_t lastRaysCast;
+static SDL_atomic_t lastRaySteps;
+
+/* Main thread state */
+static float frameHistory[HUD_HISTORY];
+static int historyNext = 0;
+static int historyCount = 0;
+static float smoothedStageMs[NUM_HUD_STAGES];
+static float smoothedRays = 0;
+static float smoothedSteps = 0;
+static float smoothedHudMicros = 0;
+
+/* The panel as last drawn into each buffer, so that only the rows that change are uploaded */
+static struct {
+    Uint32* buffer;
+    char shown;     /* The panel was drawn over the last frame uploaded from the buffer */
+    Uint32 pixels[HUD_HEIGHT][HUD_WIDTH];
+} drawnPanels[HUD_BUFFERS];
+static int nextPanelSlot = 0;
+
+
+void recordHudStage(HudStage stage, Uint64 startTime) {
+    Uint64 elapsed = SDL_GetPerformanceCounter() - startTime;
+
+    SDL_AtomicSet(&stageMicros[stage], (int)(elapsed * 1000000 / SDL_GetPerformanceFrequency()));
+}
+
+void recordHudRays() {
+    SDL_AtomicSet(&lastRaysCast, frameRayCost.raysCast);
+    SDL_AtomicSet(&lastRaySteps, frameRayCost.verticalSteps + frameRayCost.horizontalSteps);
+}
+
+void recordHudFrame(double frameMs) {
+    int i, rays = SDL_AtomicGet(&lastRaysCast);
+    float steps = rays ? SDL_AtomicGet(&lastRaySteps) / (float)rays : 0;
+
+    frameHistory[historyNext] = frameMs;
+    historyNext = (historyNext + 1) % HUD_HISTORY;
+    if(historyCount < HUD_HISTORY)
+        historyCount++;
+
+    for(i = 0; i < NUM_HUD_STAGES; i++)
+        smoothedStageMs[i] += HUD_SMOOTHING * (SDL_AtomicGet(&stageMicros[i]) / 1000.0f - smoothedStageMs[i]);
+    smoothedRays += HUD_SMOOTHING * (rays - smoothedRays);
+    smoothedSteps += HUD_SMOOTHING * (steps - smoothedSteps);
+}
+
+
+/*========================================================
+ * Drawing
+ *========================================================
+ */
+
+static unsigned short glyphForChar(char c) {
+    if(c >= '0' && c <= '9')
+        return digitGlyphs[c - '0'];
+    if(c >= 'A' && c <= 'Z')
+        return letterGlyphs[c - 'A'];
+    if(c >= 'a' && c <= 'z')
+        return letterGlyphs[c - 'a'];
+
+    switch(c) {
+        case '.': return GLYPH(0, 0, 0, 0, 2);
+        case ':': return GLYPH(0, 2, 0, 2, 0);
+        case '/': return GLYPH(1, 1, 2, 4, 4);
+        case '-': return GLYPH(0, 0, 7, 0, 0);
+        case '%': return GLYPH(5, 1, 2, 4, 5);
+        default:  return 0;
+    }
+}
+
+/* Draw a line of text with its top left corner at (x, y) */
+static void drawText(Uint32* buffer, int x, int y, const char* text) {
+    int row, col, i, j;
+
+    for(; *text; text++, x += CHAR_ADVANCE) {
+        unsigned short glyph = glyphForChar(*text);
+
+        for(row = 0; glyph && row < GLYPH_HEIGHT; row++) {
+            for(col = 0; col < GLYPH_WIDTH; col++) {
+                Uint32* dst;
+
+                if(!(glyph & (1 << ((GLYPH_HEIGHT - 1 - row) * GLYPH_WIDTH + (GLYPH_WIDTH - 1 - col)))))
+                    continue;
+
+                dst = buffer + XY_TO_SCREEN_INDEX(x + col * HUD_SCALE, y + row * HUD_SCALE);
+                for(i = 0; i < HUD_SCALE; i++)
+                    for(j = 0; j < HUD_SCALE; j++)
+                        dst[i * WINDOW_WIDTH + j] = HUD_TEXT_COLOR;
+            }
+        }
+    }
+}
+
+/* Darken the panel's background to a quarter of its brightness */
+static void darkenPanel(Uint32* buffer) {
+    int x, y;
+
+    for(y = HUD_Y; y < HUD_Y + HUD_HEIGHT; y++) {
+        Uint32* row = buffer + XY_TO_SCREEN_INDEX(HUD_X, y);
+
+        for(x = 0; x < HUD_WIDTH; x++)
+            row[x] = ((row[x] >> 2) & 0x3F3F3F3F) | 0xFF000000;
+    }
+}
+
+/* Draw the frame time history as bars with their bottom left corner at (x, bottom), oldest first */
+static void drawSparkline(Uint32* buffer, int x, int bottom) {
+    int i, y, targetHeight = (int)(HUD_SPARK_HEIGHT * HUD_TARGET_MS / HUD_SPARK_MAX_MS);
+
+    for(i = 0; i < HUD_COLUMNS * CHAR_ADVANCE; i += 2)
+        buffer[XY_TO_SCREEN_INDEX(x + i, bottom - targetHeight)] = HUD_TARGET_COLOR;
+
+    for(i = HUD_HISTORY - historyCount; i < HUD_HISTORY; i++) {
+        float ms = frameHistory[(historyNext + i) % HUD_HISTORY];
+        int height = MIN((int)(ms * HUD_SPARK_HEIGHT / HUD_SPARK_MAX_MS + 0.5f), HUD_SPARK_HEIGHT);
+        Uint32 color = (ms <= HUD_TARGET_MS) ? HUD_GOOD_COLOR : (ms <= 2 * HUD_TARGET_MS) ? HUD_SLOW_COLOR : HUD_BAD_COLOR;
+        Uint32* dst = buffer + XY_TO_SCREEN_INDEX(x + i * SPARK_BAR_STRIDE, bottom);
+
+        for(y = 0; y < height; y++, dst -= WINDOW_WIDTH) {
+            dst[0] = color;
+            dst[1] = color;
+        }
+    }
+}
+
+/* Returns the slot of a buffer's last drawn panel, taking over the oldest slot for a new buffer */
+static int findPanelSlot(Uint32* buffer) {
+    int slot;
+
+    for(slot = 0; slot < HUD_BUFFERS; slot++)
+        if(drawnPanels[slot].buffer == buffer)
+            return slot;
+
+    slot = nextPanelSlot;
+    nextPanelSlot = (nextPanelSlot + 1) % HUD_BUFFERS;
+    drawnPanels[slot].buffer = buffer;
+    drawnPanels[slot].shown = FALSE;
+    return slot;
+}
+
+/*
+ * Mark the runs of panel rows that changed since the panel was last drawn
+ * into the buffer, or the whole panel if it was not shown there, and keep
+ * the rows for the next comparison
+ */
+static void markChangedPanelRows(Uint32* buffer) {
+    int slot = findPanelSlot(buffer);
+    int y, start = -1;
+
+    for(y = 0; y <= HUD_HEIGHT; y++) {
+        const Uint32* row = buffer + XY_TO_SCREEN_INDEX(HUD_X, HUD_Y + y);
+        int changed = y < HUD_HEIGHT &&
+            (!drawnPanels[slot].shown || memcmp(drawnPanels[slot].pixels[y], row, sizeof(drawnPanels[slot].pixels[y])));
+
+        if(changed) {
+            memcpy(drawnPanels[slot].pixels[y], row, sizeof(drawnPanels[slot].pixels[y]));
+            if(start < 0)
+                start = y;
+        } else if(start >= 0) {
+            markTextureDirty(buffer, HUD_X, HUD_Y + start, HUD_WIDTH, y - start);
+            start = -1;
+        }
+    }
+
+    drawnPanels[slot].shown = TRUE;
+}
+
+void drawHud(Uint32* buffer) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    char line[HUD_COLUMNS + 1];
+    float meanFrameMs = 0;
+    int i, x = HUD_X + HUD_PADDING, y = HUD_Y + HUD_PADDING;
+
+    for(i = 0; i < historyCount; i++)
+        meanFrameMs += frameHistory[i];
+    if(historyCount)
+        meanFrameMs /= historyCount;
+
+    darkenPanel(buffer);
+
+    snprintf(line, sizeof(line), "FPS %5.1f %6.2f MS", meanFrameMs > 0 ? 1000.0f / meanFrameMs : 0.0f, meanFrameMs);
+    drawText(buffer, x, y, line);
+    y += LINE_HEIGHT;
+
+    drawSparkline(buffer, x, y + HUD_SPARK_HEIGHT - 1);
+    y += HUD_SPARK_HEIGHT + HUD_PADDING;
+
+    snprintf(line, sizeof(line), "SIM %6.2f CAST %6.2f", smoothedStageMs[HUD_SIMULATE], smoothedStageMs[HUD_CAST]);
+    drawText(buffer, x, y, line);
+    y += LINE_HEIGHT;
+
+    snprintf(line, sizeof(line), "DRAW%6.2f PRES %6.2f", smoothedStageMs[HUD_DRAW], smoothedStageMs[HUD_PRESENT]);
+    drawText(buffer, x, y, line);
+    y += LINE_HEIGHT;
+
+    snprintf(line, sizeof(line), "HUD %6.1f US", smoothedHudMicros);
+    drawText(buffer, x, y, line);
+    y += LINE_HEIGHT;
+
+    snprintf(line, sizeof(line), "RAYS %4.0f STEPS %5.2f", smoothedRays, smoothedSteps);
+    drawText(buffer, x, y, line);
+    y += LINE_HEIGHT;
+
+    snprintf(line, sizeof(line), "RES %dX%d", WINDOW_WIDTH, WINDOW_HEIGHT);
+    drawText(buffer, x, y, line);
+
+    markChangedPanelRows(buffer);
+
+    smoothedHudMicros += HUD_SMOOTHING *
+        ((SDL_GetPerformanceCounter() - start) * 1000000.0f / SDL_GetPerformanceFrequency() - smoothedHudMicros);
+}
+
+void eraseHud(Uint32* buffer) {
+    int slot = findPanelSlot(buffer);
+
+    if(drawnPanels[slot].shown)
+        markTextureDirty(buffer, HUD_X, HUD_Y, HUD_WIDTH, HUD_HEIGHT);
+    drawnPanels[slot].shown = FALSE;
+}
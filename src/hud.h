@@ -0,0 +1,71 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include "gfx.h"
+
+/* Placement and size of the HUD panel */
+#define HUD_X              8
+#define HUD_Y              8
+#define HUD_SCALE          2      /* Screen pixels per font pixel */
+#define HUD_HISTORY        64     /* Frames shown in the frame time sparkline */
+#define HUD_SPARK_HEIGHT   24
+#define HUD_SPARK_MAX_MS   33.3f  /* Frame time of a full height sparkline bar */
+
+/* Weight of the latest frame in the smoothed timings */
+#define HUD_SMOOTHING      0.1f
+
+/* Enums */
+typedef enum {
+    HUD_SIMULATE,   /* Input and player ticks */
+    HUD_CAST,       /* updateRaycaster */
+    HUD_DRAW,       /* Drawing the scene into the screen buffer */
+    HUD_PRESENT,    /* Uploading and presenting the frame */
+    NUM_HUD_STAGES
+} HudStage;
+
+/* Functions */
+
+/**
+ * Record how long a stage of the current frame took. Stages may be
+ * recorded from the cast thread while the main thread draws the HUD.
+ *
+ * stage:     The stage.
+ * startTime: The performance counter value when the stage started. It
+ *            ends now.
+ */
+void recordHudStage(HudStage stage, Uint64 startTime);
+
+/**
+ * Record the rays cast for the frame just drawn, from frameRayCost.
+ * Call this from the thread that cast them.
+ */
+void recordHudRays();
+
+/**
+ * Add a frame to the sparkline and fold the latest stage timings into
+ * the smoothed ones shown by the HUD. Call this once per frame.
+ *
+ * frameMs: The time since the previous frame started, in milliseconds.
+ */
+void recordHudFrame(double frameMs);
+
+/**
+ * Draw the HUD over the top left of a finished frame, and mark the rows
+ * of it that changed since it was last drawn into the same buffer to be
+ * uploaded. It shows the frame rate, a sparkline of recent frame times,
+ * per-stage timings, the average ray steps and the resolution.
+ *
+ * buffer: The WINDOW_WIDTH x WINDOW_HEIGHT frame to draw into.
+ */
+void drawHud(Uint32* buffer);
+
+/**
+ * Mark the HUD's area of a finished frame to be uploaded if the HUD was
+ * drawn over the last frame uploaded from the same buffer. Call this
+ * instead of drawHud while the HUD is hidden.
+ *
+ * buffer: The WINDOW_WIDTH x WINDOW_HEIGHT frame the HUD is not drawn into.
+ */
+void eraseHud(Uint32* buffer);
+
+#endif /* HUD_H */
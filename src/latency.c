@@ -0,0 +1,61 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "latency.h"
+
+
+Uint64 eventTimeToCounter(Uint32 timestamp) {
+    Uint64 now = SDL_GetPerformanceCounter();
+    Uint32 age = SDL_GetTicks() - timestamp;
+
+    /* Events without a timestamp, or from the future, are taken to have just happened */
+    if(!timestamp || age > 0x7FFFFFFF)
+        return now;
+
+    return now - (Uint64)age * SDL_GetPerformanceFrequency() / 1000;
+}
+
+void addLatencySample(LatencySamples* samples, Uint64 startTime, Uint64 endTime) {
+    samples->samples[samples->next] = (endTime - startTime) * 1000.0 / SDL_GetPerformanceFrequency();
+    samples->next = (samples->next + 1) % LATENCY_SAMPLES;
+    if(samples->count < LATENCY_SAMPLES)
+        samples->count++;
+    samples->total++;
+}
+
+static int compareFloats(const void* a, const void* b) {
+    float x = *(const float*)a, y = *(const float*)b;
+
+    return (x > y) - (x < y);
+}
+
+/* The smallest sample that at least percent of the samples are less than or equal to */
+static float nearestRank(const float* sorted, int count, int percent) {
+    int rank = (percent * count + 99) / 100;
+
+    return sorted[MAX(rank, 1) - 1];
+}
+
+void getLatencyPercentiles(const LatencySamples* samples, LatencyPercentiles* result) {
+    float sorted[LATENCY_SAMPLES];
+
+    memset(result, 0, sizeof(*result));
+    result->count = samples->count;
+    if(!samples->count)
+        return;
+
+    memcpy(sorted, samples->samples, samples->count * sizeof(float));
+    qsort(sorted, samples->count, sizeof(float), compareFloats);
+
+    result->p50 = nearestRank(sorted, samples->count, 50);
+    result->p95 = nearestRank(sorted, samples->count, 95);
+    result->p99 = nearestRank(sorted, samples->count, 99);
+    result->max = sorted[samples->count - 1];
+}
+
+void resetLatencySamples(LatencySamples* samples) {
+    samples->next = 0;
+    samples->count = 0;
+    samples->total = 0;
+}
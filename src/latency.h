@@ -0,0 +1,63 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "gfx.h"
+
+/* Number of most recent latency samples kept for the percentiles */
+#define LATENCY_SAMPLES  1024
+
+/* Datatypes */
+typedef struct {
+    float samples[LATENCY_SAMPLES];    /* In milliseconds, a ring of the latest samples */
+    int next;
+    int count;
+    long total;                        /* Samples added since the last reset, including overwritten ones */
+} LatencySamples;
+
+typedef struct {
+    int count;
+    float p50;
+    float p95;
+    float p99;
+    float max;
+} LatencyPercentiles;
+
+/* Functions */
+
+/**
+ * Convert the timestamp of an SDL event to a performance counter value.
+ * Event timestamps have millisecond resolution, so the result is too.
+ *
+ * timestamp: The event's timestamp, in SDL_GetTicks milliseconds.
+ *
+ * Returns: The performance counter value at which the event was queued,
+ *          or the current value if the event has no usable timestamp.
+ */
+Uint64 eventTimeToCounter(Uint32 timestamp);
+
+/**
+ * Add a latency sample, replacing the oldest if the ring is full.
+ *
+ * samples:   The samples to add to.
+ * startTime: The performance counter value at which the latency started.
+ * endTime:   The performance counter value at which it ended.
+ */
+void addLatencySample(LatencySamples* samples, Uint64 startTime, Uint64 endTime);
+
+/**
+ * Compute nearest rank percentiles of the samples in the ring.
+ *
+ * samples: The samples.
+ * result:  Set to the percentiles. Its count is zero if there are no
+ *          samples.
+ */
+void getLatencyPercentiles(const LatencySamples* samples, LatencyPercentiles* result);
+
+/**
+ * Remove all samples.
+ *
+ * samples: The samples to clear.
+ */
+void resetLatencySamples(LatencySamples* samples);
+
+#endif /* LATENCY_H */
@@ -1,13 +1,28 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "config.h"
 #include "raycaster.h"
 #include "renderer.h"
 #include "player.h"
+#include "entity.h"
+#include "flowfield.h"
 #include "map.h"
+#include "bench.h"
+#include "golden.h"
+#include "pipeline.h"
+#include "capture.h"
+#include "frameexport.h"
+#include "palette.h"
+#include "texturepack.h"
+#include "hud.h"
+#include "trace.h"
+#include "latency.h"
+#include "tilemap.h"
+#include "pvs.h"
 
-const short MAP[MAP_GRID_HEIGHT][MAP_GRID_WIDTH] = {
+short MAP[MAP_GRID_HEIGHT][MAP_GRID_WIDTH] = {
     {R,R,R,R,R,R,R,R,R,R},
     {R,B,0,0,0,0,P,0,B,R},
     {R,0,0,0,0,0,0,0,0,R},
@@ -35,7 +50,11 @@ const Uint32 COLORS[4] = {
     RGBtoABGR(128, 128, 128)
 };
 
-Uint32* TEXTURES[4];
+WallTexture TEXTURES[4];
+
+/* Wall textures can be mapped from a texture pack instead of being generated */
+const char* texturePackPath = NULL;
+TexturePack texturePack;
 
 /* Program toggles */
 char gameIsRunning    = TRUE;
@@ -43,7 +62,21 @@ char showMap          = TRUE;
 char distortion       = FALSE;
 char slowRenderMode   = FALSE;
 char rayCastMode      = 0;
+char rayCostMode      = 0;
 char textureMode      = 0;
+char pipelinedMode    = FALSE;
+char interlacedMode   = FALSE;
+char adaptiveStep     = 1;
+char palettizedMode   = FALSE;
+char tiledMode        = FALSE;
+char hudMode          = FALSE;
+
+/*
+ * The oldest key events not yet reflected in a frame, as performance
+ * counter values. Movement only shows once a player tick has run.
+ */
+Uint64 pendingTickEventTime  = 0;
+Uint64 pendingFrameEventTime = 0;
 
 void render() {
     if(showMap) {
@@ -54,6 +87,59 @@ void render() {
     }
 }
 
+/* Keep the older of a pending event time and a new one */
+void keepOldestEventTime(Uint64* pending, Uint64 time) {
+    if(!*pending || time < *pending)
+        *pending = time;
+}
+
+void noteInputEvent(const SDL_KeyboardEvent* key) {
+    Uint64 time = eventTimeToCounter(key->timestamp);
+
+    switch(key->keysym.sym) {
+        case SDLK_UP:
+        case SDLK_DOWN:
+        case SDLK_LEFT:
+        case SDLK_RIGHT:
+        case SDLK_LSHIFT:
+        case SDLK_RSHIFT:
+            keepOldestEventTime(&pendingTickEventTime, time);
+            break;
+        default:
+            /* Toggles act on key down */
+            if(key->type == SDL_KEYDOWN)
+                keepOldestEventTime(&pendingFrameEventTime, time);
+            break;
+    }
+}
+
+/*
+ * Knock down the wall a tile ahead of the player, or build one there.
+ * The walls around the map stay, and walls are not built on top of the
+ * player or entities.
+ */
+void toggleWallAhead() {
+    int tileX = (int)((playerPos.x + WALL_SIZE * playerDir.x) / WALL_SIZE);
+    int tileY = (int)((playerPos.y + WALL_SIZE * playerDir.y) / WALL_SIZE);
+    float left = tileX * WALL_SIZE, top = tileY * WALL_SIZE;
+
+    if(tileX <= 0 || tileY <= 0 || tileX >= MAP_GRID_WIDTH - 1 || tileY >= MAP_GRID_HEIGHT - 1)
+        return;
+
+    if(getMapTile(&gameMap, tileX, tileY) > 0) {
+        setMapTile(&gameMap, tileX, tileY, 0);
+        return;
+    }
+
+    if(playerPos.x + PLAYER_SIZE > left && playerPos.x - PLAYER_SIZE < left + WALL_SIZE &&
+            playerPos.y + PLAYER_SIZE > top && playerPos.y - PLAYER_SIZE < top + WALL_SIZE)
+        return;
+    if(tileHasEntities(&gameEntities, tileX, tileY))
+        return;
+
+    setMapTile(&gameMap, tileX, tileY, W);
+}
+
 void consumeSDLEvents() {
     SDL_Event event;
     char keyIsDown;
@@ -63,6 +149,9 @@ void consumeSDLEvents() {
         switch(event.type) {
             case SDL_KEYUP:
             case SDL_KEYDOWN:
+                if(!event.key.repeat)
+                    noteInputEvent(&event.key);
+
                 switch(event.key.keysym.sym) {
                     case SDLK_UP:
                         movingForward = keyIsDown;
@@ -95,9 +184,55 @@ void consumeSDLEvents() {
                     case SDLK_r:
                         if(keyIsDown) slowRenderMode = !slowRenderMode;
                         break;
+                    case SDLK_p:
+                        if(keyIsDown) pipelinedMode = !pipelinedMode;
+                        break;
+                    case SDLK_i:
+                        if(keyIsDown) interlacedMode = !interlacedMode;
+                        break;
+                    case SDLK_a:
+                        if(keyIsDown) adaptiveStep = (adaptiveStep >= ADAPTIVE_MAX_STEP) ? 1 : adaptiveStep * 2;
+                        break;
+                    case SDLK_v:
+                        if(keyIsDown) {
+                            if(isCapturing()) stopCapture();
+                            else startCapture(CAPTURE_PATH);
+                        }
+                        break;
+                    case SDLK_x:
+                        if(keyIsDown) {
+                            if(isExportingFrames()) stopFrameExport();
+                            else startFrameExport();
+                        }
+                        break;
+                    case SDLK_8:
+                        /* The palette is only built the first time it is needed */
+                        if(keyIsDown) {
+                            if(palettizedMode || initPalette()) palettizedMode = !palettizedMode;
+                            else fprintf(stderr, "Could not build the palette\n");
+                        }
+                        break;
+                    case SDLK_b:
+                        if(keyIsDown) tiledMode = !tiledMode;
+                        break;
+                    case SDLK_h:
+                        if(keyIsDown) hudMode = !hudMode;
+                        break;
                     case SDLK_c:
                         if(keyIsDown) rayCastMode = (rayCastMode + 1) % 3;
                         break;
+                    case SDLK_k:
+                        if(keyIsDown) rayCostMode = (rayCostMode + 1) % 3;
+                        break;
+                    case SDLK_z:
+                        if(keyIsDown) {
+                            if(isTracing()) stopTrace();
+                            else startTrace(TRACE_PATH);
+                        }
+                        break;
+                    case SDLK_e:
+                        if(keyIsDown) toggleWallAhead();
+                        break;
                     case SDLK_LEFTBRACKET:
                         if(keyIsDown && distFromViewplane - 20.0f > 100.0f) distFromViewplane -= 20.0f;
                         break;
@@ -117,32 +252,225 @@ void consumeSDLEvents() {
     }
 }
 
+void printEventLatency(const LatencySamples* samples) {
+    LatencyPercentiles latency;
+
+    getLatencyPercentiles(samples, &latency);
+    if(latency.count)
+        fprintf(stderr, "Input event to present: p50 %.1f ms, p95 %.1f ms, p99 %.1f ms, max %.1f ms (%d events)\n",
+                latency.p50, latency.p95, latency.p99, latency.max, latency.count);
+}
+
 void runGame() {
     long gameTicks = 0;
     long time;
+    Uint64 inputTime, presentedInputTime, presentTime, castStart;
+    Uint64 frameEventTime, presentedEventTime, pipelinedEventTime = 0;
+    Uint64 lastTickTime = SDL_GetPerformanceCounter();
+    Vector3f presentedPos, presentedDir, pipelinedPos, pipelinedDir;
+    PlayerPose previousPose, currentPose, renderPose;
+    double tickSeconds = 1.0 / SIMULATION_TICK_RATE;
+    double accumulator = 0;
+    double latencyMs = 0;
+    int latencyFrames = 0;
+    Uint64 uploadedBytes = getUploadedTextureBytes();
+    RayCostStats rayCost;
+    LatencySamples eventLatency;
+    char pipelined;
+
+    getPlayerPose(&currentPose);
+    previousPose = currentPose;
+    memset(&rayCost, 0, sizeof(rayCost));
+    resetLatencySamples(&eventLatency);
 
     do {
+        TRACE_BEGIN(frame);
         time = SDL_GetTicks();
+        inputTime = SDL_GetPerformanceCounter();
 
         /* Handle SDL key events */
+        TRACE_BEGIN(consumeSDLEvents);
         consumeSDLEvents();
+        TRACE_END(consumeSDLEvents);
+
+        /* Run the player at a fixed tick rate, dropping time the simulation can't catch up on */
+        recordHudFrame((inputTime - lastTickTime) * 1000.0 / SDL_GetPerformanceFrequency());
+        accumulator += (inputTime - lastTickTime) / (double)SDL_GetPerformanceFrequency();
+        lastTickTime = inputTime;
+        if(accumulator > MAX_TICKS_PER_FRAME * tickSeconds)
+            accumulator = MAX_TICKS_PER_FRAME * tickSeconds;
+
+        while(accumulator >= tickSeconds) {
+            TRACE_BEGIN(updatePlayer);
+            previousPose = currentPose;
+            updatePlayer();
+            getPlayerPose(&currentPose);
+            accumulator -= tickSeconds;
+            TRACE_END(updatePlayer);
 
-        /* Update the player */
-        updatePlayer();
+            /* The game's map is small enough to rebuild its set as soon as a wall is knocked down */
+            if(gamePvs.stale) {
+                destroyPvs(&gamePvs);
+                buildPvs(&gamePvs, &MAP[0][0], MAP_GRID_WIDTH, MAP_GRID_HEIGHT, PVS_GAME_CLUSTER_SIZE);
+            }
+            setPvsViewpoint(&gamePvs, playerPos.x, playerPos.y);
 
-        /* Update the raycaster */
-        updateRaycaster();
+            TRACE_BEGIN(updateFlowField);
+            updateFlowField(&playerFlow, (int)(playerPos.x / WALL_SIZE), (int)(playerPos.y / WALL_SIZE));
+            TRACE_END(updateFlowField);
 
-        /* Render a frame */
-        render();
+            TRACE_BEGIN(updateEntities);
+            updateEntities(&gameEntities);
+            TRACE_END(updateEntities);
+
+            if(pendingTickEventTime) {
+                keepOldestEventTime(&pendingFrameEventTime, pendingTickEventTime);
+                pendingTickEventTime = 0;
+            }
+        }
+        recordHudStage(HUD_SIMULATE, inputTime);
+
+        /* This frame is the first to reflect the pending events */
+        frameEventTime = pendingFrameEventTime;
+        pendingFrameEventTime = 0;
+
+        /* Render from between the last two ticks */
+        interpolatePlayerPose(&previousPose, &currentPose, accumulator / tickSeconds, &renderPose);
+        setPlayerPose(&renderPose);
+
+        /* Only the projected scene can be pipelined */
+        pipelined = pipelinedMode && !showMap && !slowRenderMode;
+        if(pipelined && !initPipeline())
+            pipelined = pipelinedMode = FALSE;
+
+        if(pipelined) {
+            /* Cast and draw this frame while presenting the previous one */
+            TRACE_BEGIN(renderPipelinedFrame);
+            presentedInputTime = renderPipelinedFrame(inputTime, &presentTime);
+            TRACE_END(renderPipelinedFrame);
+
+            /* The presented frame was cast from the previous iteration's pose */
+            presentedPos = pipelinedPos;
+            presentedDir = pipelinedDir;
+            presentedEventTime = pipelinedEventTime;
+            pipelinedPos = playerPos;
+            pipelinedDir = playerDir;
+            pipelinedEventTime = frameEventTime;
+        } else {
+            discardPipelinedFrame();
+
+            /* Update the raycaster */
+            TRACE_BEGIN(updateRaycaster);
+            castStart = SDL_GetPerformanceCounter();
+            updateRaycaster();
+            recordHudStage(HUD_CAST, castStart);
+            TRACE_END(updateRaycaster);
+
+            /* Render a frame */
+            TRACE_BEGIN(render);
+            render();
+            TRACE_END(render);
+            presentedInputTime = inputTime;
+            presentTime = SDL_GetPerformanceCounter();
+            presentedPos = playerPos;
+            presentedDir = playerDir;
+            presentedEventTime = frameEventTime;
+            pipelinedEventTime = 0;
+        }
+
+        /* Hand the presented frame to the capture writer and the frame ring */
+        if(presentedInputTime && !showMap) {
+            TRACE_BEGIN(handOffFrame);
+            if(isCapturing()) captureFrame(screenBuffer);
+            if(isExportingFrames()) exportFrame(screenBuffer, &presentedPos, &presentedDir);
+            TRACE_END(handOffFrame);
+        }
+
+        /* The cast thread is idle once the frame is done, so its ray costs can be read */
+        accumulateRayCost(&rayCost, &frameRayCost);
+
+        /* Continue the simulation from the last tick */
+        setPlayerPose(&currentPose);
+
+        /* Track the time from sampling input to presenting the frame built from it */
+        if(presentedInputTime) {
+            latencyMs += (presentTime - presentedInputTime) * 1000.0 / SDL_GetPerformanceFrequency();
+            latencyFrames++;
+
+            /* And from the key events it first reflects */
+            if(presentedEventTime)
+                addLatencySample(&eventLatency, presentedEventTime, presentTime);
+        }
 
         /* Fixed delay before next frame */
+        TRACE_BEGIN(frameDelay);
         SDL_Delay(10);
+        TRACE_END(frameDelay);
 
-        /* Print FPS every 500 frames */
-        if(!(gameTicks++ % 500))
-            fprintf(stderr, "FPS: %.2f\n", 1000.0f / (float)(SDL_GetTicks() - time));
+        /* Print FPS, average input-to-present latency and uploaded pixel data every 500 frames */
+        if(!(gameTicks++ % 500)) {
+            fprintf(stderr, "FPS: %.2f  Input-to-present: %.2f ms  Uploaded: %.1f KB/frame%s\n",
+                    1000.0f / (float)(SDL_GetTicks() - time), latencyFrames ? latencyMs / latencyFrames : 0.0,
+                    (getUploadedTextureBytes() - uploadedBytes) / 1024.0 / (gameTicks > 1 ? 500 : 1),
+                    pipelinedMode ? " (pipelined)" : "");
+            uploadedBytes = getUploadedTextureBytes();
+            latencyMs = 0;
+            latencyFrames = 0;
+
+            if(rayCost.raysCast) {
+                fprintf(stderr, "Rays: %.2f steps/ray (%.2f vertical, %.2f horizontal), at most %d in column %d",
+                        (rayCost.verticalSteps + rayCost.horizontalSteps) / (float)rayCost.raysCast,
+                        rayCost.verticalSteps / (float)rayCost.raysCast, rayCost.horizontalSteps / (float)rayCost.raysCast,
+                        rayCost.maxSteps, rayCost.maxStepsColumn);
+                if(rayCostMode == RAY_COST_TIME)
+                    fprintf(stderr, ", %.0f ns/ray", rayCost.nanoseconds / (float)rayCost.raysCast);
+                fprintf(stderr, "\n");
+            }
+            memset(&rayCost, 0, sizeof(rayCost));
+
+            printEventLatency(&eventLatency);
+            resetLatencySamples(&eventLatency);
+        }
+        TRACE_END(frame);
     } while(gameIsRunning);
+
+    printEventLatency(&eventLatency);
+
+    destroyPipeline();
+    stopCapture();
+    stopFrameExport();
+    stopTrace();
+}
+
+/*
+ * Use the first four textures of a texture pack as the wall textures.
+ * They are used straight from the pack's mapping, and may each have
+ * their own size.
+ */
+int loadPackedTextures(const char* path) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    int i;
+
+    if(!openTexturePack(path, &texturePack)) {
+        fprintf(stderr, "Could not open texture pack %s\n", path);
+        return FALSE;
+    }
+
+    for(i = 0; i < 4; i++) {
+        if((unsigned int)i >= texturePack.header->textureCount ||
+                texturePack.entries[i].width > MAX_TEXTURE_SIZE || texturePack.entries[i].height > MAX_TEXTURE_SIZE) {
+            fprintf(stderr, "Texture pack %s needs four wall textures of at most %dx%d\n", path, MAX_TEXTURE_SIZE, MAX_TEXTURE_SIZE);
+            closeTexturePack(&texturePack);
+            return FALSE;
+        }
+
+        initWallTexture(&TEXTURES[i], (Uint32*)getPackTexture(&texturePack, i, 0),
+                        texturePack.entries[i].width, texturePack.entries[i].height);
+    }
+
+    fprintf(stderr, "Mapped %u textures from %s in %.3f ms\n", texturePack.header->textureCount, path,
+            (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+    return TRUE;
 }
 
 int setupWindow() {
@@ -151,14 +479,16 @@ int setupWindow() {
     if(!initGFX("Raycaster", WINDOW_WIDTH, WINDOW_HEIGHT)) return FALSE;
 
     screenBuffer = createTexture(WINDOW_WIDTH, WINDOW_HEIGHT);
-    redXorTexture = generateRedXorTexture(TEXTURE_SIZE);
-    greenXorTexture = generateGreenXorTexture(TEXTURE_SIZE);
-    blueXorTexture = generateBlueXorTexture(TEXTURE_SIZE);
-    grayXorTexture = generateGrayXorTexture(TEXTURE_SIZE);
-    TEXTURES[0] = redXorTexture;
-    TEXTURES[1] = greenXorTexture;
-    TEXTURES[2] = blueXorTexture;
-    TEXTURES[3] = grayXorTexture;
+    if(!texturePackPath || !loadPackedTextures(texturePackPath)) {
+        redXorTexture = generateRedXorTexture(TEXTURE_SIZE);
+        greenXorTexture = generateGreenXorTexture(TEXTURE_SIZE);
+        blueXorTexture = generateBlueXorTexture(TEXTURE_SIZE);
+        grayXorTexture = generateGrayXorTexture(TEXTURE_SIZE);
+        initWallTexture(&TEXTURES[0], redXorTexture, TEXTURE_SIZE, TEXTURE_SIZE);
+        initWallTexture(&TEXTURES[1], greenXorTexture, TEXTURE_SIZE, TEXTURE_SIZE);
+        initWallTexture(&TEXTURES[2], blueXorTexture, TEXTURE_SIZE, TEXTURE_SIZE);
+        initWallTexture(&TEXTURES[3], grayXorTexture, TEXTURE_SIZE, TEXTURE_SIZE);
+    }
 
     if(!screenBuffer) return FALSE;
 
@@ -170,15 +500,94 @@ int setupWindow() {
     return TRUE;
 }
 
-int main() {
+void printTextureMemoryStats() {
+    TextureMemoryStats stats;
+
+    getTextureMemoryStats(&stats);
+    fprintf(stderr, "Texture memory: %d textures, %.1f KB live, %.1f KB peak, %.1f KB reserved, %ld allocations\n",
+            stats.textureCount, stats.bytesLive / 1024.0, stats.bytesPeak / 1024.0, stats.bytesReserved / 1024.0,
+            stats.totalAllocations);
+}
+
+int main(int argc, char** argv) {
+    int i, status = EXIT_SUCCESS;
+
+    TRACE_THREAD_NAME("main");
+
+    /* Options that affect how the window and textures are set up */
+    for(i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--huge-pages"))
+            useHugePagesForTextures(TRUE);
+        else if(!strcmp(argv[i], "--textures") && i + 1 < argc)
+            texturePackPath = argv[++i];
+    }
+
+    /* The golden image check only draws into the screen buffer, so it runs without a display */
+    if(argc > 1 && !strcmp(argv[1], "--golden"))
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", FALSE);
+
     if(!setupWindow()) {
         fprintf(stderr, "Could not initialize raycaster!\n");
         return EXIT_FAILURE;
     }
     initPlayer();
     initRaycaster();
-    runGame();
+    if(!initEntityWorld(&gameEntities, &MAP[0][0], MAP_GRID_WIDTH, MAP_GRID_HEIGHT, GAME_ENTITIES)) {
+        fprintf(stderr, "Could not allocate the entities!\n");
+        return EXIT_FAILURE;
+    }
+    spawnEntities(&gameEntities, GAME_ENTITIES, ENTITY_SEED);
+
+    /* Entities chase the player */
+    initFlowThreads();
+    if(!initFlowField(&playerFlow, &MAP[0][0], MAP_GRID_WIDTH, MAP_GRID_HEIGHT)) {
+        fprintf(stderr, "Could not allocate the flow field!\n");
+        return EXIT_FAILURE;
+    }
+    gameEntities.flow = &playerFlow;
+
+    /* Walls can be built and knocked down while playing */
+    initTileMap(&gameMap, &MAP[0][0], MAP_GRID_WIDTH, MAP_GRID_HEIGHT);
+    addMapListener(&gameMap, flowFieldMapListener, &playerFlow);
+    addMapListener(&gameMap, raycasterMapListener, NULL);
+
+    /* What can be seen from where, for culling */
+    if(!buildPvs(&gamePvs, &MAP[0][0], MAP_GRID_WIDTH, MAP_GRID_HEIGHT, PVS_GAME_CLUSTER_SIZE)) {
+        fprintf(stderr, "Could not allocate the potentially visible set!\n");
+        return EXIT_FAILURE;
+    }
+    addMapListener(&gameMap, pvsMapListener, &gamePvs);
+
+    if(argc > 1 && !strcmp(argv[1], "--bench")) {
+        if(!runBenchmarks((argc > 2) ? argv[2] : BENCH_RESULTS_PATH, (argc > 3) ? argv[3] : BENCH_BASELINE_PATH))
+            status = EXIT_FAILURE;
+    } else if(argc > 1 && !strcmp(argv[1], "--golden")) {
+        if(argc < 3 || (strcmp(argv[2], "record") && strcmp(argv[2], "check"))) {
+            fprintf(stderr, "Usage: raycaster --golden record|check [directory]\n");
+            status = EXIT_FAILURE;
+        } else if(!runGoldenImages((argc > 3) ? argv[3] : GOLDEN_PATH, !strcmp(argv[2], "record"))) {
+            status = EXIT_FAILURE;
+        }
+    } else {
+        for(i = 1; i < argc; i++) {
+            if(!strcmp(argv[i], "--capture"))
+                startCapture((i + 1 < argc && argv[i + 1][0] != '-') ? argv[++i] : CAPTURE_PATH);
+            else if(!strcmp(argv[i], "--export"))
+                startFrameExport();
+            else if(!strcmp(argv[i], "--trace"))
+                startTrace((i + 1 < argc && argv[i + 1][0] != '-') ? argv[++i] : TRACE_PATH);
+        }
+        runGame();
+    }
 
+    printTextureMemoryStats();
+    destroyEntityWorld(&gameEntities);
+    destroyPvs(&gamePvs);
+    destroyFlowField(&playerFlow);
+    destroyFlowThreads();
+    destroyPalette();
     destroyGFX();
-    return EXIT_SUCCESS;
+    closeTexturePack(&texturePack);
+    destroyTrace();
+    return status;
 }
@@ -1,9 +1,12 @@
 #include <stdio.h>
 
 #include "config.h"
+#include "entity.h"
 #include "map.h"
 #include "player.h"
+#include "pvs.h"
 #include "raycaster.h"
+#include "renderer.h"
 
 void renderOverheadMap() {
     int i, row, col;
@@ -29,14 +32,30 @@ void renderOverheadMap() {
                     setDrawColor(128, 128, 128, 255);
                     break;
                 default:
-                    setDrawColor(255, 255, 255, 255);
+                    /* Open tiles the player can't see from their cluster are shaded */
+                    if(isTilePotentiallyVisible(&gamePvs, col, row))
+                        setDrawColor(255, 255, 255, 255);
+                    else
+                        setDrawColor(200, 200, 200, 255);
                     break;
             }
             fillRect((int)(mapGridSquareSize * col) + mapXOffset, (int)(mapGridSquareSize * row) + mapYOffset, mapGridSquareSize, mapGridSquareSize);
         }
     }
 
-    /* Draw rays */
+    /* Draw entities */
+    for(i = 0; i < gameEntities.count; i++) {
+        if(isTilePotentiallyVisible(&gamePvs, (int)(gameEntities.x[i] / WALL_SIZE), (int)(gameEntities.y[i] / WALL_SIZE)))
+            setDrawColor(255, 160, 0, 255);
+        else
+            setDrawColor(128, 80, 0, 255);
+        fillRect((int)((gameEntities.x[i] - ENTITY_SIZE) * HUD_MAP_SIZE / (float)MAP_PIXEL_WIDTH) + mapXOffset,
+                (int)((gameEntities.y[i] - ENTITY_SIZE) * HUD_MAP_SIZE / (float)MAP_PIXEL_HEIGHT) + mapYOffset,
+                2 * ENTITY_SIZE * HUD_MAP_SIZE / MAP_PIXEL_WIDTH, 2 * ENTITY_SIZE * HUD_MAP_SIZE / MAP_PIXEL_HEIGHT);
+    }
+
+    /* Draw rays, including those interlaced and adaptive casting skipped */
+    castSkippedColumns();
     setDrawColor(200, 100, 50, 255);
     for(i = 0; i < WINDOW_WIDTH; i++) {
         Vector3f ray;
@@ -44,6 +63,10 @@ void renderOverheadMap() {
             ray = rays[i].hRay;
         else
             ray = rays[i].vRay;
+        if (rayCostMode) {
+            Uint32 color = getColumnCostColor(i);
+            setDrawColor(color & 0xFF, (color >> 8) & 0xFF, (color >> 16) & 0xFF, 255);
+        }
         drawLine((int)(playerPos.x * HUD_MAP_SIZE / (float)MAP_PIXEL_WIDTH) + mapXOffset, (int)(playerPos.y * HUD_MAP_SIZE / (float)MAP_PIXEL_HEIGHT + mapYOffset),
                 (int)((playerPos.x + ray.x) * HUD_MAP_SIZE / (float)MAP_PIXEL_WIDTH) + mapXOffset, (int)((playerPos.y + ray.y) * HUD_MAP_SIZE / (float)MAP_PIXEL_WIDTH) + mapYOffset);
         if (slowRenderMode) {
@@ -0,0 +1,206 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "palette.h"
+#include "renderer.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_AVX2_EXPANSION
+#endif
+
+/* Globals */
+Uint32 paletteColors[PALETTE_SIZE];
+Uint8 shadeRemap[PALETTE_SIZE];
+Uint8 colorIndices[4];
+Uint8 ceilingIndex = 0;
+Uint8 floorIndex = 0;
+Uint8* indexedScreenBuffer = NULL;
+
+/* Palette colors are found through an open addressed hash table of their indices, twice the palette's size */
+#define PALETTE_HASH_SIZE   (2 * PALETTE_SIZE)
+#define PALETTE_HASH(C)     (((C) * 0x9E3779B1u) >> 23)
+
+/* Colors not in the palette map to the nearest entry to the center of their 15-bit RGB cell */
+#define NEAREST_CELL(C)     ((((C) >> 3) & 0x1F) | (((C) >> 6) & 0x3E0) | (((C) >> 9) & 0x7C00))
+#define NEAREST_CELLS       (1 << 15)
+
+static int paletteCount = 0;
+static Sint16 paletteSlots[PALETTE_HASH_SIZE];
+static Sint16 nearestCells[NEAREST_CELLS];      /* The nearest entry of each cell, or -1 until it is needed */
+static Uint8 paletteCells[NEAREST_CELLS];       /* Non-zero for cells with palette colors in them */
+static void (*expandPixels)(const Uint8* src, Uint32* dst, int count) = expandIndexedPixelsScalar;
+
+
+/* Returns the index of a color in the palette, or -1 if it is not in the palette */
+static int findPaletteColor(Uint32 color) {
+    Uint32 slot = PALETTE_HASH(color);
+
+    while(paletteSlots[slot] >= 0) {
+        if(paletteColors[paletteSlots[slot]] == color)
+            return paletteSlots[slot];
+        slot = (slot + 1) % PALETTE_HASH_SIZE;
+    }
+
+    return -1;
+}
+
+/* Add a color to the palette if it is not in it yet and there is room left */
+static void addPaletteColor(Uint32 color) {
+    Uint32 slot = PALETTE_HASH(color);
+
+    if(paletteCount == PALETTE_SIZE)
+        return;
+
+    while(paletteSlots[slot] >= 0) {
+        if(paletteColors[paletteSlots[slot]] == color)
+            return;
+        slot = (slot + 1) % PALETTE_HASH_SIZE;
+    }
+
+    paletteSlots[slot] = paletteCount;
+    paletteColors[paletteCount++] = color;
+    paletteCells[NEAREST_CELL(color)] = TRUE;
+}
+
+static int colorDistance(Uint32 a, Uint32 b) {
+    int dr = (int)(a & 0xFF) - (int)(b & 0xFF);
+    int dg = (int)((a >> 8) & 0xFF) - (int)((b >> 8) & 0xFF);
+    int db = (int)((a >> 16) & 0xFF) - (int)((b >> 16) & 0xFF);
+
+    return dr * dr + dg * dg + db * db;
+}
+
+Uint8 nearestPaletteIndex(Uint32 color) {
+    int i, best = 0, bestDistance = colorDistance(color, paletteColors[0]);
+
+    for(i = 1; i < paletteCount && bestDistance; i++) {
+        int distance = colorDistance(color, paletteColors[i]);
+        if(distance < bestDistance) {
+            best = i;
+            bestDistance = distance;
+        }
+    }
+
+    return best;
+}
+
+/* Returns a texel's palette index: its own entry if it has one, the nearest to its cell's center otherwise */
+static Uint8 texelPaletteIndex(Uint32 color) {
+    int cell = NEAREST_CELL(color);
+    int index = paletteCells[cell] ? findPaletteColor(color) : -1;
+
+    if(index >= 0)
+        return index;
+
+    if(nearestCells[cell] < 0) {
+        Uint32 center = ((cell & 0x1F) << 3) | ((cell & 0x3E0) << 6) | ((cell & 0x7C00) << 9) | 0x040404;
+        nearestCells[cell] = nearestPaletteIndex(center);
+    }
+
+    return nearestCells[cell];
+}
+
+#ifdef HAVE_AVX2_EXPANSION
+/* Expand eight pixels per iteration by gathering their colors from the palette */
+__attribute__((target("avx2")))
+static void expandIndexedPixelsAVX2(const Uint8* src, Uint32* dst, int count) {
+    int i = 0;
+
+    for(; i + 8 <= count; i += 8) {
+        __m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_i32gather_epi32((const int*)paletteColors, indices, 4));
+    }
+
+    for(; i < count; i++)
+        dst[i] = paletteColors[src[i]];
+}
+#endif
+
+void expandIndexedPixelsScalar(const Uint8* src, Uint32* dst, int count) {
+    int i;
+
+    for(i = 0; i < count; i++)
+        dst[i] = paletteColors[src[i]];
+}
+
+void expandIndexedPixels(const Uint8* src, Uint32* dst, int count) {
+    expandPixels(src, dst, count);
+}
+
+int initPalette() {
+    int i, t, baseColors;
+
+    /* The screen buffer is allocated last, so the palette is complete once it exists */
+    if(indexedScreenBuffer)
+        return TRUE;
+
+    destroyPalette();
+    memset(paletteColors, 0, sizeof(paletteColors));
+    memset(paletteSlots, 0xFF, sizeof(paletteSlots));
+    memset(nearestCells, 0xFF, sizeof(nearestCells));
+    memset(paletteCells, 0, sizeof(paletteCells));
+    paletteCount = 0;
+
+    /* The flat colors come first so that they are always exact */
+    addPaletteColor(CEILING_COLOR);
+    addPaletteColor(FLOOR_COLOR);
+    for(i = 0; i < 4; i++)
+        addPaletteColor(COLORS[i]);
+
+    for(t = 0; t < 4 && paletteCount < PALETTE_SIZE; t++)
+        for(i = 0; i < TEXTURES[t].width * TEXTURES[t].height && paletteCount < PALETTE_SIZE; i++)
+            addPaletteColor(TEXTURES[t].pixels[i]);
+
+    /* Spend any room left on the darkened colors, flat colors first */
+    baseColors = paletteCount;
+    for(i = 0; i < baseColors; i++)
+        addPaletteColor(DARKEN_COLOR(paletteColors[i]));
+
+    for(i = 0; i < PALETTE_SIZE; i++)
+        shadeRemap[i] = (i < paletteCount) ? nearestPaletteIndex(DARKEN_COLOR(paletteColors[i])) : i;
+
+    ceilingIndex = nearestPaletteIndex(CEILING_COLOR);
+    floorIndex = nearestPaletteIndex(FLOOR_COLOR);
+    for(i = 0; i < 4; i++)
+        colorIndices[i] = nearestPaletteIndex(COLORS[i]);
+
+    for(t = 0; t < 4; t++) {
+        WallTexture* texture = &TEXTURES[t];
+
+        texture->indexedPixels = malloc((size_t)texture->width * texture->height);
+        if(!texture->indexedPixels) {
+            destroyPalette();
+            return FALSE;
+        }
+
+        for(i = 0; i < texture->width * texture->height; i++)
+            texture->indexedPixels[i] = texelPaletteIndex(texture->pixels[i]);
+    }
+
+    indexedScreenBuffer = malloc(WINDOW_WIDTH * WINDOW_HEIGHT);
+    if(!indexedScreenBuffer) {
+        destroyPalette();
+        return FALSE;
+    }
+
+#ifdef HAVE_AVX2_EXPANSION
+    if(SDL_HasAVX2())
+        expandPixels = expandIndexedPixelsAVX2;
+#endif
+
+    return TRUE;
+}
+
+void destroyPalette() {
+    int t;
+
+    for(t = 0; t < 4; t++) {
+        free(TEXTURES[t].indexedPixels);
+        TEXTURES[t].indexedPixels = NULL;
+    }
+
+    free(indexedScreenBuffer);
+    indexedScreenBuffer = NULL;
+}
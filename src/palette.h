@@ -0,0 +1,72 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include "gfx.h"
+
+#define PALETTE_SIZE  256
+
+/* Global data */
+
+/* The ABGR color of every palette index */
+extern Uint32 paletteColors[PALETTE_SIZE];
+
+/* The palette index of the darkened version of every palette index */
+extern Uint8 shadeRemap[PALETTE_SIZE];
+
+/* Palette index versions of COLORS and the ceiling and floor colors. TEXTURES keep their own indexed pixels. */
+extern Uint8 colorIndices[4];
+extern Uint8 ceilingIndex;
+extern Uint8 floorIndex;
+
+/* The 8-bit frame drawn in palettized mode, expanded into screenBuffer at present */
+extern Uint8* indexedScreenBuffer;
+
+/* Functions */
+
+/**
+ * Build the palette from the ceiling and floor colors, COLORS and
+ * TEXTURES, and create indexed versions of them, unless it has already
+ * been built. Colors that do not fit in the palette, including most
+ * darkened ones, map to their nearest palette entry; texels do so by
+ * their 15-bit RGB color. This assumes that the textures have been
+ * created, and is only needed before palettized rendering.
+ *
+ * Returns: Non-zero if the palette is built, zero otherwise.
+ */
+int initPalette();
+
+/**
+ * Free the indexed textures and screen buffer.
+ */
+void destroyPalette();
+
+/**
+ * Find the palette entry nearest to a color.
+ *
+ * color: The ABGR color to look up.
+ *
+ * Returns: The index of the nearest palette entry.
+ */
+Uint8 nearestPaletteIndex(Uint32 color);
+
+/**
+ * Expand palette indices to ABGR colors, using AVX2 gathers if the CPU
+ * supports them.
+ *
+ * src:   The palette indices.
+ * dst:   Set to the ABGR colors of the indices.
+ * count: The number of pixels to expand.
+ */
+void expandIndexedPixels(const Uint8* src, Uint32* dst, int count);
+
+/**
+ * Expand palette indices to ABGR colors one pixel at a time.
+ * This is the fallback that expandIndexedPixels must match.
+ *
+ * src:   The palette indices.
+ * dst:   Set to the ABGR colors of the indices.
+ * count: The number of pixels to expand.
+ */
+void expandIndexedPixelsScalar(const Uint8* src, Uint32* dst, int count);
+
+#endif /* PALETTE_H */
@@ -0,0 +1,151 @@
+#include <stdio.h>
+
+#include "config.h"
+#include "pipeline.h"
+#include "raycaster.h"
+#include "renderer.h"
+#include "hud.h"
+#include "trace.h"
+
+/*
+ * The pipeline alternates two screen buffers. While the main thread
+ * uploads and presents the front buffer, the cast thread casts rays and
+ * draws the next frame into the back buffer (which is always the one
+ * screenBuffer points to). Once both are done the buffers are swapped.
+ *
+ * Buffer ownership follows from the frame sequence numbers alone, so
+ * the handoff needs no locks: the semaphores only park idle threads.
+ */
+static SDL_Thread* castThread = NULL;
+static SDL_sem* castWake = NULL;
+static SDL_sem* castDone = NULL;
+static SDL_atomic_t requestedFrame;
+static SDL_atomic_t completedFrame;
+static SDL_atomic_t castThreadQuit;
+
+static Uint32* screenBuffers[2] = {NULL, NULL};
+static Uint32* frontBuffer = NULL;
+static Uint64 frontInputTime = 0;
+
+
+static int runCastThread(void* data) {
+    Uint64 castStart, drawStart;
+
+    (void)data;
+    TRACE_THREAD_NAME("cast");
+
+    for(;;) {
+        SDL_SemWait(castWake);
+        if(SDL_AtomicGet(&castThreadQuit))
+            break;
+
+        TRACE_BEGIN(updateRaycaster);
+        castStart = SDL_GetPerformanceCounter();
+        updateRaycaster();
+        recordHudStage(HUD_CAST, castStart);
+        TRACE_END(updateRaycaster);
+
+        TRACE_BEGIN(drawProjectedScene);
+        drawStart = SDL_GetPerformanceCounter();
+        drawProjectedScene();
+        recordHudStage(HUD_DRAW, drawStart);
+        TRACE_END(drawProjectedScene);
+        recordHudRays();
+
+        SDL_AtomicSet(&completedFrame, SDL_AtomicGet(&requestedFrame));
+        SDL_SemPost(castDone);
+    }
+
+    return 0;
+}
+
+int initPipeline() {
+    if(castThread)
+        return TRUE;
+
+    screenBuffers[0] = screenBuffer;
+    screenBuffers[1] = createTexture(WINDOW_WIDTH, WINDOW_HEIGHT);
+    castWake = SDL_CreateSemaphore(0);
+    castDone = SDL_CreateSemaphore(0);
+    SDL_AtomicSet(&requestedFrame, 0);
+    SDL_AtomicSet(&completedFrame, 0);
+    SDL_AtomicSet(&castThreadQuit, FALSE);
+
+    if(screenBuffers[1] && castWake && castDone)
+        castThread = SDL_CreateThread(runCastThread, "cast", NULL);
+
+    if(!castThread) {
+        fprintf(stderr, "Could not start the cast thread: %s\n", SDL_GetError());
+        destroyPipeline();
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+Uint64 renderPipelinedFrame(Uint64 inputTime, Uint64* presentTime) {
+    int frame = SDL_AtomicGet(&requestedFrame) + 1;
+    Uint64 presentedInputTime = 0;
+
+    /* Hand the back buffer to the cast thread */
+    SDL_AtomicSet(&requestedFrame, frame);
+    SDL_SemPost(castWake);
+
+    /* Present the previous frame meanwhile */
+    if(frontBuffer) {
+        Uint64 presentStart;
+
+        if(hudMode) {
+            TRACE_BEGIN(drawHud);
+            drawHud(frontBuffer);
+            TRACE_END(drawHud);
+        } else {
+            eraseHud(frontBuffer);
+        }
+
+        presentStart = SDL_GetPerformanceCounter();
+        clearRenderer();
+        displayFullscreenTexture(frontBuffer);
+        recordHudStage(HUD_PRESENT, presentStart);
+        presentedInputTime = frontInputTime;
+    }
+    *presentTime = SDL_GetPerformanceCounter();
+
+    TRACE_BEGIN(waitForCastThread);
+    while(SDL_AtomicGet(&completedFrame) != frame)
+        SDL_SemWait(castDone);
+    TRACE_END(waitForCastThread);
+
+    /* Swap buffers */
+    frontBuffer = screenBuffer;
+    frontInputTime = inputTime;
+    screenBuffer = (screenBuffer == screenBuffers[0]) ? screenBuffers[1] : screenBuffers[0];
+
+    return presentedInputTime;
+}
+
+void discardPipelinedFrame() {
+    frontBuffer = NULL;
+}
+
+void destroyPipeline() {
+    if(castThread) {
+        SDL_AtomicSet(&castThreadQuit, TRUE);
+        SDL_SemPost(castWake);
+        SDL_WaitThread(castThread, NULL);
+        castThread = NULL;
+    }
+
+    if(castWake) SDL_DestroySemaphore(castWake);
+    if(castDone) SDL_DestroySemaphore(castDone);
+    castWake = NULL;
+    castDone = NULL;
+
+    /* Hand the original buffer back to the sequential loop */
+    if(screenBuffers[1]) {
+        screenBuffer = screenBuffers[0];
+        destroyTexture(screenBuffers[1]);
+    }
+    screenBuffers[0] = screenBuffers[1] = NULL;
+    frontBuffer = NULL;
+}
@@ -0,0 +1,46 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "gfx.h"
+
+/* Functions */
+
+/**
+ * Initialize the pipelined frame loop: allocate a second screen buffer
+ * and start the cast thread. Does nothing if it is already initialized.
+ *
+ * Returns: Non-zero if the pipeline is ready, zero otherwise.
+ */
+int initPipeline();
+
+/**
+ * Produce a frame in pipelined mode. The cast thread casts and draws
+ * the next frame from the current player state, while the calling thread
+ * uploads and presents the previous one. Returns once both are done.
+ *
+ * The player state and render toggles must not be changed while this
+ * is running, and the scene must be the projected view.
+ *
+ * inputTime:   The performance counter value at which input for the next
+ *              frame was sampled.
+ * presentTime: Set to the performance counter value at which the previous
+ *              frame finished presenting.
+ *
+ * Returns: The input time of the frame that was presented, or zero if no
+ *          frame was presented.
+ */
+Uint64 renderPipelinedFrame(Uint64 inputTime, Uint64* presentTime);
+
+/**
+ * Drop the frame waiting to be presented by the pipeline. This must be
+ * called whenever a frame is rendered outside of the pipeline, so that
+ * the pipeline does not present an older frame after it.
+ */
+void discardPipelinedFrame();
+
+/**
+ * Stop the cast thread and free the second screen buffer.
+ */
+void destroyPipeline();
+
+#endif /* PIPELINE_H */
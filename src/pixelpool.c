@@ -0,0 +1,210 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "pixelpool.h"
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#define POOL_SIZE_CLASSES  32
+#define HUGE_PAGE_SIZE     (2 << 20)
+
+#define ALIGN_UP(N, A)     (((N) + (A) - 1) & ~(size_t)((A) - 1))
+
+/*
+ * Blocks below POOL_LARGE_THRESHOLD are carved from shared arenas, and
+ * larger ones (framebuffers) get a mapping of their own. Freed blocks of
+ * either kind are kept on a free list per size and handed out again to
+ * the next allocation of the same size. Free blocks are linked through
+ * their own first bytes, so no block carries a header.
+ */
+typedef struct FreeBlock_ FreeBlock_;
+struct FreeBlock_ {
+    FreeBlock_* next;
+};
+
+typedef struct {
+    size_t size;
+    FreeBlock_* head;
+} SizeClass_;
+
+/* Memory obtained from the system, released by destroyPool */
+typedef struct Mapping_ Mapping_;
+struct Mapping_ {
+    void* ptr;
+    size_t size;
+    Mapping_* next;
+};
+
+static SizeClass_ sizeClasses[POOL_SIZE_CLASSES];
+static int sizeClassCount = 0;
+static Mapping_* mappings = NULL;
+static char* arenaNext = NULL;
+static size_t arenaLeft = 0;
+static int useHugePages = 0;
+static PoolStats stats;
+
+
+static void unmapMemory(void* ptr, size_t size) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    munmap(ptr, size);
+#endif
+}
+
+/* Get memory from the system, on a huge page boundary if huge pages are requested */
+static void* mapMemory(size_t size) {
+    Mapping_* mapping = malloc(sizeof(Mapping_));
+    void* ptr;
+
+    if(!mapping)
+        return NULL;
+
+#ifdef _WIN32
+    ptr = _aligned_malloc(size, POOL_ALIGNMENT);
+#else
+    if(useHugePages) {
+        /* Over-map, then trim the ends so the block starts on a huge page */
+        char* raw;
+        size_t lead;
+
+        size = ALIGN_UP(size, HUGE_PAGE_SIZE);
+        raw = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(raw == MAP_FAILED) {
+            free(mapping);
+            return NULL;
+        }
+
+        lead = ALIGN_UP((uintptr_t)raw, HUGE_PAGE_SIZE) - (uintptr_t)raw;
+        if(lead)
+            munmap(raw, lead);
+        if(HUGE_PAGE_SIZE - lead)
+            munmap(raw + lead + size, HUGE_PAGE_SIZE - lead);
+        ptr = raw + lead;
+#ifdef MADV_HUGEPAGE
+        madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+    } else {
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(ptr == MAP_FAILED)
+            ptr = NULL;
+    }
+#endif
+
+    if(!ptr) {
+        free(mapping);
+        return NULL;
+    }
+
+    mapping->ptr = ptr;
+    mapping->size = size;
+    mapping->next = mappings;
+    mappings = mapping;
+    stats.bytesReserved += size;
+
+    return ptr;
+}
+
+/* Returns the size class for a block size, creating it if there is room. NULL if there is none. */
+static SizeClass_* findSizeClass(size_t size) {
+    int i;
+
+    for(i = 0; i < sizeClassCount; i++)
+        if(sizeClasses[i].size == size)
+            return &sizeClasses[i];
+
+    if(sizeClassCount == POOL_SIZE_CLASSES)
+        return NULL;
+
+    sizeClasses[sizeClassCount].size = size;
+    sizeClasses[sizeClassCount].head = NULL;
+    return &sizeClasses[sizeClassCount++];
+}
+
+void* poolAlloc(size_t size) {
+    SizeClass_* sizeClass;
+    void* ptr = NULL;
+
+    if(!size)
+        return NULL;
+    size = ALIGN_UP(size, POOL_ALIGNMENT);
+
+    /* Recycle a freed block of the same size */
+    sizeClass = findSizeClass(size);
+    if(sizeClass && sizeClass->head) {
+        ptr = sizeClass->head;
+        sizeClass->head = sizeClass->head->next;
+    } else if(size >= POOL_LARGE_THRESHOLD) {
+        ptr = mapMemory(size);
+    } else {
+        if(arenaLeft < size) {
+            arenaNext = mapMemory(POOL_ARENA_SIZE);
+            arenaLeft = arenaNext ? POOL_ARENA_SIZE : 0;
+        }
+
+        if(arenaLeft >= size) {
+            ptr = arenaNext;
+            arenaNext += size;
+            arenaLeft -= size;
+        }
+    }
+
+    if(!ptr)
+        return NULL;
+
+    stats.bytesLive += size;
+    if(stats.bytesLive > stats.bytesPeak)
+        stats.bytesPeak = stats.bytesLive;
+    stats.blocksLive++;
+    stats.totalAllocations++;
+
+    return ptr;
+}
+
+void poolFree(void* ptr, size_t size) {
+    SizeClass_* sizeClass;
+
+    if(!ptr)
+        return;
+    size = ALIGN_UP(size, POOL_ALIGNMENT);
+
+    stats.bytesLive -= size;
+    stats.blocksLive--;
+
+    /* Without a free size class the block stays unused until destroyPool */
+    sizeClass = findSizeClass(size);
+    if(sizeClass) {
+        FreeBlock_* block = ptr;
+        block->next = sizeClass->head;
+        sizeClass->head = block;
+    }
+}
+
+void poolUseHugePages(int enabled) {
+    useHugePages = enabled;
+}
+
+void getPoolStats(PoolStats* poolStats) {
+    *poolStats = stats;
+}
+
+void destroyPool() {
+    while(mappings) {
+        Mapping_* next = mappings->next;
+
+        unmapMemory(mappings->ptr, mappings->size);
+        free(mappings);
+        mappings = next;
+    }
+
+    sizeClassCount = 0;
+    arenaNext = NULL;
+    arenaLeft = 0;
+    stats.bytesLive = 0;
+    stats.bytesReserved = 0;
+    stats.blocksLive = 0;
+}
@@ -0,0 +1,66 @@
+#ifndef PIXELPOOL_H
+#define PIXELPOOL_H
+
+#include <stddef.h>
+
+/* Alignment of every block handed out by the pool */
+#define POOL_ALIGNMENT        64
+
+/* Blocks of at least this many bytes get their own mapping instead of sharing an arena */
+#define POOL_LARGE_THRESHOLD  (1 << 20)
+
+/* Size of the arenas that smaller blocks are carved from */
+#define POOL_ARENA_SIZE       (4 << 20)
+
+/* Datatypes */
+typedef struct {
+    size_t bytesLive;         /* Bytes in blocks currently allocated */
+    size_t bytesPeak;         /* Highest value bytesLive has reached */
+    size_t bytesReserved;     /* Bytes obtained from the system, including free blocks */
+    long blocksLive;          /* Blocks currently allocated */
+    long totalAllocations;    /* Blocks allocated since startup */
+} PoolStats;
+
+/* Functions */
+
+/**
+ * Allocate a block of memory from the pool. Blocks are aligned to
+ * POOL_ALIGNMENT bytes and carry no header, so the caller must pass the
+ * same size back to poolFree.
+ *
+ * size: The size of the block in bytes.
+ *
+ * Returns: The block, or NULL if it could not be allocated.
+ */
+void* poolAlloc(size_t size);
+
+/**
+ * Return a block to the pool. Blocks of the same size are recycled.
+ *
+ * ptr:  The block, as returned by poolAlloc.
+ * size: The size the block was allocated with.
+ */
+void poolFree(void* ptr, size_t size);
+
+/**
+ * Set whether large blocks and arenas are backed by huge pages where the
+ * system supports it. Their mappings are then rounded up to whole huge
+ * pages. This only affects blocks allocated afterwards.
+ *
+ * enabled: Non-zero to request huge pages, zero otherwise.
+ */
+void poolUseHugePages(int enabled);
+
+/**
+ * Get the pool's allocation statistics.
+ *
+ * stats: Set to the current statistics.
+ */
+void getPoolStats(PoolStats* stats);
+
+/**
+ * Release all memory held by the pool. Every block must have been freed.
+ */
+void destroyPool();
+
+#endif /* PIXELPOOL_H */
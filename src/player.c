@@ -3,6 +3,7 @@
 #include "config.h"
 #include "player.h"
 #include "raycaster.h"
+#include "vector2f.h"
 
 
 /* Global data */
@@ -44,6 +45,36 @@ void updatePlayer() {
 
 }
 
+void getPlayerPose(PlayerPose* pose) {
+    pose->pos = playerPos;
+    pose->dir = playerDir;
+    pose->viewplaneDir = viewplaneDir;
+}
+
+void setPlayerPose(const PlayerPose* pose) {
+    playerPos = pose->pos;
+    playerDir = pose->dir;
+    viewplaneDir = pose->viewplaneDir;
+}
+
+/* Interpolate the direction of two vectors, keeping the length of the later one */
+static Vector3f interpolateDirection(const Vector3f* from, const Vector3f* to, float alpha) {
+    Vector2f a = vector3fTo2f(from);
+    Vector2f b = vector3fTo2f(to);
+    Vector2f dir = normalizeVector2f(vector2fAdd(a, vector2fScale(vector2fSubtract(b, a), alpha)));
+
+    return vector2fTo3f(vector2fScale(dir, vector2fMagnitude(b)));
+}
+
+void interpolatePlayerPose(const PlayerPose* from, const PlayerPose* to, float alpha, PlayerPose* out) {
+    Vector2f a = vector3fTo2f(&from->pos);
+    Vector2f b = vector3fTo2f(&to->pos);
+
+    out->pos = vector2fTo3f(vector2fAdd(a, vector2fScale(vector2fSubtract(b, a), alpha)));
+    out->dir = interpolateDirection(&from->dir, &to->dir, alpha);
+    out->viewplaneDir = interpolateDirection(&from->viewplaneDir, &to->viewplaneDir, alpha);
+}
+
 void movePlayer(float dx, float dy) {
 
     /* Don't clip if the player doesn't intersect anything */
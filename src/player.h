@@ -3,6 +3,13 @@
 
 #include "linalg.h"
 
+/* Datatypes */
+typedef struct {
+    Vector3f pos;
+    Vector3f dir;
+    Vector3f viewplaneDir;
+} PlayerPose;
+
 /* Global data */
 extern Vector3f playerPos;
 extern Vector3f playerDir;
@@ -22,10 +29,35 @@ extern char playerIsRunning;
 void initPlayer();
 
 /**
- * Update the player for the current frame.
+ * Advance the player by one simulation tick.
  */
 void updatePlayer();
 
+/**
+ * Get the current camera pose of the player.
+ *
+ * pose: Set to the player's position, direction and viewplane direction.
+ */
+void getPlayerPose(PlayerPose* pose);
+
+/**
+ * Move the player's camera to a pose.
+ *
+ * pose: The pose to use.
+ */
+void setPlayerPose(const PlayerPose* pose);
+
+/**
+ * Interpolate between two poses of the player, e.g. the poses of the
+ * last two simulation ticks.
+ *
+ * from:  The earlier pose.
+ * to:    The later pose.
+ * alpha: How far to interpolate from 'from' (0) towards 'to' (1).
+ * out:   Set to the interpolated pose.
+ */
+void interpolatePlayerPose(const PlayerPose* from, const PlayerPose* to, float alpha, PlayerPose* out);
+
 /**
  * Move the player by a given movement vector.
  *
@@ -0,0 +1,277 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "pvs.h"
+#include "raycaster.h"
+#include "trace.h"
+
+/* Fractional parts of multiples of these are spread evenly over [0, 1) in two dimensions */
+#define PVS_SAMPLE_X  0.7548776662f
+#define PVS_SAMPLE_Y  0.5698402910f
+
+/* Ray origins keep this far from the edges of their tiles, as the player and entities do */
+#define PVS_SAMPLE_MARGIN  0.1f
+
+/* Global data */
+PotentiallyVisibleSet gamePvs;
+
+
+/*========================================================
+ * Building
+ *========================================================
+ */
+
+/* Scratch space for building a set */
+typedef struct {
+    unsigned char* row;     /* The row being built, decompressed */
+    int* visible;           /* The clusters set in the row, in the order they were found */
+    int visibleCount;
+    int* traced;            /* The tiles the last ray passed through */
+    int maxTraced;
+    long capacity;          /* Bytes allocated for the compressed rows */
+} PvsBuilder;
+
+/* Make room for another size bytes of compressed rows. Returns zero if they could not grow. */
+static int reserveRows(PotentiallyVisibleSet* pvs, PvsBuilder* builder, long size) {
+    unsigned char* grown;
+    long capacity = builder->capacity;
+
+    while(capacity < pvs->size + size)
+        capacity *= 2;
+    if(capacity == builder->capacity)
+        return TRUE;
+
+    grown = realloc(pvs->rows, capacity);
+    if(!grown)
+        return FALSE;
+
+    pvs->rows = grown;
+    builder->capacity = capacity;
+    return TRUE;
+}
+
+static int compareClusters(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+/*
+ * Trace the rays of a cluster. Tile k of the cluster's n open tiles casts
+ * rays i = j * n + k at angles (i + 0.5) / rays of the full circle, so
+ * that the cluster's rays are spread evenly however many open tiles it
+ * has, each from a different point of its tile.
+ */
+static void traceCluster(PotentiallyVisibleSet* pvs, PvsBuilder* builder, const short* tiles, int cluster) {
+    int left = (cluster % pvs->clustersWide) * pvs->clusterSize;
+    int top = (cluster / pvs->clustersWide) * pvs->clusterSize;
+    int right = MIN(left + pvs->clusterSize, pvs->gridWidth);
+    int bottom = MIN(top + pvs->clusterSize, pvs->gridHeight);
+    int x, y, i, j, k = 0, open = 0, raysPerTile, rays;
+
+    for(y = top; y < bottom; y++)
+        for(x = left; x < right; x++)
+            open += tiles[y * pvs->gridWidth + x] <= 0;
+    if(!open)
+        return;
+
+    raysPerTile = (PVS_RAYS_PER_CLUSTER + open - 1) / open;
+    rays = raysPerTile * open;
+
+    for(y = top; y < bottom; y++) {
+        for(x = left; x < right; x++) {
+            if(tiles[y * pvs->gridWidth + x] > 0)
+                continue;
+
+            for(j = 0; j < raysPerTile; j++) {
+                int ray = j * open + k, traced;
+                float angle = 2.0f * PI * (ray + 0.5f) / rays;
+                float sampleX = ray * PVS_SAMPLE_X, sampleY = ray * PVS_SAMPLE_Y;
+                Vector2f origin, dir = vector2f(cos(angle), sin(angle));
+
+                sampleX = PVS_SAMPLE_MARGIN + (1.0f - 2.0f * PVS_SAMPLE_MARGIN) * (sampleX - (int)sampleX);
+                sampleY = PVS_SAMPLE_MARGIN + (1.0f - 2.0f * PVS_SAMPLE_MARGIN) * (sampleY - (int)sampleY);
+                origin = vector2f((x + sampleX) * WALL_SIZE, (y + sampleY) * WALL_SIZE);
+
+                traced = traceRayTiles(tiles, pvs->gridWidth, pvs->gridHeight, origin, dir, builder->traced, builder->maxTraced);
+                for(i = 0; i < traced; i++) {
+                    int tile = builder->traced[i];
+                    int seen = (tile / pvs->gridWidth / pvs->clusterSize) * pvs->clustersWide +
+                        (tile % pvs->gridWidth) / pvs->clusterSize;
+
+                    if(builder->row[seen >> 3] & (1 << (seen & 7)))
+                        continue;
+                    builder->row[seen >> 3] |= 1 << (seen & 7);
+                    builder->visible[builder->visibleCount++] = seen;
+                }
+            }
+            k++;
+        }
+    }
+}
+
+/*
+ * Append the row being built to the compressed rows, and clear it. Only
+ * the bytes the visible clusters are in are visited, so each row costs
+ * time in proportion to what it sees rather than to the size of the map.
+ */
+static int compressRow(PotentiallyVisibleSet* pvs, PvsBuilder* builder) {
+    int i, position = 0;
+
+    /* A visible cluster takes at most one byte and a zero run before it, and the zero runs up to 255 bytes each */
+    if(!reserveRows(pvs, builder, 3L * builder->visibleCount + 2L * (pvs->rowBytes / 255 + 1)))
+        return FALSE;
+
+    qsort(builder->visible, builder->visibleCount, sizeof(int), compareClusters);
+    for(i = 0; i < builder->visibleCount; i++) {
+        int byte = builder->visible[i] >> 3;
+
+        if(byte < position)
+            continue;
+
+        while(position < byte) {
+            int run = MIN(byte - position, 255);
+
+            pvs->rows[pvs->size++] = 0;
+            pvs->rows[pvs->size++] = run;
+            position += run;
+        }
+        pvs->rows[pvs->size++] = builder->row[byte];
+        builder->row[byte] = 0;
+        position++;
+    }
+
+    builder->visibleCount = 0;
+    return TRUE;
+}
+
+int buildPvs(PotentiallyVisibleSet* pvs, const short* tiles, int gridWidth, int gridHeight, int clusterSize) {
+    PvsBuilder builder;
+    int c, clusters, success;
+
+    TRACE_BEGIN(buildPvs);
+
+    memset(pvs, 0, sizeof(*pvs));
+    pvs->gridWidth = gridWidth;
+    pvs->gridHeight = gridHeight;
+    pvs->clusterSize = clusterSize;
+    pvs->clustersWide = (gridWidth + clusterSize - 1) / clusterSize;
+    pvs->clustersHigh = (gridHeight + clusterSize - 1) / clusterSize;
+    pvs->rowBytes = (pvs->clustersWide * pvs->clustersHigh + 7) / 8;
+    pvs->viewCluster = -1;
+    clusters = pvs->clustersWide * pvs->clustersHigh;
+
+    /* Start with room for rows of a few bytes each */
+    builder.capacity = 16L * clusters;
+    builder.visibleCount = 0;
+    builder.maxTraced = gridWidth + gridHeight + 3;
+    builder.row = calloc(pvs->rowBytes, 1);
+    builder.visible = malloc(clusters * sizeof(int));
+    builder.traced = malloc(builder.maxTraced * sizeof(int));
+    pvs->rows = malloc(builder.capacity);
+    pvs->rowStarts = malloc((clusters + 1) * sizeof(long));
+    pvs->viewRow = malloc(pvs->rowBytes);
+
+    success = builder.row && builder.visible && builder.traced && pvs->rows && pvs->rowStarts && pvs->viewRow;
+    for(c = 0; success && c < clusters; c++) {
+        pvs->rowStarts[c] = pvs->size;
+        traceCluster(pvs, &builder, tiles, c);
+        success = compressRow(pvs, &builder);
+    }
+
+    free(builder.row);
+    free(builder.visible);
+    free(builder.traced);
+    TRACE_END(buildPvs);
+
+    if(!success) {
+        destroyPvs(pvs);
+        return FALSE;
+    }
+
+    pvs->rowStarts[clusters] = pvs->size;
+    return TRUE;
+}
+
+void destroyPvs(PotentiallyVisibleSet* pvs) {
+    free(pvs->rows);
+    free(pvs->rowStarts);
+    free(pvs->viewRow);
+    memset(pvs, 0, sizeof(*pvs));
+    pvs->viewCluster = -1;
+    pvs->stale = TRUE;
+}
+
+
+/*========================================================
+ * Queries
+ *========================================================
+ */
+
+void setPvsViewpoint(PotentiallyVisibleSet* pvs, float x, float y) {
+    int tileX = (int)(x / WALL_SIZE), tileY = (int)(y / WALL_SIZE);
+    int cluster, position = 0;
+    long i;
+
+    if(!pvs->viewRow)
+        return;
+
+    if(x < 0 || y < 0 || tileX >= pvs->gridWidth || tileY >= pvs->gridHeight) {
+        pvs->viewCluster = -1;
+        return;
+    }
+
+    cluster = (tileY / pvs->clusterSize) * pvs->clustersWide + tileX / pvs->clusterSize;
+    if(cluster == pvs->viewCluster)
+        return;
+
+    memset(pvs->viewRow, 0, pvs->rowBytes);
+    for(i = pvs->rowStarts[cluster]; i < pvs->rowStarts[cluster + 1]; i++) {
+        if(pvs->rows[i])
+            pvs->viewRow[position++] = pvs->rows[i];
+        else
+            position += pvs->rows[++i];
+    }
+    pvs->viewCluster = cluster;
+}
+
+int isTilePotentiallyVisible(const PotentiallyVisibleSet* pvs, int tileX, int tileY) {
+    int cluster;
+
+    if(pvs->stale || pvs->viewCluster < 0)
+        return TRUE;
+    if(tileX < 0 || tileY < 0 || tileX >= pvs->gridWidth || tileY >= pvs->gridHeight)
+        return FALSE;
+
+    cluster = (tileY / pvs->clusterSize) * pvs->clustersWide + tileX / pvs->clusterSize;
+    return (pvs->viewRow[cluster >> 3] >> (cluster & 7)) & 1;
+}
+
+int isRegionPotentiallyVisible(const PotentiallyVisibleSet* pvs, int left, int top, int right, int bottom) {
+    int row, col;
+
+    if(pvs->stale || pvs->viewCluster < 0)
+        return TRUE;
+    if(right < 0 || bottom < 0 || left >= pvs->gridWidth || top >= pvs->gridHeight)
+        return FALSE;
+
+    left = MAX(left, 0) / pvs->clusterSize;
+    top = MAX(top, 0) / pvs->clusterSize;
+    right = MIN(right, pvs->gridWidth - 1) / pvs->clusterSize;
+    bottom = MIN(bottom, pvs->gridHeight - 1) / pvs->clusterSize;
+
+    for(row = top; row <= bottom; row++) {
+        for(col = left; col <= right; col++) {
+            int cluster = row * pvs->clustersWide + col;
+
+            if((pvs->viewRow[cluster >> 3] >> (cluster & 7)) & 1)
+                return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+void pvsMapListener(void* pvs, const TileMap* map, int tileX, int tileY, short oldTile) {
+    if(oldTile > 0 && getMapTile(map, tileX, tileY) <= 0)
+        ((PotentiallyVisibleSet*)pvs)->stale = TRUE;
+}
@@ -0,0 +1,118 @@
+#ifndef PVS_H
+#define PVS_H
+
+#include "config.h"
+#include "tilemap.h"
+
+/*
+ * A potentially visible set (PVS) records, for every cluster of tiles,
+ * which clusters can be seen from anywhere inside it, so that work on
+ * the parts of a map the player can't see can be skipped. Clusters are
+ * squares of clusterSize tiles; larger clusters make smaller sets that
+ * are less precise.
+ *
+ * The sets are sampled: PVS_RAYS_PER_CLUSTER rays are traced from points
+ * spread over the open tiles of each cluster, in directions spread over
+ * the full circle, with the raycaster's own traversal. Every tile a ray
+ * passes through, and the wall it stops at, is visible.
+ *
+ * Each cluster's set is a row of one bit per cluster. Most of a row is
+ * zero on large maps, so rows are stored compressed: runs of zero bytes
+ * are replaced by a zero byte followed by the length of the run, and
+ * zero bytes at the end of a row are dropped. The row of the cluster the
+ * viewpoint is in is decompressed whenever the viewpoint moves to another
+ * cluster, so that queries are a bit test.
+ */
+
+/* Datatypes */
+typedef struct {
+    int gridWidth;      /* In tiles */
+    int gridHeight;
+    int clusterSize;    /* Tiles along each side of a cluster */
+    int clustersWide;
+    int clustersHigh;
+    int rowBytes;       /* Bytes of a decompressed row */
+
+    /* Cluster c's compressed row is rows[rowStarts[c]] to rows[rowStarts[c + 1] - 1] */
+    unsigned char* rows;
+    long* rowStarts;
+    long size;          /* Bytes of compressed rows */
+
+    int viewCluster;    /* The cluster the viewpoint is in, or -1 if it is off the map */
+    unsigned char* viewRow;
+
+    /* A wall was knocked down since the set was built, which may have made any tile visible from anywhere */
+    char stale;
+} PotentiallyVisibleSet;
+
+/* Global data */
+extern PotentiallyVisibleSet gamePvs;
+
+/* Functions */
+
+/**
+ * Build a potentially visible set for a map. The viewpoint starts off the
+ * map.
+ *
+ * pvs:         The set to build.
+ * tiles:       The map, row by row. Positive tiles are walls.
+ * gridWidth:   The width of the map in tiles.
+ * gridHeight:  The height of the map in tiles.
+ * clusterSize: The number of tiles along each side of a cluster.
+ *
+ * Returns: Zero if the set could not be allocated, non-zero otherwise.
+ */
+int buildPvs(PotentiallyVisibleSet* pvs, const short* tiles, int gridWidth, int gridHeight, int clusterSize);
+
+/**
+ * Free a potentially visible set's arrays. Until it is built again, every
+ * tile counts as potentially visible.
+ *
+ * pvs: The set to destroy.
+ */
+void destroyPvs(PotentiallyVisibleSet* pvs);
+
+/**
+ * Move the point that visibility queries are answered from.
+ *
+ * pvs: The set to query.
+ * x:   The x coordinate of the viewpoint, in world units.
+ * y:   The y coordinate of the viewpoint, in world units.
+ */
+void setPvsViewpoint(PotentiallyVisibleSet* pvs, float x, float y);
+
+/**
+ * Check if a tile may be visible from the viewpoint.
+ *
+ * pvs:   The set to query.
+ * tileX: The column of the tile.
+ * tileY: The row of the tile.
+ *
+ * Returns: Zero if the tile can't be seen from the viewpoint's cluster,
+ *          non-zero if it may be, or if the set is stale or the
+ *          viewpoint is off the map.
+ */
+int isTilePotentiallyVisible(const PotentiallyVisibleSet* pvs, int tileX, int tileY);
+
+/**
+ * Check if any tile of a rectangle may be visible from the viewpoint.
+ *
+ * pvs:    The set to query.
+ * left:   The first column of the rectangle.
+ * top:    The first row of the rectangle.
+ * right:  The last column of the rectangle.
+ * bottom: The last row of the rectangle.
+ *
+ * Returns: Zero if none of the tiles can be seen from the viewpoint's
+ *          cluster, non-zero otherwise, as for isTilePotentiallyVisible.
+ */
+int isRegionPotentiallyVisible(const PotentiallyVisibleSet* pvs, int left, int top, int right, int bottom);
+
+/**
+ * A map listener that marks the set it is added with as stale when a
+ * wall of its map is knocked down. Walls that are built can only hide
+ * tiles, so the set stays conservative without them.
+ */
+void pvsMapListener(void* pvs, const TileMap* map, int tileX, int tileY, short oldTile);
+
+#endif /* PVS_H */
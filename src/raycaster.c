@@ -1,8 +1,10 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "config.h"
 #include "raycaster.h"
 #include "player.h"
+#include "trace.h"
 
 /* Globals */
 Vector3f viewplaneDir = {VIEWPLANE_DIR_X, VIEWPLANE_DIR_Y, 1};
@@ -10,103 +12,279 @@ float distFromViewplane;
 Matrix3f counterClockwiseRotation = IDENTITY_M;
 Matrix3f clockwiseRotation = IDENTITY_M;
 RayTuple rays[VIEWPLANE_LENGTH];
+CastPattern castPattern = FULL_CAST;
+int castColumnStart = 0;
+int castColumnStep  = 1;
+unsigned long raycasterFrame = 0;
+ColumnCost columnCosts[VIEWPLANE_LENGTH];
+RayCostStats frameRayCost;
+
+
+/* Scratch space for ray directions before they are normalized */
+static Vector2f rayDirections[VIEWPLANE_LENGTH];
+
+/* The map changed since the last cast */
+static char mapEdited = FALSE;
 
 
 void initializeRayDirections() {
     int i;
-    Vector3f v1,v2,v3;
+    Vector2f v1 = vector2fScale(vector3fTo2f(&playerDir), distFromViewplane);
+    Vector2f viewplane = vector3fTo2f(&viewplaneDir);
+
+    for(i = 0; i < VIEWPLANE_LENGTH; i++)
+        rayDirections[i] = vector2fSubtract(v1, vector2fScale(viewplane, ((VIEWPLANE_LENGTH / 2) - i)));
+    normalizeVector2fArray(rayDirections, VIEWPLANE_LENGTH);
 
     for(i = 0; i < VIEWPLANE_LENGTH; i++) {
-        v1 = homogeneousVectorScale(&playerDir, distFromViewplane);
-        v2 = homogeneousVectorScale(&viewplaneDir, ((VIEWPLANE_LENGTH / 2) - i));
-        v3 = vectorSubtract(&v1, &v2);
-        rays[i].hRay = normalizeVector(&v3);
-        rays[i].vRay = normalizeVector(&v3);
-
-        if (rayCastMode == ONLY_NORMALIZED) {
-            rays[i].hRay = homogeneousVectorScale(&rays[i].hRay, 40);
-            rays[i].vRay = homogeneousVectorScale(&rays[i].vRay, 40);
-        }
+        Vector2f dir = rayDirections[i];
+
+        if (rayCastMode == ONLY_NORMALIZED)
+            dir = vector2fScale(dir, 40);
+
+        rays[i].hRay = vector2fTo3f(dir);
+        rays[i].vRay = vector2fTo3f(dir);
     }
 }
 
+/* Offsets from a ray origin to the grid lines surrounding it, which are the same for every ray from it */
+typedef struct {
+    Vector2f left;
+    Vector2f right;
+    Vector2f up;
+    Vector2f down;
+} GridLineOffsets;
+
+static inline GridLineOffsets findGridLineOffsets(Vector2f origin) {
+    GridLineOffsets offsets;
+
+    offsets.left  = vector2f(((int)(origin.x / (float)WALL_SIZE)) * WALL_SIZE - origin.x, 0);
+    offsets.right = vector2f(((int)(origin.x / (float)WALL_SIZE)) * WALL_SIZE - origin.x + WALL_SIZE, 0);
+    offsets.up    = vector2f(0, ((int)(origin.y / (float)WALL_SIZE)) * WALL_SIZE - origin.y);
+    offsets.down  = vector2f(0, ((int)(origin.y / (float)WALL_SIZE)) * WALL_SIZE - origin.y + WALL_SIZE);
+
+    return offsets;
+}
+
+static inline void extendRayToFirstHit(RayTuple* ray, const GridLineOffsets* offsets) {
+    Vector2f vRay = vector3fTo2f(&ray->vRay);
+    Vector2f hRay = vector3fTo2f(&ray->hRay);
+
+    /* Extend vertical ray */
+    Vector2f perpVec = (vRay.x < 0) ? offsets->left : offsets->right;
+    ray->vRay = vector2fTo3f(vector2fScale(vRay, vector2fDotProduct(perpVec, perpVec) / MAKE_FLOAT_NONZERO(vector2fDotProduct(perpVec, vRay))));
+
+    /* Extend horizontal ray */
+    perpVec = (hRay.y < 0) ? offsets->up : offsets->down;
+    ray->hRay = vector2fTo3f(vector2fScale(hRay, vector2fDotProduct(perpVec, perpVec) / MAKE_FLOAT_NONZERO(vector2fDotProduct(perpVec, hRay))));
+}
+
 void extendRaysToFirstHit(RayTuple* rays) {
     int i;
+    GridLineOffsets offsets = findGridLineOffsets(vector3fTo2f(&playerPos));
 
-    for(i = 0; i < VIEWPLANE_LENGTH; i++) {
-        Vector3f perpVec = HOMOGENEOUS_V3;
+    for(i = 0; i < VIEWPLANE_LENGTH; i++)
+        extendRayToFirstHit(&rays[i], &offsets);
+}
 
-        /* Extend vertical ray */
-        if(rays[i].vRay.x < 0) { /* Ray is facing left */
-            perpVec.x = ((int)(playerPos.x / (float)WALL_SIZE)) * WALL_SIZE - playerPos.x;
-        } else { /* Ray is facing right */
-            perpVec.x = ((int)(playerPos.x / (float)WALL_SIZE)) * WALL_SIZE - playerPos.x + WALL_SIZE;
-        }
-        rays[i].vRay = homogeneousVectorScale(&rays[i].vRay, vectorDotProduct(&perpVec, &perpVec) / MAKE_FLOAT_NONZERO(vectorDotProduct(&perpVec, &rays[i].vRay)));
-
-        /* Extend horizontal ray */
-        perpVec.x = 0.0f;
-        if(rays[i].hRay.y < 0) { /* Ray is facing up */
-            perpVec.y = ((int)(playerPos.y / (float)WALL_SIZE)) * WALL_SIZE - playerPos.y;
-        } else { /* Ray is facing down */
-            perpVec.y = ((int)(playerPos.y / (float)WALL_SIZE)) * WALL_SIZE - playerPos.y + WALL_SIZE;
-        }
-        rays[i].hRay = homogeneousVectorScale(&rays[i].hRay, vectorDotProduct(&perpVec, &perpVec) / MAKE_FLOAT_NONZERO(vectorDotProduct(&perpVec, &rays[i].hRay)));
-    }
+static inline Vector2f verticalRayStep(Vector2f ray) {
+    Vector2f stepVector = vector2f((ray.x < 0) ? -1 * WALL_SIZE : WALL_SIZE, 0);
 
+    return vector2fScale(ray, vector2fDotProduct(stepVector, stepVector) / MAKE_FLOAT_NONZERO(vector2fDotProduct(stepVector, ray)));
+}
+
+static inline Vector2f horizontalRayStep(Vector2f ray) {
+    Vector2f stepVector = vector2f(0, (ray.y < 0) ? -1 * WALL_SIZE : WALL_SIZE);
+
+    return vector2fScale(ray, vector2fDotProduct(stepVector, stepVector) / MAKE_FLOAT_NONZERO(vector2fDotProduct(stepVector, ray)));
 }
 
 Vector3f findVerticalRayStepVector(Vector3f* ray) {
-    Vector3f stepVector = HOMOGENEOUS_V3;
-    if(ray->x < 0) { /* Ray is facing left */
-        stepVector.x = -1 * WALL_SIZE;
+    return vector2fTo3f(verticalRayStep(vector3fTo2f(ray)));
+}
 
-    } else { /* Ray is facing right */
-        stepVector.x = WALL_SIZE;
+Vector3f findHorizontalRayStepVector(Vector3f* ray) {
+    return vector2fTo3f(horizontalRayStep(vector3fTo2f(ray)));
+}
+
+static inline void castRay(RayTuple* ray, Vector2f origin, int column) {
+    Vector2f vRay = vector3fTo2f(&ray->vRay);
+    Vector2f hRay = vector3fTo2f(&ray->hRay);
+    Vector2f vstep = verticalRayStep(normalizeVector2f(vRay));
+    Vector2f hstep = horizontalRayStep(normalizeVector2f(hRay));
+    ColumnCost* cost = &columnCosts[column];
+    Uint64 start = (rayCostMode == RAY_COST_TIME) ? SDL_GetPerformanceCounter() : 0;
+    int tileX, tileY, verticalSteps = 0, horizontalSteps = 0;
+
+    /* Cast the vertical ray until it hits something */
+    findVerticalRayTile(origin, vRay, &tileX, &tileY);
+    while(tileX > 0 && tileY > 0 && tileX < MAP_GRID_WIDTH && tileY < MAP_GRID_HEIGHT && MAP[tileY][tileX] < 1) {
+        vRay = vector2fAdd(vRay, vstep);
+        findVerticalRayTile(origin, vRay, &tileX, &tileY);
+        verticalSteps++;
+    }
+
+    /* Cast the horizontal ray until it hits something */
+    findHorizontalRayTile(origin, hRay, &tileX, &tileY);
+    while(tileX > 0 && tileY > 0 && tileX < MAP_GRID_WIDTH && tileY < MAP_GRID_HEIGHT && MAP[tileY][tileX] < 1) {
+        hRay = vector2fAdd(hRay, hstep);
+        findHorizontalRayTile(origin, hRay, &tileX, &tileY);
+        horizontalSteps++;
+    }
+
+    ray->vRay = vector2fTo3f(vRay);
+    ray->hRay = vector2fTo3f(hRay);
+
+    /* Record the column's traversal cost */
+    cost->frame = raycasterFrame;
+    cost->verticalSteps = verticalSteps;
+    cost->horizontalSteps = horizontalSteps;
+    cost->nanoseconds = 0;
+    if(start) {
+        cost->nanoseconds = (unsigned int)((SDL_GetPerformanceCounter() - start) * 1000000000 / SDL_GetPerformanceFrequency());
+        frameRayCost.nanoseconds += cost->nanoseconds;
     }
 
-    return homogeneousVectorScale(ray, vectorDotProduct(&stepVector, &stepVector) / MAKE_FLOAT_NONZERO(vectorDotProduct(&stepVector, ray)));
+    frameRayCost.raysCast++;
+    frameRayCost.verticalSteps += verticalSteps;
+    frameRayCost.horizontalSteps += horizontalSteps;
+    if(verticalSteps + horizontalSteps > frameRayCost.maxSteps) {
+        frameRayCost.maxSteps = verticalSteps + horizontalSteps;
+        frameRayCost.maxStepsColumn = column;
+    }
 }
 
-Vector3f findHorizontalRayStepVector(Vector3f* ray) {
-    Vector3f stepVector = HOMOGENEOUS_V3;
-    if(ray->y < 0) { /* Ray is facing up */
-        stepVector.y = -1 * WALL_SIZE;
+int traceRayTiles(const short* tiles, int gridWidth, int gridHeight, Vector2f origin, Vector2f dir, int* visited, int maxVisited) {
+    GridLineOffsets offsets = findGridLineOffsets(origin);
+    Vector2f vstep = verticalRayStep(dir);
+    Vector2f hstep = horizontalRayStep(dir);
+    Vector2f vRay, hRay, pos;
+    RayTuple ray;
+    int tileX = (int)(origin.x / WALL_SIZE), tileY = (int)(origin.y / WALL_SIZE), count = 0;
+
+    if(origin.x < 0 || origin.y < 0 || tileX >= gridWidth || tileY >= gridHeight || maxVisited < 1)
+        return 0;
+    visited[count++] = tileY * gridWidth + tileX;
+    if(tiles[tileY * gridWidth + tileX] > 0)
+        return count;
+
+    ray.vRay = ray.hRay = vector2fTo3f(dir);
+    extendRayToFirstHit(&ray, &offsets);
+    vRay = vector3fTo2f(&ray.vRay);
+    hRay = vector3fTo2f(&ray.hRay);
+
+    /* Step whichever of the vertical and horizontal rays is shorter, so that the tiles come in order */
+    while(count < maxVisited) {
+        if(vector2fDotProduct(vRay, vRay) < vector2fDotProduct(hRay, hRay)) {
+            pos = vector2fAdd(origin, vRay);
+            findVerticalRayTile(origin, vRay, &tileX, &tileY);
+            vRay = vector2fAdd(vRay, vstep);
+        } else {
+            pos = vector2fAdd(origin, hRay);
+            findHorizontalRayTile(origin, hRay, &tileX, &tileY);
+            hRay = vector2fAdd(hRay, hstep);
+        }
 
-    } else { /* Ray is facing down */
-        stepVector.y = WALL_SIZE;
+        /* Tile coordinates are truncated towards zero, so check the intersection itself for leaving the map */
+        if(pos.x < 0 || pos.y < 0 || tileX >= gridWidth || tileY >= gridHeight)
+            break;
+
+        visited[count++] = tileY * gridWidth + tileX;
+        if(tiles[tileY * gridWidth + tileX] > 0)
+            break;
     }
 
-    return homogeneousVectorScale(ray, vectorDotProduct(&stepVector, &stepVector) / MAKE_FLOAT_NONZERO(vectorDotProduct(&stepVector, ray)));
+    return count;
 }
 
 void raycast(RayTuple* rays) {
     int i;
+    Vector2f origin = vector3fTo2f(&playerPos);
 
-    for(i = 0; i < VIEWPLANE_LENGTH; i++) {
-        Vector3f vnorm = normalizeVector(&rays[i].vRay);
-        Vector3f hnorm = normalizeVector(&rays[i].hRay);
-        Vector3f vstep = findVerticalRayStepVector(&vnorm);
-        Vector3f hstep = findHorizontalRayStepVector(&hnorm);
-        Vector3f mapCoord;
-
-        /* Cast the vertical ray until it hits something */
-        mapCoord = getTileCoordinateForVerticalRay(&rays[i].vRay);
-        while(mapCoord.x > 0 && mapCoord.y > 0 && mapCoord.x < MAP_GRID_WIDTH && mapCoord.y < MAP_GRID_HEIGHT && MAP[(int)mapCoord.y][(int)mapCoord.x] < 1) {
-            rays[i].vRay = vectorAdd(&rays[i].vRay, &vstep);
-            mapCoord = getTileCoordinateForVerticalRay(&rays[i].vRay);
-        }
+    TRACE_BEGIN(raycast);
+    for(i = 0; i < VIEWPLANE_LENGTH; i++)
+        castRay(&rays[i], origin, i);
+    TRACE_END(raycast);
+}
 
-        /* Cast the horizontal ray until it hits something */
-        mapCoord = getTileCoordinateForHorizontalRay(&rays[i].hRay);
-        while(mapCoord.x > 0 && mapCoord.y > 0 && mapCoord.x < MAP_GRID_WIDTH && mapCoord.y < MAP_GRID_HEIGHT && MAP[(int)mapCoord.y][(int)mapCoord.x] < 1) {
-            rays[i].hRay = vectorAdd(&rays[i].hRay, &hstep);
-            mapCoord = getTileCoordinateForHorizontalRay(&rays[i].hRay);
-        }
+void castColumns(int start, int end, int step) {
+    int i;
+    Vector2f origin = vector3fTo2f(&playerPos);
+    Vector2f v1 = vector2fScale(vector3fTo2f(&playerDir), distFromViewplane);
+    Vector2f viewplane = vector3fTo2f(&viewplaneDir);
+    GridLineOffsets offsets = findGridLineOffsets(vector3fTo2f(&playerPos));
+
+    TRACE_BEGIN(castColumns);
+    for(i = start; i < end; i += step) {
+        Vector2f dir = normalizeVector2f(vector2fSubtract(v1, vector2fScale(viewplane, ((VIEWPLANE_LENGTH / 2) - i))));
+
+        if (rayCastMode == ONLY_NORMALIZED)
+            dir = vector2fScale(dir, 40);
+
+        rays[i].hRay = vector2fTo3f(dir);
+        rays[i].vRay = vector2fTo3f(dir);
+        if (rayCastMode == ONLY_NORMALIZED)
+            continue;
+
+        extendRayToFirstHit(&rays[i], &offsets);
+        if (rayCastMode == ONLY_FIRST_HIT)
+            continue;
+
+        castRay(&rays[i], origin, i);
     }
+    TRACE_END(castColumns);
+}
+
+/*
+ * Check whether the camera moved little enough since the last cast for
+ * the previous frame's hits to be reprojected into this one.
+ */
+static int cameraMovedSlowly() {
+    static Vector2f lastPos, lastDir;
+    static float lastDistFromViewplane = 0;
+    Vector2f pos = vector3fTo2f(&playerPos);
+    Vector2f dir = normalizeVector2f(vector3fTo2f(&playerDir));
+    int slow = lastDistFromViewplane == distFromViewplane &&
+        vector2fMagnitude(vector2fSubtract(pos, lastPos)) <= INTERLACE_MAX_MOVEMENT &&
+        vector2fDotProduct(dir, lastDir) >= cos(INTERLACE_MAX_ROTATION);
+
+    lastPos = pos;
+    lastDir = dir;
+    lastDistFromViewplane = distFromViewplane;
+
+    return slow;
 }
 
 void updateRaycaster() {
+    static int interlacedFrame = 0;
+    int slow = cameraMovedSlowly() && !mapEdited;
+
+    mapEdited = FALSE;
+    raycasterFrame++;
+    memset(&frameRayCost, 0, sizeof(frameRayCost));
+
+    /* In adaptive mode, cast every adaptiveStep'th column and the last one */
+    if (adaptiveStep > 1 && rayCastMode == 0) {
+        castPattern = ADAPTIVE_CAST;
+        castColumnStart = 0;
+        castColumnStep = adaptiveStep;
+        castColumns(0, VIEWPLANE_LENGTH, castColumnStep);
+        if ((VIEWPLANE_LENGTH - 1) % castColumnStep)
+            castColumns(VIEWPLANE_LENGTH - 1, VIEWPLANE_LENGTH, 1);
+        return;
+    }
+
+    /* In interlaced mode, alternate between casting the even and odd columns */
+    if (interlacedMode && rayCastMode == 0 && slow) {
+        castPattern = INTERLACED_CAST;
+        castColumnStart = (interlacedFrame++) & 1;
+        castColumnStep = 2;
+        castColumns(castColumnStart, VIEWPLANE_LENGTH, castColumnStep);
+        return;
+    }
+    castPattern = FULL_CAST;
+    castColumnStart = 0;
+    castColumnStep = 1;
 
     /* Update the rays */
     initializeRayDirections();
@@ -124,20 +302,60 @@ void updateRaycaster() {
 
 }
 
+void castSkippedColumns() {
+    int start, end = VIEWPLANE_LENGTH;
+
+    /* Adaptive casts have already cast the last column */
+    if(castPattern == ADAPTIVE_CAST)
+        end--;
+
+    for(start = 0; start < castColumnStep; start++)
+        if(start != castColumnStart)
+            castColumns(start, end, castColumnStep);
+
+    castPattern = FULL_CAST;
+    castColumnStart = 0;
+    castColumnStep = 1;
+}
+
+void raycasterMapListener(void* context, const TileMap* map, int tileX, int tileY, short oldTile) {
+    (void)context;
+    (void)map;
+    (void)tileX;
+    (void)tileY;
+    (void)oldTile;
+    mapEdited = TRUE;
+}
+
+void accumulateRayCost(RayCostStats* total, const RayCostStats* frame) {
+    total->raysCast += frame->raysCast;
+    total->verticalSteps += frame->verticalSteps;
+    total->horizontalSteps += frame->horizontalSteps;
+    total->nanoseconds += frame->nanoseconds;
+    if(frame->maxSteps > total->maxSteps) {
+        total->maxSteps = frame->maxSteps;
+        total->maxStepsColumn = frame->maxStepsColumn;
+    }
+}
+
 Vector3f getTileCoordinateForVerticalRay(Vector3f* ray) {
-    Vector3f pos = vectorAdd(&playerPos, ray);
-    Vector3f coord;
-    coord.x = (int)(pos.x + ((ray->x < 0) ? (-1 * RAY_EPS) : (RAY_EPS))) / WALL_SIZE;
-    coord.y = (int)(pos.y + ((ray->y < 0) ? (-1 * EPS) : (EPS))) / WALL_SIZE;
+    Vector3f coord = HOMOGENEOUS_V3;
+    int tileX, tileY;
+
+    findVerticalRayTile(vector3fTo2f(&playerPos), vector3fTo2f(ray), &tileX, &tileY);
+    coord.x = tileX;
+    coord.y = tileY;
 
     return coord;
 }
 
 Vector3f getTileCoordinateForHorizontalRay(Vector3f* ray) {
-    Vector3f pos = vectorAdd(&playerPos, ray);
-    Vector3f coord;
-    coord.x = (int)(pos.x + ((ray->x < 0) ? (-1 * EPS) : EPS)) / WALL_SIZE;
-    coord.y = (int)(pos.y + ((ray->y < 0) ? (-1 * RAY_EPS) : (RAY_EPS))) / WALL_SIZE;
+    Vector3f coord = HOMOGENEOUS_V3;
+    int tileX, tileY;
+
+    findHorizontalRayTile(vector3fTo2f(&playerPos), vector3fTo2f(ray), &tileX, &tileY);
+    coord.x = tileX;
+    coord.y = tileY;
 
     return coord;
 }
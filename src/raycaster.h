@@ -3,6 +3,8 @@
 
 #include "config.h"
 #include "linalg.h"
+#include "vector2f.h"
+#include "tilemap.h"
 
 /* Constants */
 #define RAY_EPS   (WALL_SIZE / 3.0f)
@@ -13,6 +15,31 @@ typedef struct {
     Vector3f hRay;
 } RayTuple;
 
+/* Traversal cost of the ray last cast in a screen column */
+typedef struct {
+    unsigned long frame;            /* raycasterFrame when the column was cast */
+    unsigned short verticalSteps;   /* Grid steps past the first hit */
+    unsigned short horizontalSteps;
+    unsigned int nanoseconds;       /* Traversal time, only measured when rayCostMode is RAY_COST_TIME */
+} ColumnCost;
+
+/* Traversal cost of the rays cast for a frame */
+typedef struct {
+    int raysCast;
+    int verticalSteps;
+    int horizontalSteps;
+    int maxSteps;           /* Most steps taken by a single ray */
+    int maxStepsColumn;     /* The column of that ray */
+    Uint64 nanoseconds;     /* Only measured when rayCostMode is RAY_COST_TIME */
+} RayCostStats;
+
+/* How the columns that were not cast should be filled in */
+typedef enum {
+    FULL_CAST,          /* Every column was cast */
+    INTERLACED_CAST,    /* Reproject the previous frame's hits into the other columns */
+    ADAPTIVE_CAST       /* Interpolate or cast the columns between samples */
+} CastPattern;
+
 /* Global data */
 extern Vector3f viewplaneDir;
 extern float distFromViewplane;
@@ -20,6 +47,27 @@ extern Matrix3f counterClockwiseRotation;
 extern Matrix3f clockwiseRotation;
 extern RayTuple rays[VIEWPLANE_LENGTH];
 
+/*
+ * The columns cast by the last call to updateRaycaster: every
+ * castColumnStep'th column starting from castColumnStart (and the last
+ * column for adaptive casts). The rays of the other columns are left
+ * over from earlier frames.
+ */
+extern CastPattern castPattern;
+extern int castColumnStart;
+extern int castColumnStep;
+
+/* Incremented on every call to updateRaycaster */
+extern unsigned long raycasterFrame;
+
+/*
+ * The cost of each column's last cast, and of all rays cast since the
+ * last call to updateRaycaster, including columns the renderer casts
+ * while resolving the frame.
+ */
+extern ColumnCost columnCosts[VIEWPLANE_LENGTH];
+extern RayCostStats frameRayCost;
+
 /* Functions */
 
 /**
@@ -64,6 +112,48 @@ Vector3f findHorizontalRayStepVector(Vector3f* ray);
  */
 void raycast(RayTuple* rays);
 
+/**
+ * Walk a ray through a map the way the raycaster casts rays, listing the
+ * tiles it passes through in order, up to and including the first wall.
+ *
+ * tiles:      The map, row by row. Positive tiles are walls.
+ * gridWidth:  The width of the map in tiles.
+ * gridHeight: The height of the map in tiles.
+ * origin:     The start of the ray, in world units.
+ * dir:        The direction of the ray, normalized.
+ * visited:    Set to the indices of the tiles, starting with the
+ *             origin's. A ray can't pass through more than
+ *             gridWidth + gridHeight + 3 tiles.
+ * maxVisited: The most tiles to list.
+ *
+ * Returns: The number of tiles listed, zero if the origin is off the map.
+ */
+int traceRayTiles(const short* tiles, int gridWidth, int gridHeight, Vector2f origin, Vector2f dir, int* visited, int maxVisited);
+
+/**
+ * Initialize and cast the rays of a subset of the screen columns.
+ * This honours rayCastMode like updateRaycaster does.
+ *
+ * start: The first column to cast.
+ * end:   One past the last column to cast.
+ * step:  The distance between cast columns.
+ */
+void castColumns(int start, int end, int step);
+
+/**
+ * Cast the columns the last call to updateRaycaster skipped, for code
+ * that reads every column's ray rather than a projected scene.
+ */
+void castSkippedColumns();
+
+/**
+ * Add the ray costs of a frame to a running total.
+ *
+ * total: The total to add to.
+ * frame: The frame's costs, such as frameRayCost.
+ */
+void accumulateRayCost(RayCostStats* total, const RayCostStats* frame);
+
 /**
  * Get the tile coordinate (x, y) for the vertical intersection
  * point of a ray and the world.
@@ -84,12 +174,53 @@ Vector3f getTileCoordinateForVerticalRay(Vector3f* ray);
  */
 Vector3f getTileCoordinateForHorizontalRay(Vector3f* ray);
 
+/**
+ * Get the tile coordinate for the vertical intersection point of a ray
+ * cast from a given origin. This is the inline counterpart of
+ * getTileCoordinateForVerticalRay for use in hot loops.
+ *
+ * origin: The origin of the ray.
+ * ray:    The ray to find the tile coordinate for.
+ * tileX:  Set to the x tile coordinate.
+ * tileY:  Set to the y tile coordinate.
+ */
+static inline void findVerticalRayTile(Vector2f origin, Vector2f ray, int* tileX, int* tileY) {
+    Vector2f pos = vector2fAdd(origin, ray);
+    *tileX = (int)(pos.x + ((ray.x < 0) ? (-1 * RAY_EPS) : (RAY_EPS))) / WALL_SIZE;
+    *tileY = (int)(pos.y + ((ray.y < 0) ? (-1 * EPS) : (EPS))) / WALL_SIZE;
+}
+
+/**
+ * Get the tile coordinate for the horizontal intersection point of a ray
+ * cast from a given origin. This is the inline counterpart of
+ * getTileCoordinateForHorizontalRay for use in hot loops.
+ *
+ * origin: The origin of the ray.
+ * ray:    The ray to find the tile coordinate for.
+ * tileX:  Set to the x tile coordinate.
+ * tileY:  Set to the y tile coordinate.
+ */
+static inline void findHorizontalRayTile(Vector2f origin, Vector2f ray, int* tileX, int* tileY) {
+    Vector2f pos = vector2fAdd(origin, ray);
+    *tileX = (int)(pos.x + ((ray.x < 0) ? (-1 * EPS) : EPS)) / WALL_SIZE;
+    *tileY = (int)(pos.y + ((ray.y < 0) ? (-1 * RAY_EPS) : (RAY_EPS))) / WALL_SIZE;
+}
+
 /**
  * Update the raycaster (setup and perform raycasting) for
- * the current frame.
+ * the current frame. In adaptive mode only every adaptiveStep'th
+ * column is cast. In interlaced mode only every other column is cast,
+ * unless the camera moved too much or the map changed since the last
+ * frame.
  */
 void updateRaycaster();
 
+/**
+ * A map listener that stops the next frame from reusing the hits of the
+ * last one, as walls may have appeared or vanished since.
+ */
+void raycasterMapListener(void* context, const TileMap* map, int tileX, int tileY, short oldTile);
+
 /**
  * Initialize the raycaster.
  */
@@ -1,9 +1,55 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "config.h"
 #include "renderer.h"
 #include "raycaster.h"
 #include "player.h"
+#include "palette.h"
+#include "hud.h"
+#include "trace.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <stdint.h>
+#include <immintrin.h>
+#define HAVE_AVX2_GATHER
+#endif
+
+/* Globals */
+ColumnHit columnHits[VIEWPLANE_LENGTH];
+
+/* Hits of the previous frame, reprojected into columns that are not cast in interlaced mode */
+static ColumnHit previousHits[VIEWPLANE_LENGTH];
+static char previousHitWasCast[VIEWPLANE_LENGTH];
+static Vector2f previousOrigin;
+static unsigned long previousHitsFrame = 0;
+
+/* Per-column state while resolving an interlaced frame */
+static char columnWasCast[VIEWPLANE_LENGTH];
+static float reprojectedDepth[VIEWPLANE_LENGTH];
+static char reprojectedHitMoved[VIEWPLANE_LENGTH];    /* Moved over from a cast column, or nothing landed */
+
+/*
+ * What each screen buffer's uploaded frame was drawn from: the screen
+ * buffer's and the pipeline's second one. Columns are only uploaded
+ * again when this changes.
+ */
+#define DRAWN_BUFFERS   2
+#define HIT_EPSILON     (WALL_SIZE * 1e-5f)     /* Hits closer than this draw the same column */
+
+static struct {
+    Uint32* buffer;
+    Vector3f pos;
+    Vector3f dir;
+    Vector3f viewplaneDir;
+    float distFromViewplane;
+    char textureMode;
+    char distortion;
+    char palettizedMode;
+    char rayCostMode;
+    ColumnHit hits[VIEWPLANE_LENGTH];
+} drawnFrames[DRAWN_BUFFERS];
+static int nextDrawnSlot = 0;
 
 
 float calculateDrawHeight(float rayLength) {
@@ -27,8 +73,19 @@ void drawUntexturedStrip(int x, float wallYStart, float length, Uint32 ABGRColor
     }
 }
 
-void drawTexturedStrip(int x, float wallYStart, float length, int textureX, Uint32* texture, char darken) {
-    int y;
+void initWallTexture(WallTexture* texture, Uint32* pixels, int width, int height) {
+    texture->pixels = pixels;
+    texture->indexedPixels = NULL;
+    texture->width = width;
+    texture->height = height;
+
+    for(texture->widthShift = 0; (1 << texture->widthShift) < width; texture->widthShift++);
+    if((1 << texture->widthShift) != width)
+        texture->widthShift = -1;
+}
+
+void drawTexturedStrip(int x, float wallYStart, float length, int textureX, const WallTexture* texture, char darken) {
+    int y, textureHeight = texture->height;
     float d, ty;
     Uint32 color;
 
@@ -37,14 +94,15 @@ void drawTexturedStrip(int x, float wallYStart, float length, int textureX, Uint
 
     for(y = 0; y < WINDOW_HEIGHT; y++) {
         d = y - (WINDOW_HEIGHT / 2.0f) + length / 2.0f;
-        ty = d * (float)(TEXTURE_SIZE-EPS) / length;
+        ty = d * (float)(textureHeight-EPS) / length;
 
         if(y < wallYStart) {
             screenBuffer[XY_TO_SCREEN_INDEX(x, y)] = CEILING_COLOR;
         } else if(y > (wallYStart + length)) {
             screenBuffer[XY_TO_SCREEN_INDEX(x, y)] = FLOOR_COLOR;
         } else {
-            color = texture[XY_TO_TEXTURE_INDEX(textureX, (int)ty)];
+            /* The last wall row lands exactly on the texture's height, so keep it inside the texture */
+            color = texture->pixels[XY_TO_TEXEL_INDEX(texture, textureX, MIN((int)ty, textureHeight - 1))];
             if(darken) color = DARKEN_COLOR(color);
 
             screenBuffer[XY_TO_SCREEN_INDEX(x, y)] = color;
@@ -53,41 +111,587 @@ void drawTexturedStrip(int x, float wallYStart, float length, int textureX, Uint
 
 }
 
-int getTextureColumnNumberForRay(Vector3f* ray, RayType rtype) {
-    Vector3f rayHitPos = vectorAdd(&playerPos, ray);
-    if(rtype == HORIZONTAL_RAY) {
-        if(ray->y < 0)
-            return (int)rayHitPos.x % TEXTURE_SIZE;
+/* A wall spans its texture's full width, so the hit's position along the wall is scaled to the texture */
+static inline int textureColumnForRay(Vector2f origin, Vector2f ray, RayType rtype, const WallTexture* texture) {
+    Vector2f rayHitPos = vector2fAdd(origin, ray);
+    float along = (rtype == HORIZONTAL_RAY) ? rayHitPos.x : rayHitPos.y;
+    int flipped = (rtype == HORIZONTAL_RAY) ? (ray.y >= 0) : (ray.x <= 0);
+    int column = (int)(along * texture->width / WALL_SIZE);
+
+    /* Power of two widths wrap with a mask instead of a modulo */
+    if(texture->widthShift >= 0)
+        column &= texture->width - 1;
+    else
+        column %= texture->width;
+
+    return flipped ? texture->width - 1 - column : column;
+}
+
+/* viewplaneNorm is the normalized viewplane direction */
+static inline float undistortedRayLength(Vector2f ray, Vector2f viewplaneNorm) {
+    Vector2f proj = vector2fScale(viewplaneNorm, vector2fDotProduct(viewplaneNorm, ray));
+
+    return vector2fMagnitude(vector2fSubtract(ray, proj));
+}
+
+int getTextureColumnNumberForRay(Vector3f* ray, RayType rtype, const WallTexture* texture) {
+    return textureColumnForRay(vector3fTo2f(&playerPos), vector3fTo2f(ray), rtype, texture);
+}
+
+float getUndistortedRayLength(Vector3f* ray) {
+    return undistortedRayLength(vector3fTo2f(ray), normalizeVector2f(vector3fTo2f(&viewplaneDir)));
+}
+
+/*========================================================
+ * Specialized column kernels
+ *========================================================
+ */
+
+/*
+ * The generic strip drawers above decide per pixel whether they are in the
+ * ceiling, wall or floor span, and whether the wall should be shaded. The
+ * kernels below split a column into its three spans up front, and are
+ * instantiated once per texture/shading combination so that their inner
+ * loops contain no mode checks. The column renderers are likewise
+ * instantiated once per texture/distortion combination and selected once
+ * per frame. Textured spans are further specialized per column for
+ * textures with power of two widths, which step between texel rows by
+ * shifting rather than multiplying.
+ */
+
+#if defined(__GNUC__)
+#define ALWAYS_INLINE static inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE static inline
+#endif
+
+
+/*
+ * Find the first wall row and the first floor row of a strip, matching the
+ * per-pixel comparisons made by the generic strip drawers.
+ */
+ALWAYS_INLINE void findStripSpans(int height, float wallYStart, float length, int* wallStart, int* floorStart) {
+    float wallYEnd;
+
+    if(wallYStart < 0)
+        wallYStart = 0;
+    wallYEnd = wallYStart + length;
+
+    *wallStart  = (wallYStart < height) ? (int)ceilf(wallYStart) : height;
+    *floorStart = (wallYEnd < height) ? (int)floorf(wallYEnd) + 1 : height;
+    if(*floorStart < *wallStart)
+        *floorStart = *wallStart;
+}
+
+/* Draw rows [y, end) of the wall span of a textured strip */
+ALWAYS_INLINE void fillTexturedSpan(Uint32* dst, int pitch, int height, int y, int end, float length, int textureX,
+                                    const WallTexture* texture, const int powerOfTwo, const int shaded) {
+    const Uint32* texels = texture->pixels + textureX;
+    float scale = (float)(texture->height-EPS);
+    int lastRow = texture->height - 1, stride = texture->width, shift = texture->widthShift;
+
+    for(; y < end; y++, dst += pitch) {
+        float d = y - (height / 2.0f) + length / 2.0f;
+        int row = MIN((int)(d * scale / length), lastRow);
+        Uint32 texel = texels[powerOfTwo ? (row << shift) : (row * stride)];
+
+        *dst = shaded ? DARKEN_COLOR(texel) : texel;
+    }
+}
+
+ALWAYS_INLINE void fillStrip(Uint32* dst, int pitch, int height, float wallYStart, float length, int textureX,
+                             const WallTexture* texture, Uint32 color, const int textured, const int shaded) {
+    int y, wallStart, floorStart;
+
+    findStripSpans(height, wallYStart, length, &wallStart, &floorStart);
+
+    for(y = 0; y < wallStart; y++, dst += pitch)
+        *dst = CEILING_COLOR;
+
+    if(textured) {
+        if(texture->widthShift >= 0)
+            fillTexturedSpan(dst, pitch, height, y, floorStart, length, textureX, texture, TRUE, shaded);
         else
-            return TEXTURE_SIZE - 1 - ((int)rayHitPos.x % TEXTURE_SIZE);
+            fillTexturedSpan(dst, pitch, height, y, floorStart, length, textureX, texture, FALSE, shaded);
+        dst += (floorStart - y) * pitch;
+        y = floorStart;
     } else {
-        if(ray->x > 0)
-            return (int)rayHitPos.y % TEXTURE_SIZE;
+        if(shaded)
+            color = DARKEN_COLOR(color);
+        for(; y < floorStart; y++, dst += pitch)
+            *dst = color;
+    }
+
+    for(; y < height; y++, dst += pitch)
+        *dst = FLOOR_COLOR;
+}
+
+#define DEFINE_STRIP_KERNEL(NAME, TEXTURED, SHADED) \
+    static void NAME(Uint32* dst, int pitch, int height, float wallYStart, float length, int textureX, \
+                     const WallTexture* texture, Uint32 color) { \
+        fillStrip(dst, pitch, height, wallYStart, length, textureX, texture, color, TEXTURED, SHADED); \
+    }
+
+DEFINE_STRIP_KERNEL(fillFlatStrip,           FALSE, FALSE)
+DEFINE_STRIP_KERNEL(fillShadedFlatStrip,     FALSE, TRUE)
+DEFINE_STRIP_KERNEL(fillTexturedStrip,       TRUE,  FALSE)
+DEFINE_STRIP_KERNEL(fillShadedTexturedStrip, TRUE,  TRUE)
+
+/* Strip kernels indexed by [textured][shaded] */
+static const StripKernel stripKernels[2][2] = {
+    {fillFlatStrip,     fillShadedFlatStrip},
+    {fillTexturedStrip, fillShadedTexturedStrip}
+};
+
+StripKernel getStripKernel(char textured, char shaded) {
+    return stripKernels[textured != 0][shaded != 0];
+}
+
+/*
+ * The palettized counterpart of fillStrip. Colors and texels are palette
+ * indices, and shading is a lookup in the shade remap table.
+ */
+ALWAYS_INLINE void fillIndexedTexturedSpan(Uint8* dst, int pitch, int height, int y, int end, float length, int textureX,
+                                           const WallTexture* texture, const int powerOfTwo, const int shaded) {
+    const Uint8* texels = texture->indexedPixels + textureX;
+    float scale = (float)(texture->height-EPS);
+    int lastRow = texture->height - 1, stride = texture->width, shift = texture->widthShift;
+
+    for(; y < end; y++, dst += pitch) {
+        float d = y - (height / 2.0f) + length / 2.0f;
+        int row = MIN((int)(d * scale / length), lastRow);
+        Uint8 texel = texels[powerOfTwo ? (row << shift) : (row * stride)];
+
+        *dst = shaded ? shadeRemap[texel] : texel;
+    }
+}
+
+ALWAYS_INLINE void fillIndexedStrip(Uint8* dst, int pitch, int height, float wallYStart, float length, int textureX,
+                                    const WallTexture* texture, Uint8 color, const int textured, const int shaded) {
+    int y, wallStart, floorStart;
+
+    findStripSpans(height, wallYStart, length, &wallStart, &floorStart);
+
+    for(y = 0; y < wallStart; y++, dst += pitch)
+        *dst = ceilingIndex;
+
+    if(textured) {
+        if(texture->widthShift >= 0)
+            fillIndexedTexturedSpan(dst, pitch, height, y, floorStart, length, textureX, texture, TRUE, shaded);
         else
-            return TEXTURE_SIZE - 1 - ((int)rayHitPos.y % TEXTURE_SIZE);
+            fillIndexedTexturedSpan(dst, pitch, height, y, floorStart, length, textureX, texture, FALSE, shaded);
+        dst += (floorStart - y) * pitch;
+        y = floorStart;
+    } else {
+        if(shaded)
+            color = shadeRemap[color];
+        for(; y < floorStart; y++, dst += pitch)
+            *dst = color;
     }
+
+    for(; y < height; y++, dst += pitch)
+        *dst = floorIndex;
 }
 
-float getUndistortedRayLength(Vector3f* ray) {
-    Vector3f undistortedRay;
-    Vector3f proj = vectorProjection(ray, &viewplaneDir);
-    undistortedRay = vectorSubtract(ray, &proj);
+#define DEFINE_INDEXED_STRIP_KERNEL(NAME, TEXTURED, SHADED) \
+    static void NAME(Uint8* dst, int pitch, int height, float wallYStart, float length, int textureX, \
+                     const WallTexture* texture, Uint8 color) { \
+        fillIndexedStrip(dst, pitch, height, wallYStart, length, textureX, texture, color, TEXTURED, SHADED); \
+    }
+
+DEFINE_INDEXED_STRIP_KERNEL(fillIndexedFlatStrip,           FALSE, FALSE)
+DEFINE_INDEXED_STRIP_KERNEL(fillShadedIndexedFlatStrip,     FALSE, TRUE)
+DEFINE_INDEXED_STRIP_KERNEL(fillIndexedTexturedStrip,       TRUE,  FALSE)
+DEFINE_INDEXED_STRIP_KERNEL(fillShadedIndexedTexturedStrip, TRUE,  TRUE)
+
+/* Palettized strip kernels indexed by [textured][shaded] */
+static const IndexedStripKernel indexedStripKernels[2][2] = {
+    {fillIndexedFlatStrip,     fillShadedIndexedFlatStrip},
+    {fillIndexedTexturedStrip, fillShadedIndexedTexturedStrip}
+};
 
-    return homogeneousVectorMagnitude(&undistortedRay);
+IndexedStripKernel getIndexedStripKernel(char textured, char shaded) {
+    return indexedStripKernels[textured != 0][shaded != 0];
 }
 
-void renderProjectedScene() {
+/* The wall type and on-screen wall length of a column */
+ALWAYS_INLINE float columnDrawLength(const ColumnHit* hit, Vector2f viewplaneNorm, int* wallType, const int distorted) {
+    *wallType = MAP[hit->tileY][hit->tileX];
+    if(*wallType < 1 || *wallType > 4)
+        *wallType = 4;
+
+    if(distorted)
+        return calculateDrawHeight(vector2fMagnitude(hit->ray));
+    else
+        return calculateDrawHeight(undistortedRayLength(hit->ray, viewplaneNorm));
+}
+
+ALWAYS_INLINE void renderColumnSpan(int start, int end, const int textured, const int distorted, const int indexed) {
     int i;
+    Vector2f origin = vector3fTo2f(&playerPos);
+    Vector2f viewplaneNorm = normalizeVector2f(vector3fTo2f(&viewplaneDir));
 
-    if (slowRenderMode) {
-        int x, y;
+    for(i = start; i < end; i++) {
+        ColumnHit* hit = &columnHits[i];
+        int wallType;
+        float drawLength = columnDrawLength(hit, viewplaneNorm, &wallType, distorted);
 
-        for(x = 0; x < WINDOW_WIDTH; x++)
-            for(y = 0; y < WINDOW_HEIGHT; y++)
-                screenBuffer[(WINDOW_WIDTH * y) + x] = 0xFFFFFFFF;
+        const WallTexture* texture = &TEXTURES[wallType - 1];
+
+        /* Horizontal hits are shaded when textured, vertical hits when untextured */
+        if(indexed && textured)
+            indexedStripKernels[TRUE][hit->rtype == HORIZONTAL_RAY](indexedScreenBuffer + i, WINDOW_WIDTH, WINDOW_HEIGHT, (WINDOW_HEIGHT / 2.0f) - (drawLength / 2.0f), drawLength,
+                    textureColumnForRay(origin, hit->ray, hit->rtype, texture), texture, 0);
+        else if(indexed)
+            indexedStripKernels[FALSE][hit->rtype != HORIZONTAL_RAY](indexedScreenBuffer + i, WINDOW_WIDTH, WINDOW_HEIGHT, (WINDOW_HEIGHT / 2.0f) - (drawLength / 2.0f), drawLength,
+                    0, NULL, colorIndices[wallType - 1]);
+        else if(textured)
+            stripKernels[TRUE][hit->rtype == HORIZONTAL_RAY](screenBuffer + i, WINDOW_WIDTH, WINDOW_HEIGHT, (WINDOW_HEIGHT / 2.0f) - (drawLength / 2.0f), drawLength,
+                    textureColumnForRay(origin, hit->ray, hit->rtype, texture), texture, 0);
+        else
+            stripKernels[FALSE][hit->rtype != HORIZONTAL_RAY](screenBuffer + i, WINDOW_WIDTH, WINDOW_HEIGHT, (WINDOW_HEIGHT / 2.0f) - (drawLength / 2.0f), drawLength,
+                    0, NULL, COLORS[wallType - 1]);
+    }
+}
+
+#define DEFINE_COLUMN_RENDERER(NAME, TEXTURED, DISTORTED, INDEXED) \
+    static void NAME(int start, int end) { \
+        renderColumnSpan(start, end, TEXTURED, DISTORTED, INDEXED); \
+    }
+
+DEFINE_COLUMN_RENDERER(renderFlatColumns,                     FALSE, FALSE, FALSE)
+DEFINE_COLUMN_RENDERER(renderDistortedFlatColumns,            FALSE, TRUE,  FALSE)
+DEFINE_COLUMN_RENDERER(renderTexturedColumns,                 TRUE,  FALSE, FALSE)
+DEFINE_COLUMN_RENDERER(renderDistortedTexturedColumns,        TRUE,  TRUE,  FALSE)
+DEFINE_COLUMN_RENDERER(renderIndexedFlatColumns,              FALSE, FALSE, TRUE)
+DEFINE_COLUMN_RENDERER(renderDistortedIndexedFlatColumns,     FALSE, TRUE,  TRUE)
+DEFINE_COLUMN_RENDERER(renderIndexedTexturedColumns,          TRUE,  FALSE, TRUE)
+DEFINE_COLUMN_RENDERER(renderDistortedIndexedTexturedColumns, TRUE,  TRUE,  TRUE)
+
+/* Column renderers indexed by [indexed][textured][distorted] */
+static const ColumnRenderer columnRenderers[2][2][2] = {
+    {{renderFlatColumns,        renderDistortedFlatColumns},
+     {renderTexturedColumns,    renderDistortedTexturedColumns}},
+    {{renderIndexedFlatColumns,     renderDistortedIndexedFlatColumns},
+     {renderIndexedTexturedColumns, renderDistortedIndexedTexturedColumns}}
+};
+
+ColumnRenderer getColumnRenderer(char textured, char distorted) {
+    return columnRenderers[FALSE][textured != 0][distorted != 0];
+}
+
+ColumnRenderer getIndexedColumnRenderer(char textured, char distorted) {
+    return columnRenderers[TRUE][textured != 0][distorted != 0];
+}
+
+/*========================================================
+ * Tiled rendering
+ *========================================================
+ */
+
+/*
+ * The column renderers above draw each column from top to bottom, so at
+ * high resolutions every column touches a cache line per row, and those
+ * lines are evicted before the neighbouring columns reuse them. The tiled
+ * renderer instead walks the screen in bands of TILE_HEIGHT rows, drawing
+ * the part of each column that falls in the band, TILE_WIDTH columns at a
+ * time. A tile's framebuffer lines and texture rows stay in cache while
+ * all of its columns are drawn. Tiles are independent, so a column range
+ * aligned to TILE_WIDTH can be handed to another thread.
+ */
+
+static TileColumn tileColumns[VIEWPLANE_LENGTH];
+
+void prepareTileColumn(TileColumn* column, int height, float wallYStart, float length, int textureX,
+                       const WallTexture* texture, Uint32 color, char shaded) {
+    findStripSpans(height, wallYStart, length, &column->wallStart, &column->floorStart);
+    column->length = length;
+    column->texels = texture ? texture->pixels + textureX : NULL;
+    column->texelStride = texture ? texture->width : 0;
+    column->texelShift = texture ? texture->widthShift : 0;
+    column->textureHeight = texture ? texture->height : 1;
+    column->color = shaded ? DARKEN_COLOR(color) : color;
+    column->shaded = shaded;
+}
+
+/* Draw rows [y, end) of a column's wall span, matching fillTexturedSpan */
+ALWAYS_INLINE void fillTileTexels(Uint32* dst, int pitch, int height, int y, int end, const TileColumn* column,
+                                  const int powerOfTwo, const int shaded) {
+    const Uint32* texels = column->texels;
+    float scale = (float)(column->textureHeight-EPS), length = column->length;
+    int lastRow = column->textureHeight - 1, stride = column->texelStride, shift = column->texelShift;
+
+    for(; y < end; y++, dst += pitch) {
+        float d = y - (height / 2.0f) + length / 2.0f;
+        int row = MIN((int)(d * scale / length), lastRow);
+        Uint32 texel = texels[powerOfTwo ? (row << shift) : (row * stride)];
+
+        *dst = shaded ? DARKEN_COLOR(texel) : texel;
     }
+}
+
+/* Draw rows [rowStart, rowEnd) of a column, matching fillStrip */
+ALWAYS_INLINE void fillTileColumn(Uint32* dst, int pitch, int height, int rowStart, int rowEnd, const TileColumn* column,
+                                  const int shaded) {
+    int y = rowStart;
+    int wallStart = MIN(MAX(column->wallStart, rowStart), rowEnd);
+    int floorStart = MIN(MAX(column->floorStart, rowStart), rowEnd);
 
-    for(i = 0; i < WINDOW_WIDTH; i++) {
+    for(; y < wallStart; y++, dst += pitch)
+        *dst = CEILING_COLOR;
+
+    if(column->texels) {
+        if(column->texelShift >= 0)
+            fillTileTexels(dst, pitch, height, y, floorStart, column, TRUE, shaded);
+        else
+            fillTileTexels(dst, pitch, height, y, floorStart, column, FALSE, shaded);
+        dst += (floorStart - y) * pitch;
+        y = floorStart;
+    } else {
+        for(; y < floorStart; y++, dst += pitch)
+            *dst = column->color;
+    }
+
+    for(; y < rowEnd; y++, dst += pitch)
+        *dst = FLOOR_COLOR;
+}
+
+/*
+ * Within a tile, the gather kernel draws 8 adjacent columns a row at a
+ * time: each lane computes its column's texture row, the texels of all
+ * 8 columns are gathered at once, shaded with vector ops, and the
+ * ceiling and floor lanes are blended in before a single 8 pixel store.
+ * The gather addresses texels as 32-bit offsets from one column's
+ * texels, so it only takes groups whose textures lie within reach of
+ * each other (always the case for the pooled or packed wall textures).
+ * Texel rows are found by shifting when every lane's texture has a power
+ * of two width, and by multiplying otherwise.
+ */
+static signed char gatherSampling = -1;
+
+#ifdef HAVE_AVX2_GATHER
+/* Draw rows [rowStart, rowEnd) of 8 adjacent columns, matching fillTileColumn. Returns zero if the group can't be gathered. */
+__attribute__((target("avx2")))
+static int fillTileColumnsAVX2(Uint32* dst, int pitch, int height, int rowStart, int rowEnd, const TileColumn* columns) {
+    const Uint32* base = NULL;
+    int offsets[8], wallStarts[8], floorStarts[8], textured[8], shaded[8], strides[8], shifts[8], lastRows[8];
+    float lengths[8], scales[8];
+    int lane, y, powerOfTwo = TRUE;
+    __m256i laneOffsets, wallStart, floorStart, texturedLanes, shadedLanes, flatColors, stride, shift, lastRow;
+    __m256 halfLength, length, scale;
+
+    for(lane = 0; lane < 8; lane++) {
+        const TileColumn* column = &columns[lane];
+        intptr_t offset = 0;
+
+        if(column->texels) {
+            if(!base)
+                base = column->texels;
+            offset = ((intptr_t)column->texels - (intptr_t)base) / (intptr_t)sizeof(Uint32);
+            if(offset < INT32_MIN || offset > INT32_MAX - column->texelStride * column->textureHeight)
+                return FALSE;
+            if(column->texelShift < 0)
+                powerOfTwo = FALSE;
+        }
+
+        offsets[lane] = (int)offset;
+        wallStarts[lane] = column->wallStart;
+        floorStarts[lane] = column->floorStart;
+        textured[lane] = column->texels ? -1 : 0;
+        shaded[lane] = (column->texels && column->shaded) ? -1 : 0;
+        strides[lane] = column->texelStride;
+        shifts[lane] = MAX(column->texelShift, 0);
+        lastRows[lane] = column->textureHeight - 1;
+        lengths[lane] = column->length;
+        scales[lane] = (float)(column->textureHeight-EPS);
+    }
+
+    laneOffsets = _mm256_loadu_si256((const __m256i*)offsets);
+    stride = _mm256_loadu_si256((const __m256i*)strides);
+    shift = _mm256_loadu_si256((const __m256i*)shifts);
+    lastRow = _mm256_loadu_si256((const __m256i*)lastRows);
+    scale = _mm256_loadu_ps(scales);
+    wallStart = _mm256_loadu_si256((const __m256i*)wallStarts);
+    floorStart = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)floorStarts), _mm256_set1_epi32(1));
+    texturedLanes = _mm256_loadu_si256((const __m256i*)textured);
+    shadedLanes = _mm256_loadu_si256((const __m256i*)shaded);
+    flatColors = _mm256_setr_epi32(columns[0].color, columns[1].color, columns[2].color, columns[3].color,
+                                   columns[4].color, columns[5].color, columns[6].color, columns[7].color);
+    length = _mm256_loadu_ps(lengths);
+    halfLength = _mm256_div_ps(length, _mm256_set1_ps(2.0f));
+
+    for(y = rowStart; y < rowEnd; y++, dst += pitch) {
+        __m256i row = _mm256_set1_epi32(y);
+        __m256i ceilingLanes = _mm256_cmpgt_epi32(wallStart, row);
+        __m256i floorLanes = _mm256_cmpgt_epi32(row, floorStart);
+        __m256i gatherLanes = _mm256_andnot_si256(_mm256_or_si256(ceilingLanes, floorLanes), texturedLanes);
+        __m256i pixels = flatColors;
+
+        if(!_mm256_testz_si256(gatherLanes, gatherLanes)) {
+            /* The same float operations as the scalar kernels, so the texel rows match exactly */
+            __m256 d = _mm256_add_ps(_mm256_sub_ps(_mm256_set1_ps((float)y), _mm256_set1_ps(height / 2.0f)), halfLength);
+            __m256 ty = _mm256_div_ps(_mm256_mul_ps(d, scale), length);
+            __m256i texelRow = _mm256_min_epi32(_mm256_cvttps_epi32(ty), lastRow);
+            __m256i index = _mm256_add_epi32(laneOffsets, powerOfTwo ? _mm256_sllv_epi32(texelRow, shift)
+                                                                     : _mm256_mullo_epi32(texelRow, stride));
+            __m256i darkened;
+
+            pixels = _mm256_mask_i32gather_epi32(flatColors, (const int*)base, index, gatherLanes, 4);
+            darkened = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(pixels, 1), _mm256_set1_epi32(0x7F7F7F7F)),
+                                       _mm256_set1_epi32((int)0xFF000000));
+            pixels = _mm256_blendv_epi8(pixels, darkened, shadedLanes);
+        }
+
+        pixels = _mm256_blendv_epi8(pixels, _mm256_set1_epi32((int)CEILING_COLOR), ceilingLanes);
+        pixels = _mm256_blendv_epi8(pixels, _mm256_set1_epi32((int)FLOOR_COLOR), floorLanes);
+        _mm256_storeu_si256((__m256i*)dst, pixels);
+    }
+
+    return TRUE;
+}
+#endif
+
+int setGatherSampling(char enabled) {
+    gatherSampling = FALSE;
+#ifdef HAVE_AVX2_GATHER
+    if(enabled && SDL_HasAVX2())
+        gatherSampling = TRUE;
+#endif
+
+    return gatherSampling;
+}
+
+void renderTiles(Uint32* buffer, int pitch, int height, const TileColumn* columns, int start, int end) {
+    int rowStart, tileStart, x;
+
+    if(gatherSampling < 0)
+        setGatherSampling(TRUE);
+
+    for(rowStart = 0; rowStart < height; rowStart += TILE_HEIGHT) {
+        int rowEnd = MIN(rowStart + TILE_HEIGHT, height);
+        Uint32* row = buffer + (size_t)rowStart * pitch;
+
+        for(tileStart = start; tileStart < end; tileStart += TILE_WIDTH) {
+            int tileEnd = MIN(tileStart + TILE_WIDTH, end);
+
+            x = tileStart;
+#ifdef HAVE_AVX2_GATHER
+            for(; gatherSampling && x + 8 <= tileEnd; x += 8)
+                if(!fillTileColumnsAVX2(row + x, pitch, height, rowStart, rowEnd, &columns[x]))
+                    break;
+#endif
+
+            /* Columns left over, or in groups that could not be gathered */
+            for(; x < tileEnd; x++) {
+                if(columns[x].shaded)
+                    fillTileColumn(row + x, pitch, height, rowStart, rowEnd, &columns[x], TRUE);
+                else
+                    fillTileColumn(row + x, pitch, height, rowStart, rowEnd, &columns[x], FALSE);
+            }
+        }
+    }
+}
+
+/* Prepare the tile columns for a span of screen columns, then draw them tile by tile */
+ALWAYS_INLINE void renderTiledColumnSpan(int start, int end, const int textured, const int distorted) {
+    int i;
+    Vector2f origin = vector3fTo2f(&playerPos);
+    Vector2f viewplaneNorm = normalizeVector2f(vector3fTo2f(&viewplaneDir));
+
+    for(i = start; i < end; i++) {
+        ColumnHit* hit = &columnHits[i];
+        int wallType;
+        float drawLength = columnDrawLength(hit, viewplaneNorm, &wallType, distorted);
+
+        /* Horizontal hits are shaded when textured, vertical hits when untextured */
+        if(textured)
+            prepareTileColumn(&tileColumns[i], WINDOW_HEIGHT, (WINDOW_HEIGHT / 2.0f) - (drawLength / 2.0f), drawLength,
+                    textureColumnForRay(origin, hit->ray, hit->rtype, &TEXTURES[wallType - 1]), &TEXTURES[wallType - 1], 0,
+                    hit->rtype == HORIZONTAL_RAY);
+        else
+            prepareTileColumn(&tileColumns[i], WINDOW_HEIGHT, (WINDOW_HEIGHT / 2.0f) - (drawLength / 2.0f), drawLength,
+                    0, NULL, COLORS[wallType - 1], hit->rtype != HORIZONTAL_RAY);
+    }
+
+    renderTiles(screenBuffer, WINDOW_WIDTH, WINDOW_HEIGHT, tileColumns, start, end);
+}
+
+#define DEFINE_TILED_COLUMN_RENDERER(NAME, TEXTURED, DISTORTED) \
+    static void NAME(int start, int end) { \
+        renderTiledColumnSpan(start, end, TEXTURED, DISTORTED); \
+    }
+
+DEFINE_TILED_COLUMN_RENDERER(renderTiledFlatColumns,              FALSE, FALSE)
+DEFINE_TILED_COLUMN_RENDERER(renderTiledDistortedFlatColumns,     FALSE, TRUE)
+DEFINE_TILED_COLUMN_RENDERER(renderTiledTexturedColumns,          TRUE,  FALSE)
+DEFINE_TILED_COLUMN_RENDERER(renderTiledDistortedTexturedColumns, TRUE,  TRUE)
+
+/* Tiled column renderers indexed by [textured][distorted] */
+static const ColumnRenderer tiledColumnRenderers[2][2] = {
+    {renderTiledFlatColumns,     renderTiledDistortedFlatColumns},
+    {renderTiledTexturedColumns, renderTiledDistortedTexturedColumns}
+};
+
+ColumnRenderer getTiledColumnRenderer(char textured, char distorted) {
+    return tiledColumnRenderers[textured != 0][distorted != 0];
+}
+
+/*========================================================
+ * Ray cost heatmap
+ *========================================================
+ */
+
+Uint32 getColumnCostColor(int column) {
+    const ColumnCost* cost = &columnCosts[column];
+    float t;
+    int r, g, b;
+
+    /* Columns that were reprojected or interpolated this frame cost nothing */
+    if(cost->frame != raycasterFrame)
+        t = 0;
+    else if(rayCostMode == RAY_COST_TIME)
+        t = cost->nanoseconds / (float)HEATMAP_MAX_NS;
+    else
+        t = (cost->verticalSteps + cost->horizontalSteps) / (float)HEATMAP_MAX_STEPS;
+    t = MIN(MAX(t, 0.0f), 1.0f);
+
+    /* Blue through green and yellow to red */
+    if(t < 1.0f / 3.0f) {
+        r = 0;
+        g = (int)(t * 3 * 255);
+        b = 255 - g;
+    } else if(t < 2.0f / 3.0f) {
+        r = (int)((t - 1.0f / 3.0f) * 3 * 255);
+        g = 255;
+        b = 0;
+    } else {
+        r = 255;
+        g = 255 - (int)((t - 2.0f / 3.0f) * 3 * 255);
+        b = 0;
+    }
+
+    return RGBtoABGR(r, g, b);
+}
+
+/* Draw each column's wall in the color of its traversal cost */
+static void renderCostColumns(int start, int end) {
+    int i;
+    Vector2f viewplaneNorm = normalizeVector2f(vector3fTo2f(&viewplaneDir));
+
+    for(i = start; i < end; i++) {
+        int wallType;
+        float drawLength = distortion ? columnDrawLength(&columnHits[i], viewplaneNorm, &wallType, TRUE)
+                                      : columnDrawLength(&columnHits[i], viewplaneNorm, &wallType, FALSE);
+
+        stripKernels[FALSE][FALSE](screenBuffer + i, WINDOW_WIDTH, WINDOW_HEIGHT, (WINDOW_HEIGHT / 2.0f) - (drawLength / 2.0f),
+                drawLength, 0, NULL, getColumnCostColor(i));
+    }
+}
+
+void renderReferenceColumns(int start, int end) {
+    int i;
+
+    for(i = start; i < end; i++) {
         int textureX = 0;
         int mapx, mapy;
         float drawLength;
@@ -112,9 +716,6 @@ void renderProjectedScene() {
             mapy = coords.y;
         }
 
-        if(textureMode)
-            textureX = getTextureColumnNumberForRay(&ray, rtype);
-
         if(distortion)
             drawLength = calculateDrawHeight(homogeneousVectorMagnitude(&ray));
         else
@@ -124,7 +725,8 @@ void renderProjectedScene() {
             int texnum = MAP[mapy][mapx];
             if(texnum < 1 || texnum > 4)
                 texnum = 4;
-            drawTexturedStrip(i, (WINDOW_HEIGHT / 2.0f) - (drawLength / 2.0f), drawLength, textureX, TEXTURES[texnum - 1], rtype == HORIZONTAL_RAY);
+            textureX = getTextureColumnNumberForRay(&ray, rtype, &TEXTURES[texnum - 1]);
+            drawTexturedStrip(i, (WINDOW_HEIGHT / 2.0f) - (drawLength / 2.0f), drawLength, textureX, &TEXTURES[texnum - 1], rtype == HORIZONTAL_RAY);
 
         } else {
             int color = MAP[mapy][mapx];
@@ -132,15 +734,337 @@ void renderProjectedScene() {
                 color = 4;
             drawUntexturedStrip(i, (WINDOW_HEIGHT / 2.0f) - (drawLength / 2.0f), drawLength, COLORS[color - 1], rtype == HORIZONTAL_RAY);
         }
-        if (slowRenderMode) {
+    }
+}
+
+void resolveColumnHits(int start, int end) {
+    int i;
+    Vector2f origin = vector3fTo2f(&playerPos);
+
+    for(i = start; i < end; i++) {
+        ColumnHit* hit = &columnHits[i];
+        Vector2f hRay = vector3fTo2f(&rays[i].hRay);
+        Vector2f vRay = vector3fTo2f(&rays[i].vRay);
+
+        if(vector2fMagnitude(hRay) < vector2fMagnitude(vRay)) {
+            hit->ray = hRay;
+            hit->rtype = HORIZONTAL_RAY;
+            findHorizontalRayTile(origin, hRay, &hit->tileX, &hit->tileY);
+        } else {
+            hit->ray = vRay;
+            hit->rtype = VERTICAL_RAY;
+            findVerticalRayTile(origin, vRay, &hit->tileX, &hit->tileY);
+        }
+    }
+}
+
+/*
+ * Scatter the previous frame's cast hits into the columns that were not
+ * cast this frame. Each hit point is projected onto the current viewplane
+ * and lands in the nearest uncast column, keeping the nearest hit. Hits
+ * that land in a column directly win over those moved there from a cast
+ * column, so a camera that holds still draws what a full cast would.
+ */
+static void reprojectPreviousHits(Vector2f origin) {
+    int i;
+    Vector2f dir = normalizeVector2f(vector3fTo2f(&playerDir));
+    Vector2f viewplane = normalizeVector2f(vector3fTo2f(&viewplaneDir));
+
+    for(i = 0; i < VIEWPLANE_LENGTH; i++) {
+        Vector2f hitPos, ray;
+        float depth, x;
+        int col, moved = FALSE;
+
+        if(!previousHitWasCast[i])
+            continue;
+
+        hitPos = vector2fAdd(previousOrigin, previousHits[i].ray);
+        ray = vector2fSubtract(hitPos, origin);
+        depth = vector2fDotProduct(ray, dir);
+        if(depth <= 0)
+            continue;
+
+        /* Column whose ray passes through the hit point */
+        x = (VIEWPLANE_LENGTH / 2) + distFromViewplane * vector2fDotProduct(ray, viewplane) / depth;
+        if(x < -0.5f || x >= VIEWPLANE_LENGTH - 0.5f)
+            continue;
+
+        col = (int)floorf(x + 0.5f);
+        if(columnWasCast[col]) {
+            if(x < col && col > 0 && !columnWasCast[col - 1])
+                col--;
+            else if(col < VIEWPLANE_LENGTH - 1 && !columnWasCast[col + 1])
+                col++;
+            else if(col > 0 && !columnWasCast[col - 1])
+                col--;
+            else
+                continue;
+            moved = TRUE;
+        }
+
+        if(moved < reprojectedHitMoved[col] || (moved == reprojectedHitMoved[col] && depth < reprojectedDepth[col])) {
+            reprojectedDepth[col] = depth;
+            reprojectedHitMoved[col] = moved;
+            columnHits[col] = previousHits[i];
+            columnHits[col].ray = ray;
+        }
+    }
+}
+
+/*
+ * Check whether the columns between two sampled columns can be
+ * interpolated: both samples must hit the same side of the same tile,
+ * without a large jump in depth between them.
+ */
+static int sampleHitsMatch(ColumnHit* a, ColumnHit* b, Vector2f dir) {
+    float depthA = vector2fDotProduct(a->ray, dir);
+    float depthB = vector2fDotProduct(b->ray, dir);
+
+    return a->rtype == b->rtype && a->tileX == b->tileX && a->tileY == b->tileY &&
+        fabs(depthA - depthB) <= ADAPTIVE_DEPTH_THRESHOLD * MIN(depthA, depthB);
+}
+
+/*
+ * Fill the columns between two matching samples by intersecting their
+ * rays with the wall face through both sample hit points. This
+ * interpolates the hit along the face, so distance and texture column
+ * stay perspective correct. Returns zero if a ray runs parallel to the face.
+ */
+static int interpolateColumnHits(int a, int b) {
+    int i;
+    Vector2f v1 = vector2fScale(vector3fTo2f(&playerDir), distFromViewplane);
+    Vector2f viewplane = vector3fTo2f(&viewplaneDir);
+    Vector2f face = vector2fSubtract(columnHits[b].ray, columnHits[a].ray);
+    float faceOffset = columnHits[a].ray.x * face.y - columnHits[a].ray.y * face.x;
+
+    for(i = a + 1; i < b; i++) {
+        Vector2f dir = vector2fSubtract(v1, vector2fScale(viewplane, ((VIEWPLANE_LENGTH / 2) - i)));
+        float denom = dir.x * face.y - dir.y * face.x;
+
+        if(fabs(denom) < EPS)
+            return FALSE;
+
+        columnHits[i] = columnHits[a];
+        columnHits[i].ray = vector2fScale(dir, faceOffset / denom);
+    }
+
+    return TRUE;
+}
+
+/*
+ * Resolve the columns of an adaptive frame. The columns between two
+ * samples are interpolated if the samples match, and cast otherwise.
+ */
+static void refineAdaptiveColumns() {
+    int a, b;
+    Vector2f dir = normalizeVector2f(vector3fTo2f(&playerDir));
+
+    for(a = 0; a < VIEWPLANE_LENGTH - 1; a = b) {
+        b = MIN(a + castColumnStep, VIEWPLANE_LENGTH - 1);
+
+        if(a == 0)
+            resolveColumnHits(a, a + 1);
+        resolveColumnHits(b, b + 1);
+
+        if(b - a > 1 && (!sampleHitsMatch(&columnHits[a], &columnHits[b], dir) || !interpolateColumnHits(a, b))) {
+            castColumns(a + 1, b, 1);
+            resolveColumnHits(a + 1, b);
+        }
+    }
+}
+
+/*
+ * Resolve the column hits for the frame. Columns that the raycaster did
+ * not cast are either refined between adaptive samples, or reprojected
+ * from the previous frame if it was the frame immediately before this
+ * one, and cast now if nothing lands in them.
+ */
+static void resolveProjectedColumns() {
+    int i;
+    Vector2f origin = vector3fTo2f(&playerPos);
+
+    if(castPattern == FULL_CAST) {
+        resolveColumnHits(0, VIEWPLANE_LENGTH);
+        memset(columnWasCast, TRUE, sizeof(columnWasCast));
+    } else if(castPattern == ADAPTIVE_CAST) {
+        refineAdaptiveColumns();
+
+        /* Interpolated hits are as good as cast ones for reprojection */
+        memset(columnWasCast, TRUE, sizeof(columnWasCast));
+    } else {
+        for(i = 0; i < VIEWPLANE_LENGTH; i++) {
+            columnWasCast[i] = FALSE;
+            reprojectedDepth[i] = HUGE_VAL;
+            reprojectedHitMoved[i] = TRUE;
+        }
+        for(i = castColumnStart; i < VIEWPLANE_LENGTH; i += castColumnStep) {
+            resolveColumnHits(i, i + 1);
+            columnWasCast[i] = TRUE;
+        }
+
+        if(previousHitsFrame + 1 == raycasterFrame)
+            reprojectPreviousHits(origin);
+
+        for(i = 0; i < VIEWPLANE_LENGTH; i++) {
+            if(!columnWasCast[i] && reprojectedDepth[i] == HUGE_VAL) {
+                castColumns(i, i + 1, 1);
+                resolveColumnHits(i, i + 1);
+                columnWasCast[i] = TRUE;
+            }
+        }
+    }
+
+    /* Keep this frame's hits around for reprojection into the next */
+    memcpy(previousHits, columnHits, sizeof(columnHits));
+    memcpy(previousHitWasCast, columnWasCast, sizeof(columnWasCast));
+    previousOrigin = origin;
+    previousHitsFrame = raycasterFrame;
+}
+
+/* Mark a span of drawn columns to be uploaded with the next displayed frame */
+static void markColumnsDirty(int start, int end) {
+    markTextureDirty(screenBuffer, start, 0, end - start, WINDOW_HEIGHT);
+}
+
+/* Returns the slot of a buffer's drawn frame, taking over the oldest slot for a new buffer */
+static int findDrawnSlot(Uint32* buffer, int* isNew) {
+    int slot;
+
+    for(slot = 0; slot < DRAWN_BUFFERS; slot++) {
+        if(drawnFrames[slot].buffer == buffer) {
+            *isNew = FALSE;
+            return slot;
+        }
+    }
+
+    slot = nextDrawnSlot;
+    nextDrawnSlot = (nextDrawnSlot + 1) % DRAWN_BUFFERS;
+    drawnFrames[slot].buffer = buffer;
+    *isNew = TRUE;
+    return slot;
+}
+
+static int sameHit(const ColumnHit* a, const ColumnHit* b) {
+    return a->rtype == b->rtype && a->tileX == b->tileX && a->tileY == b->tileY &&
+        fabs(a->ray.x - b->ray.x) <= HIT_EPSILON && fabs(a->ray.y - b->ray.y) <= HIT_EPSILON;
+}
+
+/*
+ * Mark the columns of the frame just drawn that changed since the frame
+ * last uploaded from the screen buffer. Every column is marked if the
+ * camera moved or the draw modes changed; otherwise only the columns
+ * whose wall hit moved are, so that casting the same frame again, as a
+ * still camera does in any cast pattern, uploads nothing.
+ *
+ * all: Non-zero to mark every column regardless.
+ */
+static void markChangedColumns(int all) {
+    int isNew, slot = findDrawnSlot(screenBuffer, &isNew);
+    int i, start = -1;
+
+    all = all || isNew || drawnFrames[slot].distFromViewplane != distFromViewplane ||
+        drawnFrames[slot].pos.x != playerPos.x || drawnFrames[slot].pos.y != playerPos.y ||
+        drawnFrames[slot].dir.x != playerDir.x || drawnFrames[slot].dir.y != playerDir.y ||
+        drawnFrames[slot].viewplaneDir.x != viewplaneDir.x || drawnFrames[slot].viewplaneDir.y != viewplaneDir.y ||
+        drawnFrames[slot].textureMode != textureMode || drawnFrames[slot].distortion != distortion ||
+        drawnFrames[slot].palettizedMode != palettizedMode || drawnFrames[slot].rayCostMode != rayCostMode;
+
+    if(all) {
+        markColumnsDirty(0, WINDOW_WIDTH);
+        memcpy(drawnFrames[slot].hits, columnHits, sizeof(columnHits));
+        drawnFrames[slot].pos = playerPos;
+        drawnFrames[slot].dir = playerDir;
+        drawnFrames[slot].viewplaneDir = viewplaneDir;
+        drawnFrames[slot].distFromViewplane = distFromViewplane;
+        drawnFrames[slot].textureMode = textureMode;
+        drawnFrames[slot].distortion = distortion;
+        drawnFrames[slot].palettizedMode = palettizedMode;
+        drawnFrames[slot].rayCostMode = rayCostMode;
+        return;
+    }
+
+    /* Unmarked columns keep the hits they were uploaded with, so small moves can't add up */
+    for(i = 0; i <= VIEWPLANE_LENGTH; i++) {
+        if(i < VIEWPLANE_LENGTH && !sameHit(&columnHits[i], &drawnFrames[slot].hits[i])) {
+            drawnFrames[slot].hits[i] = columnHits[i];
+            if(start < 0)
+                start = i;
+        } else if(start >= 0) {
+            markColumnsDirty(start, i);
+            start = -1;
+        }
+    }
+}
+
+void drawProjectedScene() {
+    /* Select the column renderer for the current modes once per frame */
+    ColumnRenderer renderColumns = tiledMode ? getTiledColumnRenderer(textureMode, distortion)
+                                             : getColumnRenderer(textureMode, distortion);
+
+    if(rayCostMode) {
+        resolveProjectedColumns();
+        renderCostColumns(0, WINDOW_WIDTH);
+        markChangedColumns(TRUE);
+        return;
+    }
+
+    if(palettizedMode && indexedScreenBuffer) {
+        /* Draw 8-bit palette indices, and expand them to ABGR once per frame */
+        renderColumns = getIndexedColumnRenderer(textureMode, distortion);
+        resolveProjectedColumns();
+        renderColumns(0, WINDOW_WIDTH);
+        expandIndexedPixels(indexedScreenBuffer, screenBuffer, WINDOW_WIDTH * WINDOW_HEIGHT);
+        markChangedColumns(FALSE);
+        return;
+    }
+
+    resolveProjectedColumns();
+    renderColumns(0, WINDOW_WIDTH);
+    markChangedColumns(FALSE);
+}
+
+void renderProjectedScene() {
+    Uint64 drawStart = SDL_GetPerformanceCounter(), presentStart;
+    TRACE_BEGIN(renderProjectedScene);
+
+    if (slowRenderMode) {
+        ColumnRenderer renderColumns = getColumnRenderer(textureMode, distortion);
+        int i, x, y;
+
+        for(x = 0; x < WINDOW_WIDTH; x++)
+            for(y = 0; y < WINDOW_HEIGHT; y++)
+                screenBuffer[(WINDOW_WIDTH * y) + x] = 0xFFFFFFFF;
+        markColumnsDirty(0, WINDOW_WIDTH);
+
+        /* After the first upload, only the column drawn since the last one is uploaded */
+        resolveProjectedColumns();
+        for(i = 0; i < WINDOW_WIDTH; i++) {
+            renderColumns(i, i + 1);
+            markColumnsDirty(i, i + 1);
             clearRenderer();
             displayFullscreenTexture(screenBuffer);
             SDL_Delay(2);
         }
-    }
-    if (slowRenderMode)
         slowRenderMode = 0;
+    } else {
+        TRACE_BEGIN(drawProjectedScene);
+        drawProjectedScene();
+        TRACE_END(drawProjectedScene);
+    }
+    recordHudStage(HUD_DRAW, drawStart);
+    recordHudRays();
+
+    if(hudMode) {
+        TRACE_BEGIN(drawHud);
+        drawHud(screenBuffer);
+        TRACE_END(drawHud);
+    } else {
+        eraseHud(screenBuffer);
+    }
 
+    presentStart = SDL_GetPerformanceCounter();
     clearRenderer();
     displayFullscreenTexture(screenBuffer);
+    recordHudStage(HUD_PRESENT, presentStart);
+    TRACE_END(renderProjectedScene);
 }
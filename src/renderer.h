@@ -1,17 +1,60 @@
 #ifndef RENDERER_H
 #define RENDERER_H
 
+#include "config.h"
 #include "gfx.h"
 #include "linalg.h"
+#include "vector2f.h"
 
 /* Macros */
 #define XY_TO_SCREEN_INDEX(X, Y)   (((Y) * WINDOW_WIDTH) + (X))
-#define XY_TO_TEXTURE_INDEX(X, Y)   (((Y) * TEXTURE_SIZE) + (X))
+#define XY_TO_TEXEL_INDEX(T, X, Y)  (((Y) * (T)->width) + (X))
 #define DARKEN_COLOR(C)     ((((C) >> 1) & 0x7F7F7F7F) | 0xFF000000)
 
 /* Enums */
 typedef enum {HORIZONTAL_RAY, VERTICAL_RAY} RayType;
 
+/* Datatypes */
+
+/* The wall hit drawn in a screen column */
+typedef struct {
+    Vector2f ray;   /* From the player to the hit point */
+    int tileX;
+    int tileY;
+    RayType rtype;
+} ColumnHit;
+
+/* Renders the screen columns in the range [start, end) from their column hits */
+typedef void (*ColumnRenderer)(int start, int end);
+
+/*
+ * Draws a strip of 'height' pixels, 'pitch' pixels apart, starting at dst:
+ * ceiling, then wall from wallYStart for 'length' pixels, then floor.
+ * Textured kernels sample column textureX of 'texture', flat kernels use 'color'.
+ */
+typedef void (*StripKernel)(Uint32* dst, int pitch, int height, float wallYStart, float length, int textureX,
+                            const WallTexture* texture, Uint32 color);
+
+/* The palettized counterpart of StripKernel, drawing palette indices from the texture's indexedPixels */
+typedef void (*IndexedStripKernel)(Uint8* dst, int pitch, int height, float wallYStart, float length, int textureX,
+                                   const WallTexture* texture, Uint8 color);
+
+/* A column prepared for the tiled renderer: its spans, and its wall's texture column or color */
+typedef struct {
+    int wallStart;      /* First wall row */
+    int floorStart;     /* First floor row */
+    float length;       /* Wall length in pixels, to map rows to texels */
+    Uint32* texels;     /* Top texel of the texture column, NULL for a flat wall */
+    int texelStride;    /* Distance between texels of the column, the texture's width */
+    int texelShift;     /* The texture's widthShift */
+    int textureHeight;
+    Uint32 color;       /* Flat wall color, already shaded */
+    char shaded;
+} TileColumn;
+
+/* Global data */
+extern ColumnHit columnHits[VIEWPLANE_LENGTH];
+
 /* Functions */
 
 /**
@@ -24,6 +67,16 @@ typedef enum {HORIZONTAL_RAY, VERTICAL_RAY} RayType;
  */
 float calculateDrawHeight(float rayLength);
 
+/**
+ * Set up a wall texture descriptor.
+ *
+ * texture: The descriptor to set up. Its indexed pixels are cleared.
+ * pixels:  The texture's pixels, row by row.
+ * width:   The width of the texture in pixels.
+ * height:  The height of the texture in pixels.
+ */
+void initWallTexture(WallTexture* texture, Uint32* pixels, int width, int height);
+
 /**
  * Draw a textured pixel column on the screen.
  *
@@ -34,7 +87,7 @@ float calculateDrawHeight(float rayLength);
  * texture:    The texture to use.
  * darken:     Non-zero if the strip should be darkened, zero otherwise.
  */
-void drawTexturedStrip(int x, float wallYStart, float length, int textureX, Uint32* texture, char darken);
+void drawTexturedStrip(int x, float wallYStart, float length, int textureX, const WallTexture* texture, char darken);
 
 /**
  * Draw an un-textured pixel column on the screen.
@@ -50,12 +103,13 @@ void drawUntexturedStrip(int x, float wallYStart, float length, Uint32 ABGRColor
 /**
  * Find the texture column number to use for a given ray.
  *
- * ray:   The ray to use.
- * rtype: The type of ray intersection (see above definition of RayType)
+ * ray:     The ray to use.
+ * rtype:   The type of ray intersection (see above definition of RayType)
+ * texture: The texture of the wall the ray hit.
  *
  * Returns: The texture column number to use.
  */
-int getTextureColumnNumberForRay(Vector3f* ray, RayType rtype);
+int getTextureColumnNumberForRay(Vector3f* ray, RayType rtype, const WallTexture* texture);
 
 /**
  * Get the barrel-distortion corrected ray length for a given ray.
@@ -66,6 +120,147 @@ int getTextureColumnNumberForRay(Vector3f* ray, RayType rtype);
  */
 float getUndistortedRayLength(Vector3f* ray);
 
+/**
+ * Resolve the column hits of a range of screen columns from their
+ * cast rays, picking the nearer of each column's two rays.
+ *
+ * start: The first column to resolve.
+ * end:   One past the last column to resolve.
+ */
+void resolveColumnHits(int start, int end);
+
+/**
+ * Get the column renderer specialized for a combination of render modes.
+ * Specialized renderers contain no per-column or per-pixel mode checks,
+ * so they should be selected once per frame.
+ *
+ * textured:  Non-zero for textured walls, zero for flat colored walls.
+ * distorted: Non-zero to skip barrel distortion correction, zero otherwise.
+ *
+ * Returns: The specialized column renderer.
+ */
+ColumnRenderer getColumnRenderer(char textured, char distorted);
+
+/**
+ * Get the palettized column renderer for a combination of render modes.
+ * It draws palette indices into indexedScreenBuffer instead of colors
+ * into screenBuffer.
+ *
+ * textured:  Non-zero for textured walls, zero for flat colored walls.
+ * distorted: Non-zero to skip barrel distortion correction, zero otherwise.
+ *
+ * Returns: The specialized column renderer.
+ */
+ColumnRenderer getIndexedColumnRenderer(char textured, char distorted);
+
+/**
+ * Get the strip kernel specialized for texturing and shading.
+ *
+ * textured: Non-zero for a textured wall, zero for a flat colored wall.
+ * shaded:   Non-zero to darken the wall, zero otherwise.
+ *
+ * Returns: The strip kernel.
+ */
+StripKernel getStripKernel(char textured, char shaded);
+
+/**
+ * Get the palettized strip kernel specialized for texturing and shading.
+ *
+ * textured: Non-zero for a textured wall, zero for a flat colored wall.
+ * shaded:   Non-zero to darken the wall through the shade remap table, zero otherwise.
+ *
+ * Returns: The strip kernel.
+ */
+IndexedStripKernel getIndexedStripKernel(char textured, char shaded);
+
+/**
+ * Get the tiled column renderer for a combination of render modes. It
+ * draws the same pixels as the column renderer from getColumnRenderer,
+ * tile by tile instead of column by column.
+ *
+ * textured:  Non-zero for textured walls, zero for flat colored walls.
+ * distorted: Non-zero to skip barrel distortion correction, zero otherwise.
+ *
+ * Returns: The tiled column renderer.
+ */
+ColumnRenderer getTiledColumnRenderer(char textured, char distorted);
+
+/**
+ * Prepare a column for the tiled renderer. The arguments match those of
+ * a StripKernel, and the column is drawn the same way.
+ *
+ * column:     Set to the prepared column.
+ * height:     The height of the buffer the column is drawn into.
+ * wallYStart: The first row of the wall.
+ * length:     The length of the wall in pixels.
+ * textureX:   The texture column to sample for a textured wall.
+ * texture:    The wall texture, or NULL for a flat colored wall.
+ * color:      The color of a flat wall.
+ * shaded:     Non-zero to darken the wall, zero otherwise.
+ */
+void prepareTileColumn(TileColumn* column, int height, float wallYStart, float length, int textureX,
+                       const WallTexture* texture, Uint32 color, char shaded);
+
+/**
+ * Draw prepared columns into a buffer in tiles of TILE_WIDTH columns by
+ * TILE_HEIGHT rows, band by band from the top. Column ranges that start
+ * on a multiple of TILE_WIDTH cover separate tiles, so they can be drawn
+ * by separate threads.
+ *
+ * buffer:  The buffer to draw into.
+ * pitch:   The distance between rows of the buffer in pixels.
+ * height:  The number of rows in the buffer.
+ * columns: The prepared columns, indexed by buffer column.
+ * start:   The first column to draw.
+ * end:     One past the last column to draw.
+ */
+void renderTiles(Uint32* buffer, int pitch, int height, const TileColumn* columns, int start, int end);
+
+/**
+ * Choose how the tiled renderer samples textures. By default it draws 8
+ * adjacent columns a row at a time with AVX2 gathers if the CPU supports
+ * them, and a column at a time with scalar loads otherwise. Both draw
+ * the same pixels.
+ *
+ * enabled: Non-zero to use the gather kernel where supported, zero to
+ *          always use the scalar kernel.
+ *
+ * Returns: Non-zero if the gather kernel is now used, zero otherwise.
+ */
+int setGatherSampling(char enabled);
+
+/**
+ * Get the heatmap color of a screen column's traversal cost this frame,
+ * by grid steps or by time depending on rayCostMode. Columns that were
+ * not cast this frame have no cost.
+ *
+ * column: The screen column.
+ *
+ * Returns: The column's color, from blue for no cost to red for the
+ *          cost of HEATMAP_MAX_STEPS steps or HEATMAP_MAX_NS nanoseconds.
+ */
+Uint32 getColumnCostColor(int column);
+
+/**
+ * Render a range of screen columns with the generic strip drawers,
+ * checking the render mode globals for every column. This is the
+ * reference output that the specialized column renderers must match.
+ *
+ * start: The first column to render.
+ * end:   One past the last column to render.
+ */
+void renderReferenceColumns(int start, int end);
+
+/**
+ * Draw the scene into the screen buffer without presenting it.
+ * This assumes that rays have already been cast. Columns that were not
+ * cast this frame are filled by reprojecting the previous frame's hits.
+ * In palettized mode the scene is drawn as palette indices and expanded
+ * into the screen buffer once it is complete. With rayCostMode set, each
+ * wall is drawn in the heatmap color of its column's traversal cost.
+ */
+void drawProjectedScene();
+
 /**
  * Render the scene.
  * This assumes that rays have already been cast.
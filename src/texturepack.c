@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "texturepack.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#else
+#include <malloc.h>
+#endif
+
+#define ALIGN_UP(N, A)  (((N) + (A) - 1) & ~(uint64_t)((A) - 1))
+
+
+/* Returns the number of mip levels down to 1 pixel along the shorter side */
+static uint32_t countMipLevels(uint32_t width, uint32_t height) {
+    uint32_t levels = 1;
+
+    while((width >> levels) && (height >> levels))
+        levels++;
+
+    return levels;
+}
+
+static uint64_t mipChainSize(uint32_t width, uint32_t height, uint32_t levels) {
+    uint64_t size = 0;
+    uint32_t level;
+
+    for(level = 0; level < levels; level++)
+        size += (uint64_t)(width >> level) * (height >> level) * sizeof(Uint32);
+
+    return size;
+}
+
+/* Check that the header and every entry describe data inside the pack */
+static int validateTexturePack(const TexturePack* pack) {
+    uint32_t i;
+
+    if(pack->size < sizeof(TexturePackHeader) || pack->header->magic != TEXTURE_PACK_MAGIC ||
+            pack->header->version != TEXTURE_PACK_VERSION || pack->header->byteOrder != TEXTURE_PACK_BYTE_ORDER)
+        return 0;
+
+    if(pack->header->textureCount > (pack->size - sizeof(TexturePackHeader)) / sizeof(TexturePackEntry))
+        return 0;
+
+    for(i = 0; i < pack->header->textureCount; i++) {
+        const TexturePackEntry* entry = &pack->entries[i];
+
+        /* Sizes are checked first, so that the mip arithmetic can't overflow */
+        if(!entry->width || !entry->height ||
+                entry->width > MAX_TEXTURE_SIZE || entry->height > MAX_TEXTURE_SIZE)
+            return 0;
+
+        if(!entry->mipLevels || entry->mipLevels > countMipLevels(entry->width, entry->height) ||
+                entry->offset % TEXTURE_PACK_ALIGNMENT ||
+                entry->size != mipChainSize(entry->width, entry->height, entry->mipLevels) ||
+                entry->offset > pack->size || entry->size > pack->size - entry->offset ||
+                !memchr(entry->name, '\0', TEXTURE_PACK_NAME_SIZE))
+            return 0;
+    }
+
+    return 1;
+}
+
+int openTexturePack(const char* path, TexturePack* pack) {
+    memset(pack, 0, sizeof(*pack));
+
+#ifndef _WIN32
+    {
+        struct stat info;
+        void* mapping;
+        int fd = open(path, O_RDONLY);
+
+        if(fd < 0)
+            return 0;
+
+        if(fstat(fd, &info) < 0 || !info.st_size) {
+            close(fd);
+            return 0;
+        }
+
+        mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(mapping == MAP_FAILED)
+            return 0;
+
+        pack->data = mapping;
+        pack->size = info.st_size;
+        pack->mapped = 1;
+    }
+#else
+    {
+        FILE* file = fopen(path, "rb");
+        long size;
+        unsigned char* data;
+
+        if(!file)
+            return 0;
+
+        fseek(file, 0, SEEK_END);
+        size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+
+        /* Allocated aligned so that the pixels keep their alignment */
+        data = (size > 0) ? _aligned_malloc(size, TEXTURE_PACK_ALIGNMENT) : NULL;
+        if(!data || fread(data, 1, size, file) != (size_t)size) {
+            _aligned_free(data);
+            fclose(file);
+            return 0;
+        }
+        fclose(file);
+
+        pack->data = data;
+        pack->size = size;
+    }
+#endif
+
+    pack->header = (const TexturePackHeader*)pack->data;
+    pack->entries = (const TexturePackEntry*)(pack->header + 1);
+
+    if(!validateTexturePack(pack)) {
+        closeTexturePack(pack);
+        return 0;
+    }
+
+    return 1;
+}
+
+void closeTexturePack(TexturePack* pack) {
+    if(!pack->data)
+        return;
+
+#ifndef _WIN32
+    munmap((void*)pack->data, pack->size);
+#else
+    _aligned_free((void*)pack->data);
+#endif
+
+    memset(pack, 0, sizeof(*pack));
+}
+
+int findPackTexture(const TexturePack* pack, const char* name) {
+    uint32_t i;
+
+    for(i = 0; i < pack->header->textureCount; i++)
+        if(!strncmp(pack->entries[i].name, name, TEXTURE_PACK_NAME_SIZE))
+            return i;
+
+    return -1;
+}
+
+const Uint32* getPackTexture(const TexturePack* pack, int index, int level) {
+    const TexturePackEntry* entry;
+
+    if(index < 0 || (uint32_t)index >= pack->header->textureCount)
+        return NULL;
+
+    entry = &pack->entries[index];
+    if(level < 0 || (uint32_t)level >= entry->mipLevels)
+        return NULL;
+
+    return (const Uint32*)(pack->data + entry->offset + mipChainSize(entry->width, entry->height, level));
+}
+
+
+/*========================================================
+ * Writing
+ *========================================================
+ */
+
+/* Average each 2x2 block of a mip level into the next one */
+static void downsampleMipLevel(const Uint32* src, int srcWidth, int srcHeight, Uint32* dst) {
+    int x, y, c, width = srcWidth / 2, height = srcHeight / 2;
+
+    for(y = 0; y < height; y++) {
+        for(x = 0; x < width; x++) {
+            const Uint32* p = src + (2 * y * srcWidth) + (2 * x);
+            Uint32 result = 0;
+
+            for(c = 0; c < 32; c += 8) {
+                Uint32 sum = ((p[0] >> c) & 0xFF) + ((p[1] >> c) & 0xFF) +
+                             ((p[srcWidth] >> c) & 0xFF) + ((p[srcWidth + 1] >> c) & 0xFF);
+                result |= ((sum + 2) / 4) << c;
+            }
+            dst[(y * width) + x] = result;
+        }
+    }
+}
+
+/* Write a texture's mip chain at the current file position */
+static int writeMipChain(FILE* file, const PackSource* source, int levels) {
+    size_t pixels = (size_t)source->width * source->height;
+    Uint32* current;
+    Uint32* next;
+    int level, width = source->width, height = source->height;
+
+    if(fwrite(source->pixels, sizeof(Uint32), pixels, file) != pixels)
+        return 0;
+    if(levels == 1)
+        return 1;
+
+    current = malloc(pixels * sizeof(Uint32));
+    next = malloc(pixels * sizeof(Uint32));
+    if(!current || !next) {
+        free(current);
+        free(next);
+        return 0;
+    }
+
+    memcpy(current, source->pixels, pixels * sizeof(Uint32));
+    for(level = 1; level < levels; level++) {
+        Uint32* swap;
+
+        downsampleMipLevel(current, width, height, next);
+        width /= 2;
+        height /= 2;
+        if(fwrite(next, sizeof(Uint32), (size_t)width * height, file) != (size_t)width * height)
+            break;
+
+        swap = current;
+        current = next;
+        next = swap;
+    }
+
+    free(current);
+    free(next);
+    return level == levels;
+}
+
+int writeTexturePack(const char* path, const PackSource* textures, int count, int withMips) {
+    static const unsigned char padding[TEXTURE_PACK_ALIGNMENT];
+    TexturePackHeader header;
+    TexturePackEntry* entries = calloc(count ? count : 1, sizeof(TexturePackEntry));
+    FILE* file = fopen(path, "wb");
+    uint64_t offset;
+    int i, ok = 1;
+
+    if(!entries || !file) {
+        free(entries);
+        if(file) fclose(file);
+        return 0;
+    }
+
+    /* Lay out the textures after the header and entries */
+    memset(&header, 0, sizeof(header));
+    header.magic = TEXTURE_PACK_MAGIC;
+    header.version = TEXTURE_PACK_VERSION;
+    header.textureCount = count;
+    header.byteOrder = TEXTURE_PACK_BYTE_ORDER;
+
+    offset = ALIGN_UP(sizeof(header) + count * sizeof(TexturePackEntry), TEXTURE_PACK_ALIGNMENT);
+    for(i = 0; i < count; i++) {
+        strncpy(entries[i].name, textures[i].name, TEXTURE_PACK_NAME_SIZE - 1);
+        entries[i].width = textures[i].width;
+        entries[i].height = textures[i].height;
+        entries[i].mipLevels = withMips ? countMipLevels(textures[i].width, textures[i].height) : 1;
+        entries[i].offset = offset;
+        entries[i].size = mipChainSize(textures[i].width, textures[i].height, entries[i].mipLevels);
+        offset = ALIGN_UP(offset + entries[i].size, TEXTURE_PACK_ALIGNMENT);
+    }
+
+    ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(entries, sizeof(TexturePackEntry), count, file) == (size_t)count;
+
+    for(i = 0; ok && i < count; i++) {
+        long position = ftell(file);
+
+        ok = fwrite(padding, 1, entries[i].offset - position, file) == entries[i].offset - position &&
+            writeMipChain(file, &textures[i], entries[i].mipLevels);
+    }
+
+    free(entries);
+    if(fclose(file) != 0)
+        ok = 0;
+
+    return ok;
+}
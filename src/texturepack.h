@@ -0,0 +1,121 @@
+#ifndef TEXTUREPACK_H
+#define TEXTUREPACK_H
+
+/*
+ * Texture packs hold textures already converted to the engine's ABGR
+ * layout, so they can be mapped into memory and used in place.
+ *
+ * A pack starts with a TexturePackHeader, followed by textureCount
+ * TexturePackEntry records. Each texture's pixels follow at its entry's
+ * offset, which is a multiple of TEXTURE_PACK_ALIGNMENT: its mip levels
+ * in order, each a (width >> level) x (height >> level) array of 32-bit
+ * 0xAABBGGRR values stored row by row. So that pixels can be used in
+ * place, all fields and pixels are stored in the byte order of the host
+ * that wrote the pack, which byteOrder records; packs written on a host
+ * of the other byte order are rejected.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "gfx.h"
+
+#define TEXTURE_PACK_MAGIC      0x4B505852u  /* "RXPK" */
+#define TEXTURE_PACK_VERSION    2
+#define TEXTURE_PACK_BYTE_ORDER 0x01020304u  /* Reads back byte swapped on a host of the other byte order */
+#define TEXTURE_PACK_ALIGNMENT  64
+#define TEXTURE_PACK_NAME_SIZE  32
+
+/* Datatypes */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t textureCount;
+    uint32_t byteOrder;         /* TEXTURE_PACK_BYTE_ORDER, in the writer's byte order */
+    uint32_t reserved[12];      /* Pads the header to 64 bytes */
+} TexturePackHeader;
+
+typedef struct {
+    char name[TEXTURE_PACK_NAME_SIZE];  /* Null terminated */
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels;         /* Including the full size level */
+    uint32_t reserved;
+    uint64_t offset;            /* Of the first mip level, from the start of the pack */
+    uint64_t size;              /* Of all mip levels, in bytes */
+} TexturePackEntry;
+
+/* An open texture pack */
+typedef struct {
+    const TexturePackHeader* header;
+    const TexturePackEntry* entries;
+    const unsigned char* data;  /* The whole pack */
+    size_t size;
+    int mapped;                 /* Non-zero if data is a file mapping, zero if it was read into memory */
+} TexturePack;
+
+/* A texture to be written to a pack */
+typedef struct {
+    const char* name;
+    const Uint32* pixels;
+    int width;
+    int height;
+} PackSource;
+
+/* Functions */
+
+/**
+ * Open a texture pack by mapping it into memory read-only. Textures are
+ * used straight from the mapping, without decoding or copying. On
+ * systems without mmap the pack is read into memory instead. Packs with
+ * a texture wider or taller than MAX_TEXTURE_SIZE are rejected.
+ *
+ * path: The pack file.
+ * pack: Set to the open pack.
+ *
+ * Returns: Non-zero if the pack was opened and is valid, zero otherwise.
+ */
+int openTexturePack(const char* path, TexturePack* pack);
+
+/**
+ * Close a texture pack. Pointers into it must no longer be used.
+ *
+ * pack: The pack to close.
+ */
+void closeTexturePack(TexturePack* pack);
+
+/**
+ * Find a texture in a pack by name.
+ *
+ * pack: The pack to search.
+ * name: The texture's name.
+ *
+ * Returns: The index of the texture, or -1 if it is not in the pack.
+ */
+int findPackTexture(const TexturePack* pack, const char* name);
+
+/**
+ * Get the pixels of a mip level of a texture in a pack.
+ *
+ * pack:  The pack.
+ * index: The index of the texture.
+ * level: The mip level, 0 being the full size texture.
+ *
+ * Returns: The pixels, or NULL if the texture or level does not exist.
+ */
+const Uint32* getPackTexture(const TexturePack* pack, int index, int level);
+
+/**
+ * Write textures to a new texture pack.
+ *
+ * path:     The file to write.
+ * textures: The textures to write.
+ * count:    The number of textures.
+ * withMips: Non-zero to also store box-filtered mip levels down to 1x1,
+ *           zero to only store the full size textures.
+ *
+ * Returns: Non-zero if the pack was written, zero otherwise.
+ */
+int writeTexturePack(const char* path, const PackSource* textures, int count, int withMips);
+
+#endif /* TEXTUREPACK_H */
@@ -0,0 +1,66 @@
+#include <string.h>
+
+#include "config.h"
+#include "tilemap.h"
+
+/* Global data */
+TileMap gameMap;
+
+
+void initTileMap(TileMap* map, short* tiles, int gridWidth, int gridHeight) {
+    memset(map, 0, sizeof(*map));
+    map->tiles = tiles;
+    map->gridWidth = gridWidth;
+    map->gridHeight = gridHeight;
+}
+
+int addMapListener(TileMap* map, MapListener listener, void* context) {
+    if(map->listenerCount == MAP_MAX_LISTENERS)
+        return FALSE;
+
+    map->listeners[map->listenerCount] = listener;
+    map->listenerContexts[map->listenerCount] = context;
+    map->listenerCount++;
+    return TRUE;
+}
+
+void removeMapListener(TileMap* map, MapListener listener, void* context) {
+    int i;
+
+    for(i = 0; i < map->listenerCount; i++) {
+        if(map->listeners[i] != listener || map->listenerContexts[i] != context)
+            continue;
+
+        /* Keep the remaining listeners in order */
+        memmove(&map->listeners[i], &map->listeners[i + 1], (map->listenerCount - i - 1) * sizeof(MapListener));
+        memmove(&map->listenerContexts[i], &map->listenerContexts[i + 1], (map->listenerCount - i - 1) * sizeof(void*));
+        map->listenerCount--;
+        return;
+    }
+}
+
+int setMapTile(TileMap* map, int tileX, int tileY, short tile) {
+    short oldTile;
+    int i;
+
+    if(tileX < 0 || tileY < 0 || tileX >= map->gridWidth || tileY >= map->gridHeight)
+        return FALSE;
+
+    oldTile = map->tiles[tileY * map->gridWidth + tileX];
+    if(oldTile == tile)
+        return TRUE;
+
+    map->tiles[tileY * map->gridWidth + tileX] = tile;
+    map->edits++;
+    for(i = 0; i < map->listenerCount; i++)
+        map->listeners[i](map->listenerContexts[i], map, tileX, tileY, oldTile);
+
+    return TRUE;
+}
+
+short getMapTile(const TileMap* map, int tileX, int tileY) {
+    if(tileX < 0 || tileY < 0 || tileX >= map->gridWidth || tileY >= map->gridHeight)
+        return W;
+
+    return map->tiles[tileY * map->gridWidth + tileX];
+}
@@ -0,0 +1,104 @@
+#ifndef TILEMAP_H
+#define TILEMAP_H
+
+#include "config.h"
+
+/*
+ * A tile map wraps a map's tiles so that they can change while the game
+ * runs, for doors and walls that are built or knocked down. Structures
+ * derived from the map, such as flow fields, register a listener that is
+ * told which tile changed after every edit, so that they can update the
+ * part of themselves that depends on it instead of being rebuilt.
+ *
+ * Code that only reads the map may keep reading the tiles directly.
+ */
+
+/* Datatypes */
+struct TileMap;
+
+/**
+ * Called after a tile of a map changed.
+ *
+ * context: The context the listener was added with.
+ * map:     The map, with the new tile already in place.
+ * tileX:   The column of the tile.
+ * tileY:   The row of the tile.
+ * oldTile: The tile's value before the edit.
+ */
+typedef void (*MapListener)(void* context, const struct TileMap* map, int tileX, int tileY, short oldTile);
+
+typedef struct TileMap {
+    short* tiles;       /* Row by row. Positive tiles are walls. */
+    int gridWidth;
+    int gridHeight;
+
+    MapListener listeners[MAP_MAX_LISTENERS];
+    void* listenerContexts[MAP_MAX_LISTENERS];
+    int listenerCount;
+
+    long edits;         /* Tiles changed since the map was set up */
+} TileMap;
+
+/* Global data */
+extern TileMap gameMap;
+
+/* Functions */
+
+/**
+ * Set up a tile map without listeners.
+ *
+ * map:        The map to set up.
+ * tiles:      The tiles, row by row. They must outlive the map.
+ * gridWidth:  The width of the map in tiles.
+ * gridHeight: The height of the map in tiles.
+ */
+void initTileMap(TileMap* map, short* tiles, int gridWidth, int gridHeight);
+
+/**
+ * Have a listener told about every edit of a map from now on. Listeners
+ * are called in the order they were added.
+ *
+ * map:      The map to listen to.
+ * listener: The function to call.
+ * context:  Passed to the listener, typically the structure it updates.
+ *
+ * Returns: Zero if the map already has MAP_MAX_LISTENERS listeners,
+ *          non-zero otherwise.
+ */
+int addMapListener(TileMap* map, MapListener listener, void* context);
+
+/**
+ * Stop telling a listener about a map's edits. Does nothing if it was
+ * not added with this context.
+ *
+ * map:      The map listened to.
+ * listener: The function that was added.
+ * context:  The context it was added with.
+ */
+void removeMapListener(TileMap* map, MapListener listener, void* context);
+
+/**
+ * Change a tile, and tell the map's listeners about it if its value
+ * changed.
+ *
+ * map:   The map to edit.
+ * tileX: The column of the tile.
+ * tileY: The row of the tile.
+ * tile:  The new value of the tile.
+ *
+ * Returns: Zero if the tile is off the map, non-zero otherwise.
+ */
+int setMapTile(TileMap* map, int tileX, int tileY, short tile);
+
+/**
+ * Look up a tile.
+ *
+ * map:   The map to look in.
+ * tileX: The column of the tile.
+ * tileY: The row of the tile.
+ *
+ * Returns: The tile's value, or a wall (W) if it is off the map.
+ */
+short getMapTile(const TileMap* map, int tileX, int tileY);
+
+#endif /* TILEMAP_H */
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "config.h"
+#include "trace.h"
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+/*
+ * Every thread records its zones into its own buffer, so recording
+ * takes no locks. A buffer's owner is the only thread that writes to
+ * it: a new trace bumps traceGeneration, and each owner empties its
+ * buffer the first time it records into the new trace. The count is
+ * published after the zone it covers, so stopTrace can read the zones
+ * of other threads while they are still recording.
+ */
+typedef struct {
+    const char* name;
+    Uint64 startTime;
+    Uint64 endTime;
+} TraceZone;
+
+typedef struct {
+    const char* threadName;
+    SDL_atomic_t generation;    /* Of the trace the zones belong to */
+    SDL_atomic_t count;
+    SDL_atomic_t dropped;
+    TraceZone zones[TRACE_BUFFER_EVENTS];
+} TraceBuffer;
+
+static SDL_atomic_t tracing;
+static SDL_atomic_t traceGeneration;
+static SDL_atomic_t threadCount;
+static TraceBuffer* threadBuffers[TRACE_MAX_THREADS];
+static Uint64 traceStartTime = 0;
+static const char* tracePath = TRACE_PATH;
+
+static THREAD_LOCAL TraceBuffer* threadBuffer = NULL;
+static THREAD_LOCAL const char* threadName = NULL;
+static THREAD_LOCAL char threadBufferClaimed = FALSE;
+
+
+/* Returns the calling thread's buffer, allocating it the first time */
+static TraceBuffer* getThreadBuffer() {
+    int slot;
+
+    if(threadBufferClaimed)
+        return threadBuffer;
+    threadBufferClaimed = TRUE;
+
+    slot = SDL_AtomicAdd(&threadCount, 1);
+    if(slot >= TRACE_MAX_THREADS) {
+        fprintf(stderr, "Too many threads to trace, zones on thread %d are dropped\n", slot);
+        return NULL;
+    }
+
+    threadBuffer = calloc(1, sizeof(TraceBuffer));
+    if(!threadBuffer)
+        return NULL;
+
+    threadBuffer->threadName = threadName;
+    SDL_AtomicSet(&threadBuffer->generation, -1);
+    SDL_AtomicSetPtr((void**)&threadBuffers[slot], threadBuffer);
+
+    return threadBuffer;
+}
+
+Uint64 beginTraceZone() {
+    return SDL_AtomicGet(&tracing) ? SDL_GetPerformanceCounter() : 0;
+}
+
+void endTraceZone(const char* name, Uint64 startTime) {
+    TraceBuffer* buffer;
+    int generation, count;
+
+    /* Skip zones that began before the trace did */
+    if(!startTime || !SDL_AtomicGet(&tracing) || startTime < traceStartTime)
+        return;
+
+    buffer = getThreadBuffer();
+    if(!buffer)
+        return;
+
+    generation = SDL_AtomicGet(&traceGeneration);
+    if(SDL_AtomicGet(&buffer->generation) != generation) {
+        SDL_AtomicSet(&buffer->count, 0);
+        SDL_AtomicSet(&buffer->dropped, 0);
+        SDL_AtomicSet(&buffer->generation, generation);
+    }
+
+    count = SDL_AtomicGet(&buffer->count);
+    if(count == TRACE_BUFFER_EVENTS) {
+        SDL_AtomicAdd(&buffer->dropped, 1);
+        return;
+    }
+
+    buffer->zones[count].name = name;
+    buffer->zones[count].startTime = startTime;
+    buffer->zones[count].endTime = SDL_GetPerformanceCounter();
+    SDL_AtomicSet(&buffer->count, count + 1);
+}
+
+void setTraceThreadName(const char* name) {
+    threadName = name;
+    if(threadBuffer)
+        threadBuffer->threadName = name;
+}
+
+int startTrace(const char* path) {
+#ifndef ENABLE_TRACING
+    (void)path;
+    fprintf(stderr, "Tracing is not compiled in, build with -DENABLE_TRACING to use it\n");
+    return FALSE;
+#else
+    if(isTracing())
+        return TRUE;
+
+    tracePath = path;
+    traceStartTime = SDL_GetPerformanceCounter();
+    SDL_AtomicAdd(&traceGeneration, 1);
+    SDL_AtomicSet(&tracing, TRUE);
+
+    fprintf(stderr, "Tracing to %s\n", path);
+    return TRUE;
+#endif
+}
+
+
+/*========================================================
+ * Writing
+ *========================================================
+ */
+
+/* Convert a performance counter value to microseconds since the trace started */
+static double traceMicros(Uint64 time) {
+    return (double)(time - traceStartTime) * 1000000.0 / SDL_GetPerformanceFrequency();
+}
+
+/* Zone and thread names are identifiers and string literals, so they are written without escaping */
+void stopTrace() {
+    FILE* file;
+    int slot, i, generation, threads, zones = 0, dropped = 0;
+    const char* separator = "";
+
+    if(!isTracing())
+        return;
+    SDL_AtomicSet(&tracing, FALSE);
+
+    file = fopen(tracePath, "w");
+    if(!file) {
+        fprintf(stderr, "Could not write trace to %s\n", tracePath);
+        return;
+    }
+
+    generation = SDL_AtomicGet(&traceGeneration);
+    threads = MIN(SDL_AtomicGet(&threadCount), TRACE_MAX_THREADS);
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for(slot = 0; slot < threads; slot++) {
+        TraceBuffer* buffer = SDL_AtomicGetPtr((void**)&threadBuffers[slot]);
+        int count;
+
+        if(!buffer)
+            continue;
+
+        if(buffer->threadName) {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    separator, slot, buffer->threadName);
+            separator = ",\n";
+        }
+
+        if(SDL_AtomicGet(&buffer->generation) != generation)
+            continue;
+
+        count = SDL_AtomicGet(&buffer->count);
+        for(i = 0; i < count; i++) {
+            TraceZone* zone = &buffer->zones[i];
+
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    separator, zone->name, slot, traceMicros(zone->startTime),
+                    traceMicros(zone->endTime) - traceMicros(zone->startTime));
+            separator = ",\n";
+        }
+        zones += count;
+        dropped += SDL_AtomicGet(&buffer->dropped);
+    }
+    fprintf(file, "\n]}\n");
+
+    if(fclose(file) != 0)
+        fprintf(stderr, "Could not write trace to %s\n", tracePath);
+    else
+        fprintf(stderr, "Wrote %d zones from %d threads to %s (%d dropped)\n", zones, threads, tracePath, dropped);
+}
+
+int isTracing() {
+    return SDL_AtomicGet(&tracing);
+}
+
+void destroyTrace() {
+    int slot;
+
+    for(slot = 0; slot < TRACE_MAX_THREADS; slot++) {
+        free(threadBuffers[slot]);
+        threadBuffers[slot] = NULL;
+    }
+    threadBuffer = NULL;
+}
@@ -0,0 +1,94 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "gfx.h"
+
+/*
+ * Tracing records how long zones of the frame took on every thread, and
+ * writes them out as Chrome trace events (chrome://tracing, Perfetto).
+ *
+ * Zones are only compiled in when the game is built with ENABLE_TRACING
+ * defined (-DENABLE_TRACING), otherwise the zone macros expand to
+ * nothing. When compiled in, zones cost a flag check until a trace is
+ * started with startTrace.
+ *
+ *     TRACE_BEGIN(updateRaycaster);
+ *     updateRaycaster();
+ *     TRACE_END(updateRaycaster);
+ *
+ * A zone is named after its identifier, and must begin and end in the
+ * same block on the same thread.
+ */
+
+/* Default trace file location */
+#define TRACE_PATH           "trace.json"
+
+/* Zones each thread can record per trace. Later ones are dropped and counted. */
+#define TRACE_BUFFER_EVENTS  65536
+
+/* Threads that can record zones */
+#define TRACE_MAX_THREADS    16
+
+#ifdef ENABLE_TRACING
+#define TRACE_BEGIN(ZONE)        Uint64 ZONE##TraceStart = beginTraceZone()
+#define TRACE_END(ZONE)          endTraceZone(#ZONE, ZONE##TraceStart)
+#define TRACE_THREAD_NAME(NAME)  setTraceThreadName(NAME)
+#else
+#define TRACE_BEGIN(ZONE)
+#define TRACE_END(ZONE)
+#define TRACE_THREAD_NAME(NAME)
+#endif
+
+/* Functions */
+
+/**
+ * Start recording zones. Does nothing if a trace is already running.
+ *
+ * path: The file the trace will be written to when it is stopped.
+ *
+ * Returns: Non-zero if the trace was started, zero if tracing was not
+ *          compiled in.
+ */
+int startTrace(const char* path);
+
+/**
+ * Stop recording zones and write the trace as Chrome trace event JSON.
+ * Zones still open on other threads are left out. Does nothing if no
+ * trace is running.
+ */
+void stopTrace();
+
+/**
+ * Returns: Non-zero if a trace is running, zero otherwise.
+ */
+int isTracing();
+
+/**
+ * Free the buffers of all threads that recorded zones. Tracing must be
+ * stopped and the threads must have finished.
+ */
+void destroyTrace();
+
+/**
+ * Name the calling thread in traces.
+ *
+ * name: The thread's name. It must outlive the trace.
+ */
+void setTraceThreadName(const char* name);
+
+/**
+ * Start a zone. Use TRACE_BEGIN instead.
+ *
+ * Returns: The performance counter value, or zero if no trace is running.
+ */
+Uint64 beginTraceZone();
+
+/**
+ * Record a zone on the calling thread. Use TRACE_END instead.
+ *
+ * name:      The zone's name. It must outlive the trace.
+ * startTime: The value beginTraceZone returned. Zero skips the zone.
+ */
+void endTraceZone(const char* name, Uint64 startTime);
+
+#endif /* TRACE_H */
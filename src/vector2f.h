@@ -0,0 +1,228 @@
+#ifndef VECTOR2F_H
+#define VECTOR2F_H
+
+/*
+ * Header-only 2D vector math.
+ *
+ * The Vector3f helpers in linalg.c are out-of-line and carry a z component
+ * that the 2D operations never read. The functions below take and return
+ * 8-byte vectors by value, so they fit in a single SSE register and can be
+ * inlined into the ray loops. They produce the same results as their
+ * Vector3f counterparts.
+ */
+
+#include <math.h>
+
+#include "linalg.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Types */
+typedef struct {
+    float x;
+    float y;
+} Vector2f;
+
+/**
+ * Make a 2D vector.
+ *
+ * x: The x component.
+ * y: The y component.
+ *
+ * Returns: The vector.
+ */
+static inline Vector2f vector2f(float x, float y) {
+    Vector2f retVec;
+    retVec.x = x;
+    retVec.y = y;
+    return retVec;
+}
+
+/**
+ * Convert a homogeneous 2D vector to a 2D vector.
+ *
+ * vec: The homogeneous vector.
+ *
+ * Returns: The 2D vector.
+ */
+static inline Vector2f vector3fTo2f(const Vector3f* vec) {
+    return vector2f(vec->x, vec->y);
+}
+
+/**
+ * Convert a 2D vector to a homogeneous 2D vector.
+ * The z component of the output is fixed to '1'.
+ *
+ * vec: The 2D vector.
+ *
+ * Returns: The homogeneous vector.
+ */
+static inline Vector3f vector2fTo3f(Vector2f vec) {
+    Vector3f retVec;
+    retVec.x = vec.x;
+    retVec.y = vec.y;
+    retVec.z = 1;
+    return retVec;
+}
+
+/**
+ * Add two 2D vectors.
+ *
+ * vec1: The first vector.
+ * vec2: The second vector.
+ *
+ * Returns: The addition of vec1 and vec2.
+ */
+static inline Vector2f vector2fAdd(Vector2f vec1, Vector2f vec2) {
+    return vector2f(vec1.x + vec2.x, vec1.y + vec2.y);
+}
+
+/**
+ * Subtract one 2D vector from another.
+ *
+ * vec1: The first vector.
+ * vec2: The second vector.
+ *
+ * Returns: The subtraction of vec2 from vec1 (vec1 - vec2).
+ */
+static inline Vector2f vector2fSubtract(Vector2f vec1, Vector2f vec2) {
+    return vector2f(vec1.x - vec2.x, vec1.y - vec2.y);
+}
+
+/**
+ * Scale a 2D vector by a scalar.
+ *
+ * vec:    The vector to scale.
+ * scalar: The scalar to use.
+ *
+ * Returns: The scaled vector.
+ */
+static inline Vector2f vector2fScale(Vector2f vec, float scalar) {
+    return vector2f(vec.x * scalar, vec.y * scalar);
+}
+
+/**
+ * Find the dot product of two 2D vectors.
+ *
+ * vec1: The first vector.
+ * vec2: The second vector.
+ *
+ * Returns: Dot product of the first and second vectors.
+ */
+static inline float vector2fDotProduct(Vector2f vec1, Vector2f vec2) {
+    return vec1.x * vec2.x + vec1.y * vec2.y;
+}
+
+/**
+ * Get the magnitude of a 2D vector.
+ *
+ * vec: The vector to find the magnitude of.
+ *
+ * Returns: The magnitude (length) of the vector.
+ */
+static inline float vector2fMagnitude(Vector2f vec) {
+    return sqrtf(vec.x * vec.x + vec.y * vec.y);
+}
+
+/**
+ * Normalize a 2D vector (set its length to 1).
+ *
+ * vec: The vector to normalize.
+ *
+ * Returns: The normalized vector.
+ */
+static inline Vector2f normalizeVector2f(Vector2f vec) {
+    return vector2fScale(vec, 1.0f / vector2fMagnitude(vec));
+}
+
+/**
+ * Project a 2D vector onto another.
+ *
+ * vec1: The vector to project.
+ * vec2: The vector to project on to.
+ *
+ * Returns: The projected vector.
+ */
+static inline Vector2f vector2fProjection(Vector2f vec1, Vector2f vec2) {
+    Vector2f pvec = normalizeVector2f(vec2);
+
+    return vector2fScale(pvec, vector2fDotProduct(pvec, vec1));
+}
+
+/**
+ * Multiply a 2D vector, treated as homogeneous, by a 3D square matrix.
+ *
+ * mat: The transformation matrix.
+ * vec: The vector to be multiplied.
+ *
+ * Returns: The transformed vector.
+ */
+static inline Vector2f matrixVector2fMultiply(const Matrix3f* mat, Vector2f vec) {
+    return vector2f((*mat)[0][0] * vec.x + (*mat)[0][1] * vec.y + (*mat)[0][2],
+                    (*mat)[1][0] * vec.x + (*mat)[1][1] * vec.y + (*mat)[1][2]);
+}
+
+
+/*========================================================
+ * Batch operations
+ *========================================================
+ */
+
+/**
+ * Multiply an array of 2D vectors, treated as homogeneous, by a 3D square
+ * matrix in place. Two vectors are transformed per SSE register.
+ *
+ * mat:   The transformation matrix.
+ * vecs:  The vectors to be multiplied.
+ * count: The number of vectors in the array.
+ */
+static inline void matrixVector2fArrayMultiply(const Matrix3f* mat, Vector2f* vecs, int count) {
+    int i = 0;
+
+#if defined(__SSE2__)
+    __m128 col0 = _mm_setr_ps((*mat)[0][0], (*mat)[1][0], (*mat)[0][0], (*mat)[1][0]);
+    __m128 col1 = _mm_setr_ps((*mat)[0][1], (*mat)[1][1], (*mat)[0][1], (*mat)[1][1]);
+    __m128 col2 = _mm_setr_ps((*mat)[0][2], (*mat)[1][2], (*mat)[0][2], (*mat)[1][2]);
+
+    for(; i + 2 <= count; i += 2) {
+        __m128 v  = _mm_loadu_ps(&vecs[i].x);
+        __m128 xs = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 0, 0));
+        __m128 ys = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 1, 1));
+
+        _mm_storeu_ps(&vecs[i].x, _mm_add_ps(_mm_add_ps(_mm_mul_ps(col0, xs), _mm_mul_ps(col1, ys)), col2));
+    }
+#endif
+
+    for(; i < count; i++)
+        vecs[i] = matrixVector2fMultiply(mat, vecs[i]);
+}
+
+/**
+ * Normalize an array of 2D vectors in place.
+ * Two vectors are normalized per SSE register.
+ *
+ * vecs:  The vectors to normalize.
+ * count: The number of vectors in the array.
+ */
+static inline void normalizeVector2fArray(Vector2f* vecs, int count) {
+    int i = 0;
+
+#if defined(__SSE2__)
+    __m128 one = _mm_set1_ps(1.0f);
+
+    for(; i + 2 <= count; i += 2) {
+        __m128 v   = _mm_loadu_ps(&vecs[i].x);
+        __m128 sq  = _mm_mul_ps(v, v);
+        __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_shuffle_ps(sq, sq, _MM_SHUFFLE(2, 2, 0, 0)), _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(3, 3, 1, 1))));
+
+        _mm_storeu_ps(&vecs[i].x, _mm_mul_ps(v, _mm_div_ps(one, len)));
+    }
+#endif
+
+    for(; i < count; i++)
+        vecs[i] = normalizeVector2f(vecs[i]);
+}
+
+#endif /* VECTOR2F_H */
@@ -0,0 +1,181 @@
+/*
+ * Sample reader for the raycaster's shared-memory frame ring.
+ *
+ * Start the game with `./raycaster --export` (or press `x` while
+ * playing), then run:
+ *
+ *     gcc -O2 tools/framereader.c -o framereader -lrt
+ *     ./framereader [seconds] [last.ppm]
+ *
+ * The reader copies every frame it sees out of the ring for the given
+ * number of seconds (10 by default), then reports throughput, missed and
+ * torn frames, and the latency from publishing a frame to having copied
+ * it. If a file name is given, the last frame is saved to it as a PPM.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../src/framering.h"
+
+#define MAX_LATENCIES   (1 << 20)
+#define POLL_INTERVAL_NS 100000
+
+static uint64_t monotonicNs() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static int compareLatencies(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentileMs(uint64_t* latencies, long count, double p) {
+    return count ? latencies[(long)(p * (count - 1))] / 1e6 : 0.0;
+}
+
+static FrameRingHeader* mapRing() {
+    struct stat info;
+    FrameRingHeader* ring;
+    int fd = shm_open(FRAME_RING_NAME, O_RDONLY, 0);
+
+    if(fd < 0) {
+        perror("Could not open " FRAME_RING_NAME " (is the game exporting frames?)");
+        return NULL;
+    }
+
+    if(fstat(fd, &info) < 0 || (size_t)info.st_size < FRAME_RING_HEADER_SIZE) {
+        fprintf(stderr, "The frame ring is not initialized\n");
+        close(fd);
+        return NULL;
+    }
+
+    ring = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(ring == MAP_FAILED) {
+        perror("Could not map the frame ring");
+        return NULL;
+    }
+
+    if(__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != FRAME_RING_MAGIC || ring->version != FRAME_RING_VERSION ||
+            (uint64_t)info.st_size < frameRingSize(ring->slotCount, ring->slotSize)) {
+        fprintf(stderr, "Unsupported frame ring layout\n");
+        munmap(ring, info.st_size);
+        return NULL;
+    }
+
+    return ring;
+}
+
+/*
+ * Copy a frame out of its slot. Returns non-zero if the copy is
+ * consistent, or zero if the writer overwrote the slot meanwhile.
+ */
+static int readFrame(FrameRingHeader* ring, uint64_t frame, FrameSlotHeader* header, void* pixels, size_t maxSize) {
+    FrameSlotHeader* slot = frameRingSlot(ring, frame);
+    uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+
+    if(sequence != 2 * frame)
+        return 0;
+
+    memcpy(header, slot, sizeof(*header));
+    if(header->frameSize > maxSize)
+        return 0;
+    memcpy(pixels, slot + 1, header->frameSize);
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == sequence;
+}
+
+static void writePPM(const char* path, const FrameSlotHeader* header, const uint32_t* pixels) {
+    FILE* file = fopen(path, "wb");
+    uint32_t i;
+
+    if(!file) {
+        perror(path);
+        return;
+    }
+
+    fprintf(file, "P6\n%u %u\n255\n", header->width, header->height);
+    for(i = 0; i < header->width * header->height; i++) {
+        fputc(pixels[i] & 0xFF, file);
+        fputc((pixels[i] >> 8) & 0xFF, file);
+        fputc((pixels[i] >> 16) & 0xFF, file);
+    }
+    fclose(file);
+}
+
+int main(int argc, char** argv) {
+    double seconds = (argc > 1) ? atof(argv[1]) : 10.0;
+    struct timespec pollInterval = {0, POLL_INTERVAL_NS};
+    FrameRingHeader* ring = mapRing();
+    FrameSlotHeader header;
+    uint64_t* latencies;
+    void* pixels;
+    uint64_t start, end, lastFrame, frame;
+    long received = 0, measured, missed = 0, torn = 0;
+    double elapsed;
+
+    if(!ring)
+        return EXIT_FAILURE;
+
+    pixels = malloc(ring->slotSize);
+    latencies = malloc(MAX_LATENCIES * sizeof(uint64_t));
+    if(!pixels || !latencies) {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    memset(&header, 0, sizeof(header));
+    lastFrame = __atomic_load_n(&ring->publishedFrames, __ATOMIC_ACQUIRE);
+    start = monotonicNs();
+    end = start + (uint64_t)(seconds * 1e9);
+
+    while(monotonicNs() < end) {
+        frame = __atomic_load_n(&ring->publishedFrames, __ATOMIC_ACQUIRE);
+        if(frame == lastFrame) {
+            nanosleep(&pollInterval, NULL);
+            continue;
+        }
+
+        /* Frames that were already overwritten are missed */
+        if(frame - lastFrame > ring->slotCount - 1)
+            missed += frame - lastFrame - 1;
+        else
+            frame = lastFrame + 1;
+
+        if(readFrame(ring, frame, &header, pixels, ring->slotSize)) {
+            if(received < MAX_LATENCIES)
+                latencies[received] = monotonicNs() - header.timestampNs;
+            received++;
+        } else {
+            torn++;
+        }
+        lastFrame = frame;
+    }
+
+    elapsed = (monotonicNs() - start) / 1e9;
+    measured = (received < MAX_LATENCIES) ? received : MAX_LATENCIES;
+    qsort(latencies, measured, sizeof(uint64_t), compareLatencies);
+
+    printf("Frames received: %ld (%.1f frames/s, %.1f MB/s)\n", received, received / elapsed,
+            received * (double)header.frameSize / elapsed / 1e6);
+    printf("Frames missed:   %ld\n", missed);
+    printf("Frames torn:     %ld\n", torn);
+    printf("Publish-to-read latency: p50 %.3f ms  p95 %.3f ms  p99 %.3f ms  max %.3f ms\n",
+            percentileMs(latencies, measured, 0.50), percentileMs(latencies, measured, 0.95),
+            percentileMs(latencies, measured, 0.99), percentileMs(latencies, measured, 1.0));
+
+    if(argc > 2 && received)
+        writePPM(argv[2], &header, pixels);
+
+    return EXIT_SUCCESS;
+}
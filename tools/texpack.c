@@ -0,0 +1,186 @@
+/*
+ * Packer for the raycaster's texture pack format (see src/texturepack.h).
+ *
+ *     gcc -O2 tools/texpack.c src/texturepack.c -lSDL2 -o texpack
+ *     ./texpack [--mips] [--xor count] [--size pixels] out.pack [image.bmp ...]
+ *
+ * Textures are converted to the engine's ABGR layout and written in the
+ * order given: first `count` procedural XOR textures (the game's red,
+ * green, blue and gray set, then variations of it), then the BMP files.
+ * The game uses the first four textures in a pack as its wall textures,
+ * which may each be any size up to MAX_TEXTURE_SIZE (4096) pixels, though
+ * power of two widths are drawn faster.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/texturepack.h"
+
+#define MAX_TEXTURES  65536
+
+/* Channel masks of the procedural textures, cycled through in order */
+static const int xorMasks[][3] = {
+    {0xFF, 0x00, 0x00},
+    {0x00, 0xFF, 0x00},
+    {0x00, 0x00, 0xFF},
+    {0xFF, 0xFF, 0xFF},
+    {0xFF, 0xFF, 0x00},
+    {0xFF, 0x00, 0xFF},
+    {0x00, 0xFF, 0xFF}
+};
+#define NUM_XOR_MASKS  (int)(sizeof(xorMasks) / sizeof(xorMasks[0]))
+
+static const char* xorNames[] = {"xor-red", "xor-green", "xor-blue", "xor-gray"};
+
+/*
+ * Generate a XOR texture. Variation 0 matches generateXorTexture in
+ * gfx.c, later variations shift the pattern.
+ */
+static Uint32* generateXorPixels(int size, const int* masks, int variation) {
+    Uint32* pixels = malloc((size_t)size * size * sizeof(Uint32));
+    float factor = 256.0f / (float)size;
+    int x, y;
+
+    if(!pixels)
+        return NULL;
+
+    for(x = 0; x < size; x++) {
+        for(y = 0; y < size; y++) {
+            int v = (int)((((x + variation) % size) ^ y) * factor);
+            pixels[(size * y) + x] = RGBtoABGR(v & masks[0], v & masks[1], v & masks[2]);
+        }
+    }
+
+    return pixels;
+}
+
+/* Load a BMP and convert it to ABGR rows without padding */
+static Uint32* loadBMPPixels(const char* path, int* width, int* height) {
+    SDL_Surface* loaded = SDL_LoadBMP(path);
+    SDL_Surface* converted;
+    Uint32* pixels = NULL;
+    int y;
+
+    if(!loaded) {
+        fprintf(stderr, "Could not load %s: %s\n", path, SDL_GetError());
+        return NULL;
+    }
+
+    converted = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ABGR8888, 0);
+    SDL_FreeSurface(loaded);
+    if(!converted) {
+        fprintf(stderr, "Could not convert %s: %s\n", path, SDL_GetError());
+        return NULL;
+    }
+
+    *width = converted->w;
+    *height = converted->h;
+    pixels = malloc((size_t)converted->w * converted->h * sizeof(Uint32));
+    if(pixels) {
+        SDL_LockSurface(converted);
+        for(y = 0; y < converted->h; y++)
+            memcpy(pixels + (size_t)y * converted->w, (char*)converted->pixels + (size_t)y * converted->pitch,
+                    converted->w * sizeof(Uint32));
+        SDL_UnlockSurface(converted);
+    }
+
+    SDL_FreeSurface(converted);
+    return pixels;
+}
+
+/* Name a texture after its file, without directories or extension */
+static char* textureNameForPath(const char* path) {
+    const char* base = strrchr(path, '/');
+    char* name;
+    char* dot;
+
+    base = base ? base + 1 : path;
+    name = malloc(TEXTURE_PACK_NAME_SIZE);
+    if(!name)
+        return NULL;
+
+    strncpy(name, base, TEXTURE_PACK_NAME_SIZE - 1);
+    name[TEXTURE_PACK_NAME_SIZE - 1] = '\0';
+    dot = strrchr(name, '.');
+    if(dot)
+        *dot = '\0';
+
+    return name;
+}
+
+static void usage() {
+    fprintf(stderr, "Usage: texpack [--mips] [--xor count] [--size pixels] out.pack [image.bmp ...]\n");
+}
+
+int main(int argc, char** argv) {
+    PackSource* textures = calloc(MAX_TEXTURES, sizeof(PackSource));
+    int withMips = 0, xorCount = 0, xorSize = 64, count = 0, i, status;
+    const char* outPath = NULL;
+
+    if(!textures)
+        return EXIT_FAILURE;
+
+    for(i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if(!strcmp(argv[i], "--mips")) {
+            withMips = 1;
+        } else if(!strcmp(argv[i], "--xor") && i + 1 < argc) {
+            xorCount = atoi(argv[++i]);
+        } else if(!strcmp(argv[i], "--size") && i + 1 < argc) {
+            xorSize = atoi(argv[++i]);
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(i == argc || xorCount < 0 || xorSize <= 0 || xorCount + argc - i - 1 > MAX_TEXTURES) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    outPath = argv[i++];
+
+    for(; count < xorCount; count++) {
+        char* name = malloc(TEXTURE_PACK_NAME_SIZE);
+        if(!name)
+            return EXIT_FAILURE;
+
+        if(count < 4)
+            strcpy(name, xorNames[count]);
+        else
+            sprintf(name, "xor-%d", count);
+
+        textures[count].name = name;
+        textures[count].width = textures[count].height = xorSize;
+        textures[count].pixels = generateXorPixels(xorSize, xorMasks[count % NUM_XOR_MASKS], count / NUM_XOR_MASKS);
+        if(!textures[count].pixels)
+            return EXIT_FAILURE;
+    }
+
+    if(i < argc && SDL_Init(0) < 0) {
+        fprintf(stderr, "Could not initialize SDL: %s\n", SDL_GetError());
+        return EXIT_FAILURE;
+    }
+
+    for(; i < argc; i++, count++) {
+        textures[count].name = textureNameForPath(argv[i]);
+        textures[count].pixels = loadBMPPixels(argv[i], &textures[count].width, &textures[count].height);
+        if(!textures[count].name || !textures[count].pixels)
+            return EXIT_FAILURE;
+    }
+
+    status = writeTexturePack(outPath, textures, count, withMips);
+    if(status)
+        printf("Wrote %d textures%s to %s\n", count, withMips ? " with mip levels" : "", outPath);
+    else
+        fprintf(stderr, "Could not write %s\n", outPath);
+
+    for(i = 0; i < count; i++) {
+        free((void*)textures[i].name);
+        free((void*)textures[i].pixels);
+    }
+    free(textures);
+    SDL_Quit();
+
+    return status ? EXIT_SUCCESS : EXIT_FAILURE;
+}